@@ -0,0 +1,93 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/* Part of Arduino core API used by firmware, implemented for host build on emulated board (host.h) */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "host.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+
+static const uint8_t A0 = 14;
+static const uint8_t A1 = 15;
+static const uint8_t A2 = 16;
+static const uint8_t A3 = 17;
+static const uint8_t A4 = 18;
+static const uint8_t A5 = 19;
+static const uint8_t A6 = 20;
+static const uint8_t A7 = 21;
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+// 32 bit and wrapping like on AVR, firmware subtracts them from uint32_t timestamps
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+inline void interrupts(void) {}
+inline void noInterrupts(void) {}
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t byte) = 0;
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(const __FlashStringHelper *str) { return write(reinterpret_cast<const char *>(str)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println(void) { return write("\r\n"); }
+  template <typename T>
+  size_t println(T value) { return print(value) + println(); }
+  template <typename T>
+  size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+class HardwareSerial : public Print
+{
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void end(void) {}
+  int available(void);
+  int peek(void);
+  int read(void);
+  int availableForWrite(void) { return HOST_RX_SIZE; }
+  void flush(void) {} // bytes are passed to board owner synchronously
+  size_t write(uint8_t byte) override;
+  using Print::write;
+  operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
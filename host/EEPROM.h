@@ -0,0 +1,54 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+/* EEPROM library for host build. Memory belongs to emulated board, writes are counted for wear statistics */
+
+#include <string.h>
+#include "host.h"
+
+class EEPROMClass
+{
+public:
+  uint8_t read(int idx) { return in_range(idx) ? host_board->eeprom[idx] : 0xFF; }
+  void write(int idx, uint8_t value)
+  {
+    if (!in_range(idx))
+      return;
+    host_board->eeprom[idx] = value;
+    host_board->eeprom_dirty = 1;
+    host_board->eeprom_writes++;
+  }
+  void update(int idx, uint8_t value)
+  {
+    if (read(idx) != value)
+      write(idx, value);
+  }
+  uint16_t length(void) { return HOST_EEPROM_SIZE; }
+
+  template <typename T>
+  T &get(int idx, T &t)
+  {
+    uint8_t *ptr = (uint8_t *)&t;
+    for (size_t i = 0; i < sizeof(T); i++)
+      ptr[i] = read(idx + i);
+    return t;
+  }
+
+  template <typename T>
+  const T &put(int idx, const T &t)
+  {
+    const uint8_t *ptr = (const uint8_t *)&t;
+    for (size_t i = 0; i < sizeof(T); i++)
+      update(idx + i, ptr[i]);
+    return t;
+  }
+
+private:
+  static bool in_range(int idx) { return idx >= 0 && idx < HOST_EEPROM_SIZE; }
+};
+
+extern EEPROMClass EEPROM;
+
+inline int eeprom_is_ready(void) { return 1; } // emulated write doesn't take time
+
+#endif
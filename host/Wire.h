@@ -0,0 +1,38 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+/* Wire library for host build. Transfers go to devices attached to I2C bus of emulated board (host.h).
+   Buffer is 32 bytes like in AVR core, so transfers too long for real board fail here too */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "host.h"
+
+#define BUFFER_LENGTH 32
+
+class TwoWire
+{
+public:
+  void begin(void) {}
+  void setClock(uint32_t clock) { (void)clock; }
+  void beginTransmission(uint8_t address);
+  uint8_t endTransmission(uint8_t stop = 1); // 0 - done, 1 - too long, 2 - address not acknowledged
+  size_t write(uint8_t byte);
+  size_t write(const uint8_t *data, size_t len);
+  uint8_t requestFrom(uint8_t address, uint8_t len);
+  int available(void) { return rx_len - rx_pos; }
+  int read(void) { return rx_pos < rx_len ? rx[rx_pos++] : -1; }
+
+private:
+  uint8_t tx_address;
+  uint8_t tx[BUFFER_LENGTH];
+  uint8_t tx_len;
+  uint8_t is_overflow;
+  uint8_t rx[BUFFER_LENGTH];
+  uint8_t rx_len;
+  uint8_t rx_pos;
+};
+
+extern thread_local TwoWire Wire;
+
+#endif
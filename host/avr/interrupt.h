@@ -0,0 +1,10 @@
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+/* Interrupt handlers become plain functions, host code may call them to emulate interrupt */
+
+#define ISR(vector, ...) extern "C" void vector(void)
+#define sei()
+#define cli()
+
+#endif
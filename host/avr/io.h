@@ -0,0 +1,52 @@
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+/* Registers of peripherals which firmware configures outside of __AVR__ guarded code.
+   On host they are plain memory: writes are kept, nothing is generated by them except free running ADC
+   (host.cpp calls ADC_vect with level of HOST_BOARD::analog while clock goes), Timer1 in normal mode (TCNT1 counts
+   with clock, TIMER1_COMPA_vect and TIMER1_COMPB_vect are called on compare matches; no input capture), Timer2 compare interrupt in CTC mode
+   (TIMER2_COMPA_vect is called every OCR2A + 1 timer ticks of clock) and TWI slave (TWI_vect is called by
+   transfers of host_twi_write() and host_twi_read()), pin change interrupts (PCINTn_vect is called by
+   host_pin_input() when level seen by firmware changes on pin enabled in PCICR and PCMSKn).
+   GPIOR0 takes cycle marks (include/cycle_marks.h) */
+
+#include <stdint.h>
+
+extern thread_local volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1; // per thread like firmware globals
+extern thread_local volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B;
+extern thread_local volatile uint8_t TCCR2A, TCCR2B, TIMSK2, OCR2A;
+extern thread_local volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+extern thread_local volatile uint16_t ADC;
+extern thread_local volatile uint8_t TWAR, TWCR, TWDR, TWSR;
+extern thread_local volatile uint8_t GPIOR0;
+extern thread_local volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+
+#define _BV(bit) (1 << (bit))
+
+#define ICNC1 7
+#define ICES1 6
+#define CS11 1
+#define ICIE1 5
+#define OCIE1B 2
+#define OCIE1A 1
+#define ICF1 5
+#define OCF1B 2
+#define OCF1A 1
+#define WGM21 1
+#define CS22 2
+#define OCIE2A 1
+#define REFS0 6
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define TWINT 7
+#define TWEA 6
+#define TWSTO 4
+#define TWEN 2
+#define TWIE 0
+
+#endif
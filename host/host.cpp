@@ -0,0 +1,450 @@
+#include <time.h>
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Wire.h>
+#include <util/twi.h>
+#include "host.h"
+
+thread_local HOST_BOARD *host_board;
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+thread_local TwoWire Wire; // transfer buffers belong to board running on thread
+
+thread_local volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+thread_local volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B;
+thread_local volatile uint8_t TCCR2A, TCCR2B, TIMSK2, OCR2A;
+thread_local volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+thread_local volatile uint16_t ADC;
+thread_local volatile uint8_t TWAR, TWCR, TWDR, TWSR;
+thread_local volatile uint8_t GPIOR0;
+thread_local volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+
+extern "C" void ADC_vect(void) __attribute__((weak)); // firmware interrupt handlers, if it has them
+extern "C" void TWI_vect(void) __attribute__((weak));
+extern "C" void PCINT0_vect(void) __attribute__((weak));
+extern "C" void PCINT1_vect(void) __attribute__((weak));
+extern "C" void PCINT2_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPB_vect(void) __attribute__((weak));
+extern "C" void TIMER2_COMPA_vect(void) __attribute__((weak));
+
+static uint64_t real_time_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void host_board_init(HOST_BOARD *board, uint8_t virtual_clock)
+{
+  memset(board, 0, sizeof(*board));
+  board->virtual_clock = virtual_clock;
+  board->clock_us = virtual_clock ? 0 : real_time_us();
+  memset(board->pin_input, HOST_FLOATING, sizeof(board->pin_input));
+  memset(board->eeprom, 0, sizeof(board->eeprom)); // as after clear_rom, firmware doesn't expect 0xFF of new chip
+  board->de_pin = -1;
+  board->tick_us = HOST_TICK_US;
+}
+
+uint64_t host_now_us(HOST_BOARD *board)
+{
+  return board->virtual_clock ? board->clock_us : real_time_us() - board->clock_us;
+}
+
+void host_advance(HOST_BOARD *board, uint64_t us)
+{
+  if (board->virtual_clock)
+    board->clock_us += us;
+}
+
+uint16_t host_serial_space(HOST_BOARD *board)
+{
+  return HOST_RX_SIZE - board->rx_used;
+}
+
+uint16_t host_serial_feed(HOST_BOARD *board, const uint8_t *data, uint16_t len)
+{
+  uint16_t n = 0;
+  for (; n < len && board->rx_used < HOST_RX_SIZE; n++)
+  {
+    board->rx[board->rx_head] = data[n];
+    board->rx_head = (board->rx_head + 1) % HOST_RX_SIZE;
+    board->rx_used++;
+  }
+  board->rx_lost += len - n;
+  return n;
+}
+
+static void host_pin_change(uint8_t pin)
+{
+  // Pin change interrupt of group: D8 - D13 PCINT0, A0 - A5 PCINT1, D0 - D7 PCINT2
+  uint8_t group = pin < 8 ? 2 : (pin < 14 ? 0 : 1);
+  uint8_t bit = pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14);
+  volatile uint8_t *pcmsk = group == 0 ? &PCMSK0 : (group == 1 ? &PCMSK1 : &PCMSK2);
+  void (*vector)(void) = group == 0 ? PCINT0_vect : (group == 1 ? PCINT1_vect : PCINT2_vect);
+  if (pin < A6 && (PCICR & _BV(group)) && (*pcmsk & _BV(bit)) && vector)
+    vector();
+}
+
+void host_pin_input(HOST_BOARD *board, uint8_t pin, uint8_t level)
+{
+  if (pin >= HOST_PINS)
+    return;
+  uint8_t was = host_pin_level(board, pin);
+  board->pin_input[pin] = level;
+  if (board->pin_mode[pin] != OUTPUT && host_pin_level(board, pin) != was && board == host_board)
+    host_pin_change(pin);
+}
+
+uint8_t host_pin_level(HOST_BOARD *board, uint8_t pin)
+{
+  if (pin >= HOST_PINS)
+    return 0;
+  if (board->pin_mode[pin] == OUTPUT)
+    return board->pin_latch[pin];
+  if (board->pin_input[pin] != HOST_FLOATING)
+    return board->pin_input[pin];
+  return board->pin_latch[pin]; // pull-up keeps floating input high
+}
+
+void host_analog_input(HOST_BOARD *board, uint8_t pin, uint16_t value)
+{
+  if (pin >= A0 && pin < A0 + 8)
+    board->analog[pin - A0] = value > 1023 ? 1023 : value;
+}
+
+static void host_adc_run(HOST_BOARD *board, uint64_t now)
+{
+  // Free running ADC with interrupt: conversions completed since last clock read are given to ADC_vect
+  const uint8_t mode = _BV(ADEN) | _BV(ADATE) | _BV(ADIE);
+  if ((ADCSRA & mode) != mode || !ADC_vect)
+  {
+    board->adc_running = 0;
+    return;
+  }
+  if (!board->adc_running)
+  {
+    board->adc_next_us = now + HOST_ADC_US;
+    board->adc_running = 1;
+  }
+  else if (now > board->adc_next_us + HOST_ADC_BATCH * HOST_ADC_US)
+  {
+    board->adc_next_us = now - HOST_ADC_BATCH * HOST_ADC_US; // long gap: only last conversions are taken
+  }
+  for (; board->adc_next_us <= now; board->adc_next_us += HOST_ADC_US)
+  {
+    ADC = board->analog[ADMUX & 7];
+    ADC_vect();
+  }
+}
+
+static void host_timer1_run(HOST_BOARD *board, uint64_t now)
+{
+  // Timer1 in normal mode: TCNT1 gets ticks since last clock read, compare matches on the way call
+  // TIMER1_COMPA_vect and TIMER1_COMPB_vect in order of time
+  static const uint16_t prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+  uint16_t prescaler = prescalers[TCCR1B & 7];
+  if (prescaler == 0)
+  {
+    board->timer1_running = 0;
+    return;
+  }
+  if (board->timer1_in_isr)
+    return;
+  uint64_t ticks = now * HOST_CPU_MHZ / prescaler;
+  if (!board->timer1_running)
+  {
+    board->timer1_ticks = ticks;
+    board->timer1_running = 1;
+  }
+  board->timer1_in_isr = 1;
+  while (board->timer1_ticks < ticks)
+  {
+    // ticks until TCNT1 reaches compare register: 1 .. 65536
+    uint32_t to_a = (TIMSK1 & _BV(OCIE1A)) && TIMER1_COMPA_vect ? (uint16_t)(OCR1A - TCNT1 - 1) + 1UL : 0x20000UL;
+    uint32_t to_b = (TIMSK1 & _BV(OCIE1B)) && TIMER1_COMPB_vect ? (uint16_t)(OCR1B - TCNT1 - 1) + 1UL : 0x20000UL;
+    uint64_t step = to_a < to_b ? to_a : to_b;
+    if (step > ticks - board->timer1_ticks)
+    {
+      TCNT1 += (uint16_t)(ticks - board->timer1_ticks);
+      board->timer1_ticks = ticks;
+      break;
+    }
+    TCNT1 += (uint16_t)step;
+    board->timer1_ticks += step;
+    if (to_b == step)
+      TIMER1_COMPB_vect(); // crossing first, it arms compare A
+    if (to_a == step && (TIMSK1 & _BV(OCIE1A)))
+      TIMER1_COMPA_vect();
+  }
+  board->timer1_in_isr = 0;
+}
+
+static void host_timer2_run(HOST_BOARD *board, uint64_t now)
+{
+  // Compare A interrupt of Timer2 in CTC mode: interrupts due since last clock read are given to TIMER2_COMPA_vect
+  static const uint16_t prescalers[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+  uint16_t prescaler = prescalers[TCCR2B & 7];
+  if (!(TIMSK2 & _BV(OCIE2A)) || !(TCCR2A & _BV(WGM21)) || prescaler == 0 || !TIMER2_COMPA_vect)
+  {
+    board->timer2_running = 0;
+    return;
+  }
+  uint32_t period_us = (OCR2A + 1UL) * prescaler / HOST_CPU_MHZ;
+  if (!board->timer2_running)
+  {
+    board->timer2_next_us = now + period_us;
+    board->timer2_running = 1;
+  }
+  for (; board->timer2_next_us <= now && (TIMSK2 & _BV(OCIE2A)); board->timer2_next_us += period_us)
+    TIMER2_COMPA_vect();
+}
+
+static uint8_t host_twi_is_slave(uint8_t address)
+{
+  const uint8_t mode = _BV(TWEN) | _BV(TWIE) | _BV(TWEA);
+  return TWI_vect && (TWCR & mode) == mode && (TWAR >> 1) == address;
+}
+
+static void host_twi_event(uint8_t status)
+{
+  TWSR = status;
+  TWI_vect();
+}
+
+uint8_t host_twi_write(uint8_t address, const uint8_t *data, uint8_t len)
+{
+  // start, address with write bit, data bytes, stop: every step is one interrupt like on TWI hardware
+  if (!host_twi_is_slave(address))
+    return 0;
+  host_twi_event(TW_SR_SLA_ACK);
+  for (uint8_t i = 0; i < len; i++)
+  {
+    TWDR = data[i];
+    host_twi_event(TW_SR_DATA_ACK);
+  }
+  host_twi_event(TW_SR_STOP);
+  return 1;
+}
+
+uint8_t host_twi_read(uint8_t address, uint8_t *data, uint8_t len)
+{
+  // start, address with read bit, bytes acknowledged by master except the last one, stop
+  if (!host_twi_is_slave(address) || len == 0)
+    return 0;
+  host_twi_event(TW_ST_SLA_ACK);
+  for (uint8_t i = 0; i < len; i++)
+  {
+    data[i] = TWDR;
+    if (i + 1 < len)
+      host_twi_event(TW_ST_DATA_ACK);
+  }
+  host_twi_event(TW_ST_DATA_NACK);
+  return 1;
+}
+
+uint8_t host_i2c_attach(HOST_BOARD *board, HOST_I2C_DEVICE *dev)
+{
+  for (uint8_t i = 0; i < HOST_I2C_DEVICES; i++)
+  {
+    if (!board->i2c[i])
+    {
+      board->i2c[i] = dev;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+HOST_I2C_DEVICE *host_i2c_find(HOST_BOARD *board, uint8_t address)
+{
+  for (uint8_t i = 0; i < HOST_I2C_DEVICES; i++)
+    if (board->i2c[i] && board->i2c[i]->address == address)
+      return board->i2c[i];
+  return 0;
+}
+
+static uint64_t host_clock_step(void)
+{
+  uint64_t now = host_now_us(host_board);
+  host_advance(host_board, host_board->tick_us);
+  host_adc_run(host_board, now);
+  host_timer1_run(host_board, now);
+  host_timer2_run(host_board, now);
+  return now;
+}
+
+uint32_t millis(void)
+{
+  return (uint32_t)(host_clock_step() / 1000);
+}
+
+uint32_t micros(void)
+{
+  return (uint32_t)host_clock_step();
+}
+
+void delay(unsigned long ms)
+{
+  if (host_board->virtual_clock)
+  {
+    host_advance(host_board, ms * 1000ULL);
+    return;
+  }
+  struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+  nanosleep(&ts, 0);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  if (host_board->virtual_clock)
+  {
+    host_advance(host_board, us);
+    return;
+  }
+  uint64_t start = real_time_us();
+  while (real_time_us() - start < us)
+    ;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin >= HOST_PINS)
+    return;
+  host_board->pin_mode[pin] = mode;
+  if (mode == INPUT_PULLUP)
+    host_board->pin_latch[pin] = 1;
+  else if (mode == INPUT)
+    host_board->pin_latch[pin] = 0;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin < HOST_PINS)
+    host_board->pin_latch[pin] = value != 0;
+}
+
+int digitalRead(uint8_t pin)
+{
+  return host_pin_level(host_board, pin);
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+    n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(long n, int base)
+{
+  if (n < 0 && base == DEC)
+    return print('-') + print((unsigned long)-n, base);
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2)
+    base = DEC;
+  do
+  {
+    char digit = n % base;
+    n /= base;
+    *--str = digit < 10 ? digit + '0' : digit + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::print(double n, int digits)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+int HardwareSerial::available(void)
+{
+  return host_board->rx_used;
+}
+
+int HardwareSerial::peek(void)
+{
+  if (host_board->rx_used == 0)
+    return -1;
+  return host_board->rx[host_board->rx_tail];
+}
+
+int HardwareSerial::read(void)
+{
+  int byte = peek();
+  if (byte < 0)
+    return byte;
+  host_board->rx_tail = (host_board->rx_tail + 1) % HOST_RX_SIZE;
+  host_board->rx_used--;
+  return byte;
+}
+
+size_t HardwareSerial::write(uint8_t byte)
+{
+  HOST_BOARD *board = host_board;
+  if (!board->tx)
+    return 1;
+  uint8_t to_bus = board->de_pin < 0 || host_pin_level(board, board->de_pin);
+  board->tx(board, byte, to_bus);
+  return 1;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  tx_address = address;
+  tx_len = 0;
+  is_overflow = 0;
+}
+
+size_t TwoWire::write(uint8_t byte)
+{
+  if (tx_len >= BUFFER_LENGTH)
+  {
+    is_overflow = 1;
+    return 0;
+  }
+  tx[tx_len++] = byte;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t len)
+{
+  size_t n = 0;
+  while (n < len && write(data[n]))
+    n++;
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(uint8_t stop)
+{
+  (void)stop; // repeated start doesn't matter for emulated devices
+  if (is_overflow)
+    return 1;
+  HOST_I2C_DEVICE *dev = host_i2c_find(host_board, tx_address);
+  if (!dev || !dev->write(dev, tx, tx_len))
+    return 2;
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t len)
+{
+  HOST_I2C_DEVICE *dev = host_i2c_find(host_board, address);
+  rx_pos = 0;
+  rx_len = 0;
+  if (len > BUFFER_LENGTH)
+    len = BUFFER_LENGTH;
+  if (dev)
+    rx_len = dev->read(dev, rx, len);
+  return rx_len;
+}
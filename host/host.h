@@ -0,0 +1,85 @@
+#ifndef HOST_H
+#define HOST_H
+
+/* Emulated board for host build of firmware (env:native).
+   Firmware code calls Arduino API (host/Arduino.h, host/EEPROM.h) which works on board selected by host_board,
+   so one process can run one board (host_main.cpp) or switch between many boards.
+   Clock is real (monotonic time from board init) or virtual: virtual time moves only by host_advance(), delay()
+   and by tick_us on every clock read, so busy waits of firmware end and runs are repeatable */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HOST_PINS 22           // D0 - D13, A0 - A7
+#define HOST_EEPROM_SIZE 1024  // ATmega328P
+#define HOST_RX_SIZE 64        // same as Arduino core serial buffer. Bytes fed above it are lost like on overrun
+#define HOST_TICK_US 4         // default of HOST_BOARD::tick_us
+#define HOST_FLOATING 0xFF     // nothing drives input pin
+#define HOST_I2C_DEVICES 4     // devices on I2C bus of one board
+#define HOST_ADC_US 104        // free running conversion with prescaler 128
+#define HOST_CPU_MHZ 16        // timer ticks of emulated peripherals
+#define HOST_ADC_BATCH 256     // max conversions given to ADC_vect by one clock read, longer gaps are skipped
+
+// Device on I2C bus of board. Transfers are passed whole: write() gets bytes sent by master between start and stop,
+// read() fills bytes requested by master
+struct HOST_I2C_DEVICE
+{
+  uint8_t address;
+  uint8_t (*write)(HOST_I2C_DEVICE *dev, const uint8_t *data, uint8_t len); // returns 0 - address not acknowledged
+  uint8_t (*read)(HOST_I2C_DEVICE *dev, uint8_t *data, uint8_t len);        // returns bytes given
+  void *user;
+};
+
+struct HOST_BOARD
+{
+  uint8_t virtual_clock;                // 0 - real time, 1 - virtual time
+  uint64_t clock_us;                    // virtual time, or real time of board init
+  uint16_t tick_us;                     // virtual time spent by every millis()/micros() call
+  uint8_t pin_mode[HOST_PINS];          // INPUT, OUTPUT or INPUT_PULLUP
+  uint8_t pin_latch[HOST_PINS];         // PORTx bit: output level or pull-up of input
+  uint8_t pin_input[HOST_PINS];         // level driven from outside or HOST_FLOATING
+  uint8_t eeprom[HOST_EEPROM_SIZE];
+  uint8_t eeprom_dirty;                 // EEPROM changed since flag was cleared
+  uint32_t eeprom_writes;               // bytes actually written (update() of same value is not counted)
+  uint8_t rx[HOST_RX_SIZE];
+  uint16_t rx_head;
+  uint16_t rx_tail;
+  uint16_t rx_used;
+  uint32_t rx_lost;                     // bytes lost because buffer was full
+  int8_t de_pin;                        // pin of RS-485 transceiver driver enable, -1 - UART without transceiver
+  void (*tx)(HOST_BOARD *board, uint8_t byte, uint8_t to_bus); // sent byte. to_bus 0 - transceiver driver is disabled
+  HOST_I2C_DEVICE *i2c[HOST_I2C_DEVICES]; // attached devices, 0 - free place
+  uint16_t analog[8];                   // ADC result of A0 .. A7: 0 .. 1023
+  uint8_t adc_running;                  // free running conversion was seen enabled
+  uint64_t adc_next_us;                 // time of next conversion
+  uint8_t timer2_running;               // Timer2 compare interrupt was seen enabled
+  uint64_t timer2_next_us;              // time of next compare match
+  uint8_t timer1_running;               // Timer1 clock was seen selected
+  uint64_t timer1_ticks;                // Timer1 ticks given to TCNT1 since boot
+  uint8_t timer1_in_isr;                // compare interrupt is running, its clock reads don't run timer
+  void *user;                           // owner of board
+};
+
+extern thread_local HOST_BOARD *host_board; // board of firmware code running on this thread
+
+void host_board_init(HOST_BOARD *board, uint8_t virtual_clock);
+uint64_t host_now_us(HOST_BOARD *board);
+void host_advance(HOST_BOARD *board, uint64_t us);
+uint16_t host_serial_feed(HOST_BOARD *board, const uint8_t *data, uint16_t len); // returns accepted bytes
+uint16_t host_serial_space(HOST_BOARD *board);
+void host_pin_input(HOST_BOARD *board, uint8_t pin, uint8_t level);
+uint8_t host_pin_level(HOST_BOARD *board, uint8_t pin); // level seen from outside of board
+void host_analog_input(HOST_BOARD *board, uint8_t pin, uint16_t value); // voltage on A0 .. A7 as ADC result
+// Master transfers to TWI slave of firmware running on this thread (host_board). Return 0 if address is not acknowledged
+uint8_t host_twi_write(uint8_t address, const uint8_t *data, uint8_t len);
+uint8_t host_twi_read(uint8_t address, uint8_t *data, uint8_t len);
+uint8_t host_i2c_attach(HOST_BOARD *board, HOST_I2C_DEVICE *dev); // returns 0 if bus is full
+HOST_I2C_DEVICE *host_i2c_find(HOST_BOARD *board, uint8_t address);
+
+// Firmware globals are thread_local on host (FW_STATE in src/main.cpp). Many boards share thread by saving
+// state of one board to its image and loading state of next one before its loop()
+size_t fw_state_size(void);
+void fw_state_save(uint8_t *image);
+void fw_state_load(const uint8_t *image);
+
+#endif
@@ -0,0 +1,119 @@
+/* Runs firmware as host process on one emulated board in real time.
+   Serial is connected to stdin and stdout. Environment:
+   HOST_EEPROM      - file keeping EEPROM between runs (default "eeprom.bin")
+   HOST_BUS_DE_PIN  - pin of RS-485 transceiver driver enable. Bytes sent while driver is disabled go to stderr
+                      (USB side of node) instead of stdout (bus)
+   HOST_I2C_ROM     - file of emulated I2C memory for STORAGE_I2C build (env:native_i2c), memory is attached only
+                      when it is set
+   HOST_I2C_ROM_SIZE, HOST_I2C_ROM_PAGE - memory size (default 4096) and page (default 32, 0 - FRAM)
+   HOST_AMBIENT     - ADC result (0..1023) of ambient sensor on A6 and A7 (default 0 - dark)
+   Process exits when stdin is closed and received bytes are executed */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <Arduino.h>
+#include "host.h"
+#include "i2c_mem.h"
+
+#define HOST_IDLE_US 200          // sleep between loop() calls, so many processes could share CPU
+#define HOST_EXIT_GRACE_MS 300    // time for executing commands after stdin is closed
+#define HOST_I2C_ROM_ADDRESS 0x50
+#define HOST_I2C_ROM_WRITE_US 5000 // 24Cxx write cycle
+
+void setup();
+void loop();
+
+static void stdio_tx(HOST_BOARD *board, uint8_t byte, uint8_t to_bus)
+{
+  (void)board;
+  fputc(byte, to_bus ? stdout : stderr);
+}
+
+static void file_load(uint8_t *data, size_t size, const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return;
+  size_t n = fread(data, 1, size, file);
+  (void)n;
+  fclose(file);
+}
+
+static void file_save(const uint8_t *data, size_t size, const char *path)
+{
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return;
+  fwrite(data, 1, size, file);
+  fclose(file);
+}
+
+int main(void)
+{
+  static HOST_BOARD board;
+  const char *eeprom_path = getenv("HOST_EEPROM") ? getenv("HOST_EEPROM") : "eeprom.bin";
+  const char *de_pin = getenv("HOST_BUS_DE_PIN");
+  const char *i2c_rom_path = getenv("HOST_I2C_ROM");
+  static HOST_I2C_MEM i2c_rom;
+  static uint8_t *i2c_rom_data;
+
+  host_board_init(&board, 0);
+  host_board = &board;
+  file_load(board.eeprom, sizeof(board.eeprom), eeprom_path);
+  if (i2c_rom_path)
+  {
+    uint32_t size = getenv("HOST_I2C_ROM_SIZE") ? strtoul(getenv("HOST_I2C_ROM_SIZE"), 0, 0) : 4096;
+    uint16_t page = getenv("HOST_I2C_ROM_PAGE") ? strtoul(getenv("HOST_I2C_ROM_PAGE"), 0, 0) : 32;
+    i2c_rom_data = (uint8_t *)calloc(size, 1);
+    file_load(i2c_rom_data, size, i2c_rom_path);
+    host_i2c_mem_init(&i2c_rom, &board, HOST_I2C_ROM_ADDRESS, i2c_rom_data, size, page, HOST_I2C_ROM_WRITE_US);
+    host_i2c_attach(&board, &i2c_rom.dev);
+  }
+  if (de_pin)
+    board.de_pin = atoi(de_pin);
+  if (getenv("HOST_AMBIENT"))
+  {
+    host_analog_input(&board, A6, atoi(getenv("HOST_AMBIENT")));
+    host_analog_input(&board, A7, atoi(getenv("HOST_AMBIENT")));
+  }
+  board.tx = stdio_tx;
+  fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+  setup();
+  uint8_t is_closed = 0;
+  uint32_t closed_ms = 0;
+  while (!is_closed || board.rx_used || millis() - closed_ms < HOST_EXIT_GRACE_MS)
+  {
+    uint8_t buf[HOST_RX_SIZE];
+    uint16_t space = host_serial_space(&board);
+    if (!is_closed && space)
+    {
+      ssize_t n = read(STDIN_FILENO, buf, space);
+      if (n > 0)
+        host_serial_feed(&board, buf, n);
+      else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      {
+        is_closed = 1;
+        closed_ms = millis();
+      }
+    }
+
+    loop();
+
+    fflush(stdout);
+    fflush(stderr);
+    if (board.eeprom_dirty)
+    {
+      file_save(board.eeprom, sizeof(board.eeprom), eeprom_path);
+      board.eeprom_dirty = 0;
+    }
+    if (i2c_rom.dirty)
+    {
+      file_save(i2c_rom_data, i2c_rom.size, i2c_rom_path);
+      i2c_rom.dirty = 0;
+    }
+    usleep(HOST_IDLE_US);
+  }
+  return 0;
+}
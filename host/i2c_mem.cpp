@@ -0,0 +1,63 @@
+#include <string.h>
+#include "i2c_mem.h"
+
+static uint8_t i2c_mem_write(HOST_I2C_DEVICE *dev, const uint8_t *data, uint8_t len)
+{
+  HOST_I2C_MEM *mem = (HOST_I2C_MEM *)dev->user;
+  if (host_now_us(mem->board) < mem->busy_until_us)
+  {
+    mem->busy_naks++;
+    return 0;
+  }
+  if (len < 2)
+    return 1; // acknowledge polling or incomplete address
+  mem->pointer = ((uint32_t)data[0] << 8 | data[1]) % mem->size;
+  if (len == 2)
+    return 1; // address for following read
+
+  for (uint8_t i = 2; i < len; i++)
+  {
+    mem->data[mem->pointer] = data[i];
+    if (mem->page)
+      mem->pointer = mem->pointer - mem->pointer % mem->page + (mem->pointer + 1) % mem->page;
+    else
+      mem->pointer = (mem->pointer + 1) % mem->size;
+  }
+  mem->bytes_written += len - 2;
+  mem->writes++;
+  mem->dirty = 1;
+  if (mem->page)
+    mem->busy_until_us = host_now_us(mem->board) + mem->write_us;
+  return 1;
+}
+
+static uint8_t i2c_mem_read(HOST_I2C_DEVICE *dev, uint8_t *data, uint8_t len)
+{
+  HOST_I2C_MEM *mem = (HOST_I2C_MEM *)dev->user;
+  if (host_now_us(mem->board) < mem->busy_until_us)
+  {
+    mem->busy_naks++;
+    return 0;
+  }
+  for (uint8_t i = 0; i < len; i++)
+  {
+    data[i] = mem->data[mem->pointer];
+    mem->pointer = (mem->pointer + 1) % mem->size;
+  }
+  return len;
+}
+
+void host_i2c_mem_init(HOST_I2C_MEM *mem, HOST_BOARD *board, uint8_t address, uint8_t *data, uint32_t size,
+                       uint16_t page, uint32_t write_us)
+{
+  memset(mem, 0, sizeof(*mem));
+  mem->dev.address = address;
+  mem->dev.write = i2c_mem_write;
+  mem->dev.read = i2c_mem_read;
+  mem->dev.user = mem;
+  mem->board = board;
+  mem->data = data;
+  mem->size = size;
+  mem->page = page;
+  mem->write_us = page ? write_us : 0;
+}
@@ -0,0 +1,29 @@
+#ifndef HOST_I2C_MEM_H
+#define HOST_I2C_MEM_H
+
+/* Emulated I2C memory with two address bytes: 24Cxx EEPROM or FRAM.
+   24Cxx: sequential write wraps inside page, then memory is busy for write_us and doesn't acknowledge its address.
+   FRAM (page 0): writes don't wrap and take no time. Reads are sequential from address pointer for both */
+
+#include "host.h"
+
+struct HOST_I2C_MEM
+{
+  HOST_I2C_DEVICE dev;
+  HOST_BOARD *board;      // clock for write cycle
+  uint8_t *data;          // memory of size bytes owned by caller
+  uint32_t size;
+  uint16_t page;          // page size, 0 - FRAM
+  uint32_t write_us;      // write cycle
+  uint32_t pointer;       // address of next read or write
+  uint64_t busy_until_us;
+  uint8_t dirty;          // data changed since flag was cleared
+  uint32_t bytes_written; // for wear statistics
+  uint32_t writes;        // write transfers with data
+  uint32_t busy_naks;     // transfers refused during write cycle
+};
+
+void host_i2c_mem_init(HOST_I2C_MEM *mem, HOST_BOARD *board, uint8_t address, uint8_t *data, uint32_t size,
+                       uint16_t page, uint32_t write_us);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+/* Firmware code of one board runs on one thread and emulated interrupts are called from it, so block needs no locking */
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+#define ATOMIC_BLOCK(type) for (uint8_t atomic_done_ = 0; !atomic_done_; atomic_done_ = 1)
+
+#endif
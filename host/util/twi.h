@@ -0,0 +1,17 @@
+#ifndef HOST_UTIL_TWI_H
+#define HOST_UTIL_TWI_H
+
+/* TWI status codes used by slave interrupt handler. host_twi_write() and host_twi_read() put them to TWSR */
+
+#define TW_STATUS_MASK 0xF8
+#define TW_STATUS (TWSR & TW_STATUS_MASK)
+
+#define TW_BUS_ERROR 0x00
+#define TW_SR_SLA_ACK 0x60
+#define TW_SR_DATA_ACK 0x80
+#define TW_SR_STOP 0xA0
+#define TW_ST_SLA_ACK 0xA8
+#define TW_ST_DATA_ACK 0xB8
+#define TW_ST_DATA_NACK 0xC0
+
+#endif
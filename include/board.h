@@ -0,0 +1,178 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+/* Arduino Nano (ATmega328P) pin description.
+   Every Arduino pin number is mapped to its port, bit and pin change interrupt group at compile time,
+   so pin access does not go through Arduino core lookup tables:
+   D0 - D7  -> PORTD 0..7, PCINT2
+   D8 - D13 -> PORTB 0..5, PCINT0
+   A0 - A5  -> PORTC 0..5, PCINT1
+   A6 - A7  -> analog input only, no port
+*/
+
+#define BOARD_NO_PORT 0
+#define BOARD_NO_PCINT 0xFF
+
+struct BOARD_PIN
+{
+  char port;           // 'B', 'C', 'D' or BOARD_NO_PORT
+  uint8_t bit;         // bit in port registers
+  uint8_t pcint_group; // PCICR bit (PCIE0..PCIE2) or BOARD_NO_PCINT
+};
+
+constexpr BOARD_PIN board_pins[] = {
+    {'D', 0, 2}, {'D', 1, 2}, {'D', 2, 2}, {'D', 3, 2}, {'D', 4, 2}, {'D', 5, 2}, {'D', 6, 2}, {'D', 7, 2},
+    {'B', 0, 0}, {'B', 1, 0}, {'B', 2, 0}, {'B', 3, 0}, {'B', 4, 0}, {'B', 5, 0},
+    {'C', 0, 1}, {'C', 1, 1}, {'C', 2, 1}, {'C', 3, 1}, {'C', 4, 1}, {'C', 5, 1},
+    {BOARD_NO_PORT, 0, BOARD_NO_PCINT}, {BOARD_NO_PORT, 0, BOARD_NO_PCINT}};
+
+constexpr uint8_t board_pin_count = sizeof(board_pins) / sizeof(board_pins[0]);
+
+// Pins available for devices
+constexpr uint8_t board_button_first = 2;  // D0 and D1 are used by Serial
+constexpr uint8_t board_button_last = 13;
+constexpr uint8_t board_relay_first = 14;  // A0
+constexpr uint8_t board_relay_last = 19;   // A5, A6 and A7 are analog inputs only
+constexpr uint8_t board_sensor_first = 20; // A6
+constexpr uint8_t board_sensor_last = 21;  // A7
+
+constexpr char board_port(uint8_t pin)
+{
+  return pin < board_pin_count ? board_pins[pin].port : BOARD_NO_PORT;
+}
+
+constexpr uint8_t board_mask(uint8_t pin)
+{
+  return pin < board_pin_count ? 1 << board_pins[pin].bit : 0;
+}
+
+constexpr uint8_t board_pcint_group(uint8_t pin)
+{
+  return pin < board_pin_count ? board_pins[pin].pcint_group : BOARD_NO_PCINT;
+}
+
+constexpr uint8_t board_has_port(uint8_t pin)
+{
+  return board_port(pin) != BOARD_NO_PORT;
+}
+
+#ifdef __AVR__
+// PINx register of port. DDRx and PORTx follow it in memory: PINx + 1 and PINx + 2
+inline volatile uint8_t *board_pin_reg(char port)
+{
+  return port == 'B' ? &PINB : (port == 'C' ? &PINC : (port == 'D' ? &PIND : 0));
+}
+#endif
+
+inline volatile uint8_t *board_pcmsk_reg(uint8_t group)
+{
+  return group == 0 ? &PCMSK0 : (group == 1 ? &PCMSK1 : (group == 2 ? &PCMSK2 : 0));
+}
+
+/* Pin known at compile time. Port and mask are constants, so every access is compiled to single
+   sbi/cbi/sbic instruction */
+template <uint8_t pin>
+struct FastPin
+{
+  static_assert(board_has_port(pin), "Pin has no digital port");
+  static constexpr uint8_t mask = board_mask(pin);
+
+#ifdef __AVR__
+  static inline uint8_t read() { return (*board_pin_reg(board_port(pin)) & mask) != 0; }
+  static inline void high() { *(board_pin_reg(board_port(pin)) + 2) |= mask; }
+  static inline void low() { *(board_pin_reg(board_port(pin)) + 2) &= ~mask; }
+  static inline void output() { *(board_pin_reg(board_port(pin)) + 1) |= mask; }
+  static inline void input() { *(board_pin_reg(board_port(pin)) + 1) &= ~mask; }
+#else
+  static inline uint8_t read() { return digitalRead(pin); }
+  static inline void high() { digitalWrite(pin, HIGH); }
+  static inline void low() { digitalWrite(pin, LOW); }
+  static inline void output() { pinMode(pin, OUTPUT); }
+  static inline void input() { pinMode(pin, INPUT); }
+#endif
+  static inline void write(uint8_t value) { value ? high() : low(); }
+  static inline void input_pullup()
+  {
+    input();
+    high();
+  }
+};
+
+/* Pin known only at runtime (loaded from EEPROM). Register and mask are resolved once by fast_pin_init(),
+   after that access is a load and a mask instead of Arduino core table lookups */
+struct FAST_PIN
+{
+  volatile uint8_t *reg; // PINx register, 0 - pin has no port
+  uint8_t mask;
+  uint8_t pin;           // Arduino pin number for host build fallback
+};
+
+inline void fast_pin_init(FAST_PIN *io, uint8_t pin)
+{
+  io->pin = pin;
+  io->mask = board_mask(pin);
+#ifdef __AVR__
+  io->reg = board_pin_reg(board_port(pin));
+#else
+  io->reg = 0;
+#endif
+}
+
+inline uint8_t fast_read(const FAST_PIN *io)
+{
+#ifdef __AVR__
+  if (!io->reg)
+    return 0;
+  return (*io->reg & io->mask) != 0;
+#else
+  return digitalRead(io->pin);
+#endif
+}
+
+inline void fast_write(const FAST_PIN *io, uint8_t value)
+{
+#ifdef __AVR__
+  if (!io->reg)
+    return;
+  // port is shared with pins changed from interrupts (relay switching on zero cross)
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (value)
+      *(io->reg + 2) |= io->mask;
+    else
+      *(io->reg + 2) &= ~io->mask;
+  }
+#else
+  digitalWrite(io->pin, value);
+#endif
+}
+
+inline void fast_mode(const FAST_PIN *io, uint8_t mode)
+{
+#ifdef __AVR__
+  if (!io->reg)
+    return;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (mode == OUTPUT)
+    {
+      *(io->reg + 1) |= io->mask;
+    }
+    else
+    {
+      *(io->reg + 1) &= ~io->mask;
+      if (mode == INPUT_PULLUP)
+        *(io->reg + 2) |= io->mask;
+      else
+        *(io->reg + 2) &= ~io->mask;
+    }
+  }
+#else
+  pinMode(io->pin, mode);
+#endif
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef CYCLE_MARKS_H
+#define CYCLE_MARKS_H
+
+/* Marks of hot paths for cycle counting of AVR firmware in emulator (tools/simavr, env:nanoatmega328_simavr).
+   With CYCLE_MARKS firmware writes mark to GPIOR0 when path starts and mark | MARK_END when it ends. It's one OUT
+   instruction (1 cycle plus LDI of mark), emulator stamps every write with its cycle counter. Paths may nest.
+   Included from main.cpp after configuration defines and from tools/simavr with CYCLE_MARK_NAMES */
+
+enum CYCLE_MARK
+{
+  MARK_LOOP = 1,    // whole loop()
+  MARK_BUTTONS,     // reading and debouncing of buttons, click gestures
+  MARK_LIGHT,       // handle_switching_light(): light timeout and relay outputs
+  MARK_FRAME_INPUT, // framing of received serial bytes into command ring
+  MARK_PARSE,       // deserializing of command JSON
+  MARK_COMMAND,     // handle_input_commands()
+  MARK_JOB,         // step of background EEPROM job
+  MARK_ROM_UPDATE,  // update of one settings byte, waits for EEPROM write in progress
+  MARK_COUNT
+};
+#define MARK_END 0x80
+
+#ifdef CYCLE_MARK_NAMES
+static const char *const cycle_mark_names[MARK_COUNT] = {"", "loop", "buttons", "light", "frame_input", "parse",
+                                                         "command", "job", "rom_update"};
+#else
+static inline void cycle_mark(uint8_t mark)
+{
+  if (CYCLE_MARKS)
+    GPIOR0 = mark;
+}
+#endif
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef HELP_CATALOG_H
+#define HELP_CATALOG_H
+
+/* Generated by tools/help/gen_help.py from src/main.cpp, don't edit.
+   Every command has 3 strings in help_text: description, JSON example and errors separated by \n.
+   Byte < 0x80 is character, byte >= 0x80 is index of pair in help_rules + 0x80.
+   4213 bytes of text in 1810 bytes of text and 256 bytes of rules */
+
+#define HELP_COMMANDS 22
+#define HELP_STACK_DEPTH 5 // pending right halves of rules during expansion
+
+const char help_names[] PROGMEM =
+    "status" "\0"
+    "buttons" "\0"
+    "relays" "\0"
+    "remove" "\0"
+    "light_state" "\0"
+    "light_mode" "\0"
+    "set_timeout" "\0"
+    "clear_rom" "\0"
+    "set_config" "\0"
+    "batch" "\0"
+    "zero_cross" "\0"
+    "latency" "\0"
+    "memory" "\0"
+    "help" "\0"
+    "log" "\0"
+    "bus" "\0"
+    "ambient" "\0"
+    "usage" "\0"
+    "sequence" "\0"
+    "step" "\0"
+    "subscribe" "\0"
+    "capture" "\0";
+
+const uint16_t help_offsets[HELP_COMMANDS] PROGMEM = {0, 32, 83, 133, 218, 259, 325, 394, 428, 483, 695, 781, 828, 859, 962, 1030, 1143, 1310, 1418, 1544, 1608, 1710};
+
+const uint8_t help_rules[][2] PROGMEM = {
+  {0x6F, 0x6E}, {0x74, 0x69}, {0x81, 0x80}, {0x22, 0x3A}, {0x69, 0x6E}, {0x72, 0x65}, {0x73, 0x20}, {0x22, 0x2C},
+  {0x64, 0x20}, {0x83, 0x22}, {0x74, 0x20}, {0x87, 0x22}, {0x65, 0x20}, {0x6F, 0x70}, {0x8D, 0x82}, {0x6C, 0x61},
+  {0x61, 0x6E}, {0x64, 0x65}, {0x6F, 0x75}, {0x2C, 0x20}, {0x8E, 0x73}, {0x61, 0x63}, {0x74, 0x65}, {0x22, 0x63},
+  {0x73, 0x73}, {0x95, 0x82}, {0x43, 0x8B}, {0x6D, 0x6F}, {0x73, 0x65}, {0x7B, 0x97}, {0x89, 0x9A}, {0x8F, 0x98},
+  {0x99, 0x89}, {0x9D, 0x9F}, {0x9E, 0xA0}, {0xA1, 0xA2}, {0x66, 0x69}, {0x3A, 0x20}, {0x6C, 0x65}, {0x6C, 0x69},
+  {0x2D, 0x20}, {0x84, 0x20}, {0x5D, 0x20}, {0x61, 0x85}, {0x6F, 0x66}, {0x83, 0x5B}, {0x6D, 0x65}, {0x72, 0x6D},
+  {0xAA, 0xA8}, {0x6F, 0x72}, {0x73, 0x61}, {0x5D, 0x7D}, {0x65, 0x6E}, {0x76, 0x69}, {0x77, 0xAB}, {0x88, 0xA9},
+  {0x8B, 0x94}, {0x90, 0x88}, {0x92, 0x8A}, {0x94, 0xA5}, {0xA4, 0xAF}, {0xB8, 0xAD}, {0xBB, 0x5B}, {0xBC, 0xB6},
+  {0x62, 0xA6}, {0x6F, 0x20}, {0xAC, 0x20}, {0xB7, 0xBF}, {0x61, 0x74}, {0x63, 0x65}, {0x63, 0x68}, {0x67, 0x20},
+  {0x74, 0x86}, {0x79, 0x20}, {0x64, 0x69}, {0x72, 0x84}, {0x85, 0x8F}, {0x9B, 0x91}, {0xB2, 0xC0}, {0xCA, 0xCE},
+  {0xCF, 0xC3}, {0x62, 0x75}, {0x73, 0x74}, {0x73, 0x96}, {0xCB, 0xC8}, {0xCC, 0x79}, {0x22, 0x7D}, {0x64, 0x8C},
+  {0x65, 0x72}, {0x67, 0x68}, {0x6F, 0x6D}, {0x73, 0x68}, {0x74, 0x5F}, {0x74, 0x68}, {0xA7, 0xD9}, {0xB1, 0x20},
+  {0xD3, 0x70}, {0x27, 0x86}, {0x5D, 0x2C}, {0x63, 0x8C}, {0x70, 0xD4}, {0x71, 0x75}, {0x81, 0xAE}, {0x90, 0x67},
+  {0x91, 0x66}, {0xB5, 0xC5}, {0xE5, 0xB4}, {0x20, 0x3C}, {0x2E, 0x20}, {0x6E, 0x6F}, {0x74, 0x74}, {0x76, 0x61},
+  {0x92, 0x6E}, {0x93, 0x5B}, {0xBA, 0x8E}, {0xC4, 0xC6}, {0xD0, 0x0A}, {0xD1, 0xEE}, {0xF5, 0x80}, {0x0A, 0x42},
+  {0x63, 0xDA}, {0x65, 0x63}, {0x65, 0x88}, {0x6D, 0x90}, {0x70, 0x84}, {0x72, 0x6F}, {0x84, 0xC7}, {0x91, 0xE9},
+};
+
+const uint8_t help_text[] PROGMEM = {
+  0xE4, 0xFF, 0x86, 0x63, 0xF0, 0x74, 0x93, 0xDE, 0x8A, 0xD2, 0xC4, 0x8C, 0xB9, 0xCD, 0x93, 0xE6,
+  0xBA, 0xB9, 0x62, 0x6F, 0x6F, 0x8A, 0xE6, 0x00, 0xA3, 0xD2, 0xC4, 0x75, 0x73, 0xD6, 0x00, 0x00,
+  0xE4, 0xFC, 0x93, 0x74, 0x79, 0x70, 0x65, 0x93, 0x66, 0x72, 0x80, 0x8A, 0xB9, 0xA6, 0x61, 0x72,
+  0x6E, 0xFA, 0x91, 0x62, 0xF0, 0xE3, 0x84, 0x96, 0x72, 0xEF, 0x6C, 0x20, 0xC2, 0x65, 0x76, 0xD8,
+  0xC9, 0xF6, 0x00, 0xA3, 0xF6, 0x73, 0xD6, 0x00, 0x4E, 0xC1, 0xF6, 0xE1, 0xE8, 0x84, 0xFA, 0x79,
+  0x65, 0x74, 0x00, 0xE4, 0x70, 0xA9, 0xB9, 0x74, 0x79, 0x70, 0x8C, 0xC2, 0x65, 0x76, 0xD8, 0xC9,
+  0xD5, 0x93, 0x85, 0x9C, 0x8A, 0x70, 0xA9, 0xB9, 0x70, 0x75, 0x6C, 0x73, 0x8C, 0xC2, 0x8F, 0x74,
+  0xC6, 0xFE, 0x80, 0x65, 0x00, 0xA3, 0xD5, 0x73, 0xD6, 0x00, 0x4E, 0xC1, 0xD5, 0xE1, 0xE8, 0x84,
+  0xFA, 0x79, 0x65, 0x74, 0x00, 0xFF, 0xA5, 0x7B, 0x22, 0xFC, 0x87, 0x20, 0x22, 0xFF, 0x83, 0x20,
+  0x22, 0x42, 0x22, 0x20, 0xDF, 0x22, 0x52, 0xD6, 0x20, 0x74, 0xC1, 0x85, 0x9B, 0x76, 0x8C, 0xF6,
+  0x20, 0xDF, 0xD5, 0x00, 0xA3, 0x85, 0x9B, 0x76, 0x65, 0x8B, 0xFF, 0x83, 0x7B, 0x22, 0xFC, 0x83,
+  0x31, 0x31, 0x2C, 0x22, 0xFF, 0x89, 0x52, 0x22, 0x7C, 0x22, 0x42, 0xD6, 0x7D, 0x00, 0x44, 0x65,
+  0xE9, 0x86, 0xAB, 0x20, 0xA4, 0x78, 0x65, 0xC3, 0x0A, 0x44, 0x65, 0xB5, 0xE3, 0x74, 0xC1, 0x85,
+  0x9B, 0x76, 0x8C, 0xED, 0x8A, 0xE8, 0x84, 0x65, 0x64, 0x00, 0xBE, 0x31, 0xB0, 0x74, 0x75, 0x72,
+  0x6E, 0x20, 0xDE, 0x8A, 0x80, 0xF1, 0x30, 0xB0, 0xAC, 0x66, 0x00, 0xA3, 0xDE, 0xDC, 0xD2, 0x61,
+  0x96, 0xBD, 0x31, 0xB3, 0x00, 0x4E, 0xC1, 0xDE, 0x8A, 0xD2, 0xC4, 0x8C, 0x8E, 0xE1, 0xE8, 0x84,
+  0x65, 0x64, 0x00, 0xBE, 0xCD, 0xB0, 0xD5, 0x86, 0xF8, 0x62, 0x84, 0x61, 0x82, 0x20, 0x31, 0x20,
+  0x2E, 0xEC, 0x32, 0x5E, 0xD5, 0x86, 0xA8, 0x31, 0x93, 0x77, 0x69, 0xDD, 0xF2, 0x86, 0xA8, 0x70,
+  0x85, 0xB5, 0x92, 0x86, 0x9B, 0xD7, 0xDF, 0x6E, 0x65, 0x78, 0x8A, 0x9C, 0xEA, 0xE3, 0xE0, 0x00,
+  0xA3, 0xDE, 0xDC, 0xCD, 0xBD, 0x33, 0xB3, 0x00, 0x53, 0x65, 0x8A, 0xDE, 0x8A, 0x9B, 0xD7, 0x66,
+  0x61, 0x69, 0xA6, 0x64, 0x00, 0xBE, 0x6D, 0x84, 0x75, 0x96, 0x73, 0xB0, 0x61, 0x76, 0xD8, 0x61,
+  0x67, 0x8C, 0x80, 0x20, 0x64, 0x75, 0x72, 0x61, 0x82, 0x20, 0x77, 0x68, 0x69, 0xC6, 0x20, 0xE8,
+  0x84, 0x65, 0x86, 0xE6, 0x92, 0x74, 0x00, 0xA3, 0x9C, 0xDC, 0xE6, 0x92, 0x74, 0xBD, 0x33, 0x30,
+  0xB3, 0x00, 0x4E, 0xC1, 0xE6, 0xF2, 0xE1, 0xE8, 0x84, 0x65, 0x64, 0x0A, 0x50, 0xFD, 0xB5, 0x91,
+  0x88, 0xE6, 0xF2, 0xE1, 0xBA, 0xC2, 0x72, 0xE7, 0x65, 0x00, 0xD8, 0x61, 0x9C, 0x86, 0x9C, 0x74,
+  0x81, 0x6E, 0x67, 0x86, 0xAE, 0x9B, 0x72, 0xC9, 0xA9, 0x62, 0x95, 0x6B, 0x67, 0x72, 0xF0, 0x64,
+  0x00, 0xA3, 0x63, 0xA6, 0x61, 0x72, 0x5F, 0x72, 0xDA, 0xD6, 0x00, 0x00, 0xBE, 0x84, 0x69, 0xDC,
+  0xDE, 0xDC, 0xD2, 0x61, 0x96, 0x93, 0xE8, 0x61, 0x75, 0x6C, 0xDC, 0xDE, 0xDC, 0xCD, 0x93, 0x6C,
+  0x5F, 0xF6, 0x5F, 0xCD, 0x5D, 0x00, 0xA3, 0x9C, 0xDC, 0x63, 0x80, 0xA4, 0x67, 0xBD, 0x30, 0x2C,
+  0x33, 0x2C, 0x31, 0xB3, 0x00, 0x4E, 0xC1, 0x63, 0x80, 0xA4, 0xC7, 0x8E, 0xE1, 0x70, 0xFD, 0xB5,
+  0x91, 0x64, 0x00, 0x77, 0x68, 0x6F, 0x6C, 0x8C, 0x63, 0x80, 0xA4, 0x67, 0x75, 0x72, 0x61, 0x82,
+  0x20, 0xA9, 0x80, 0x8C, 0xF8, 0xFB, 0x64, 0x93, 0xEF, 0xA7, 0x64, 0x61, 0x96, 0x88, 0x62, 0x65,
+  0x66, 0x6F, 0x85, 0x20, 0x61, 0x70, 0x70, 0x6C, 0x79, 0xFE, 0xB9, 0xB2, 0x76, 0xFA, 0x74, 0xC1,
+  0x52, 0x4F, 0x4D, 0x20, 0x61, 0x8A, 0x80, 0xC5, 0x00, 0xA3, 0x62, 0xF3, 0x8B, 0xF6, 0x73, 0xAD,
+  0x5B, 0x33, 0x2C, 0x22, 0x4D, 0x87, 0x30, 0xE2, 0x5B, 0x34, 0x2C, 0x22, 0x4C, 0x87, 0x31, 0x5D,
+  0xE2, 0x22, 0xD5, 0x73, 0xAD, 0x5B, 0x22, 0x41, 0x30, 0x8B, 0x4C, 0x22, 0xE2, 0x5B, 0x22, 0x41,
+  0x31, 0x8B, 0x50, 0x8B, 0x41, 0x32, 0x87, 0x33, 0x30, 0x5D, 0xE2, 0x97, 0x80, 0xA4, 0x67, 0xAD,
+  0x30, 0x2C, 0x33, 0x2C, 0x31, 0xE2, 0x22, 0xE6, 0x92, 0x74, 0x83, 0x33, 0x30, 0x7D, 0x00, 0x44,
+  0x65, 0xE9, 0x86, 0xAB, 0x20, 0xA4, 0x78, 0x65, 0xC3, 0xF7, 0xF3, 0x20, 0x85, 0x6A, 0xF9, 0x96,
+  0x64, 0xA5, 0x74, 0x6F, 0xC1, 0xFB, 0xC9, 0xFF, 0x73, 0xF7, 0xF3, 0x20, 0x85, 0x6A, 0xF9, 0x96,
+  0x64, 0xA5, 0x84, 0xEF, 0xA7, 0x88, 0xF6, 0xF7, 0xF3, 0x20, 0x85, 0x6A, 0xF9, 0x96, 0x64, 0xA5,
+  0x84, 0xEF, 0xA7, 0x88, 0xD5, 0xF7, 0xF3, 0x20, 0x85, 0x6A, 0xF9, 0x96, 0x64, 0xA5, 0x84, 0xEF,
+  0xA7, 0x88, 0x63, 0x80, 0xA4, 0x67, 0xF7, 0xF3, 0x20, 0x85, 0x6A, 0xF9, 0x96, 0x64, 0xA5, 0xE6,
+  0xBA, 0xBA, 0xC2, 0x72, 0xE7, 0x65, 0x00, 0xBE, 0xAC, 0x66, 0x9C, 0xDC, 0x75, 0x73, 0xAA, 0x74,
+  0xC1, 0x9C, 0x8A, 0x6E, 0x65, 0x77, 0x20, 0x73, 0x77, 0x69, 0x74, 0xC6, 0xFE, 0xAC, 0x66, 0x9C,
+  0x74, 0x93, 0x77, 0x69, 0xDD, 0xF2, 0x86, 0xE4, 0xD2, 0x61, 0x81, 0x73, 0x81, 0x63, 0x73, 0x00,
+  0xA3, 0x7A, 0xD8, 0x6F, 0x5F, 0x63, 0xFD, 0x98, 0xBD, 0x38, 0x30, 0x30, 0xB3, 0x00, 0x5A, 0xD8,
+  0xC1, 0x63, 0xFD, 0x73, 0x86, 0x73, 0x77, 0x69, 0x74, 0xC6, 0xFE, 0xF4, 0x50, 0xFD, 0xB5, 0x91,
+  0x88, 0xAC, 0x66, 0x9C, 0x8A, 0x8E, 0xE1, 0xBA, 0xC2, 0x72, 0xE7, 0x65, 0x00, 0xBE, 0x31, 0xB0,
+  0x85, 0x9C, 0x8A, 0x68, 0x69, 0xD2, 0x6F, 0x67, 0x72, 0x61, 0x6D, 0x86, 0x61, 0x66, 0x96, 0x72,
+  0x20, 0x64, 0x75, 0x6D, 0x70, 0x00, 0xA3, 0x8F, 0x96, 0x6E, 0x63, 0x79, 0xBD, 0x31, 0xB3, 0x00,
+  0x4C, 0x61, 0x96, 0x6E, 0x63, 0xC9, 0x74, 0x72, 0x95, 0xFE, 0xD0, 0x00, 0xE4, 0x70, 0x61, 0x72,
+  0x9C, 0x72, 0x20, 0xAE, 0x9B, 0x72, 0xC9, 0x75, 0xB2, 0x67, 0x8C, 0xB9, 0x66, 0x85, 0x8C, 0x52,
+  0x41, 0x4D, 0x00, 0xA3, 0xAE, 0x9B, 0x72, 0x79, 0xD6, 0x00, 0x00, 0xBE, 0x97, 0xDA, 0xFB, 0x64,
+  0x22, 0xB0, 0x91, 0x73, 0x63, 0x72, 0x69, 0x70, 0x82, 0x93, 0x4A, 0x53, 0x4F, 0x4E, 0x20, 0x65,
+  0x78, 0x61, 0x6D, 0x70, 0x6C, 0x8C, 0xB9, 0xD8, 0x72, 0xB1, 0x86, 0xC2, 0xF8, 0xFB, 0x64, 0xEC,
+  0x57, 0x69, 0xDD, 0xF2, 0x86, 0xA7, 0x73, 0xC8, 0xF8, 0xFB, 0x64, 0x73, 0x00, 0xA3, 0x68, 0x65,
+  0x6C, 0x70, 0xBD, 0x22, 0x62, 0xF3, 0x22, 0xB3, 0x00, 0x48, 0x65, 0x6C, 0x70, 0x20, 0x63, 0xC4,
+  0x61, 0x6C, 0x6F, 0xC7, 0xF4, 0x55, 0x6E, 0x6B, 0xED, 0x77, 0x6E, 0x20, 0xF8, 0xFB, 0x64, 0x93,
+  0x9C, 0x6E, 0x88, 0xA3, 0x68, 0x65, 0x6C, 0x70, 0xD6, 0x20, 0x66, 0xDF, 0xF8, 0x6D, 0xB9, 0xA7,
+  0xD2, 0x00, 0xBE, 0x30, 0xB0, 0x64, 0x75, 0x6D, 0x70, 0x20, 0x6C, 0x6F, 0xC7, 0x66, 0x72, 0xDA,
+  0x20, 0x53, 0x52, 0x41, 0x4D, 0x20, 0x28, 0xE8, 0x61, 0x75, 0x6C, 0x74, 0x29, 0xF1, 0x31, 0xB0,
+  0x64, 0x75, 0x6D, 0x70, 0x20, 0x6C, 0x6F, 0xC7, 0x70, 0xD8, 0x73, 0x69, 0xD3, 0xB7, 0x45, 0x45,
+  0x50, 0x52, 0x4F, 0x4D, 0x00, 0xA3, 0x6C, 0x6F, 0x67, 0xBD, 0x31, 0xB3, 0x00, 0x45, 0x76, 0xB4,
+  0x8A, 0x6C, 0x6F, 0xC7, 0xD0, 0x00, 0xBE, 0x61, 0x64, 0x64, 0x85, 0x98, 0x93, 0x67, 0x72, 0x92,
+  0x70, 0x73, 0xAA, 0x74, 0xC1, 0x9C, 0x8A, 0xED, 0xD7, 0x61, 0x64, 0x64, 0x85, 0x73, 0x86, 0xB9,
+  0x67, 0x72, 0x92, 0x70, 0x86, 0x62, 0x69, 0x8A, 0x6D, 0x61, 0x73, 0x6B, 0x93, 0x77, 0x69, 0xDD,
+  0xF2, 0x86, 0xE4, 0xDD, 0x65, 0x6D, 0x00, 0xA3, 0xD1, 0x73, 0xBD, 0x31, 0x32, 0x2C, 0x35, 0xB3,
+  0x00, 0x42, 0x75, 0x86, 0x61, 0x64, 0x64, 0x85, 0x73, 0x86, 0x63, 0x90, 0x20, 0x62, 0x8C, 0x9C,
+  0x8A, 0x80, 0x6C, 0xC9, 0x62, 0xC9, 0x75, 0x6E, 0x69, 0x63, 0x61, 0x73, 0x8A, 0x66, 0x72, 0x61,
+  0xAE, 0x0A, 0x50, 0xFD, 0xB5, 0x91, 0x88, 0xD1, 0x86, 0x8E, 0xE1, 0xBA, 0xC2, 0x72, 0xE7, 0x65,
+  0xF7, 0x75, 0x86, 0x9B, 0xD7, 0xD0, 0x00, 0xBE, 0xFC, 0xAA, 0xDF, 0x5B, 0xFC, 0xF1, 0x5B, 0xDD,
+  0x85, 0xDB, 0x6F, 0x6C, 0x64, 0x93, 0xCD, 0x5D, 0x93, 0x2E, 0x2E, 0x2E, 0x5D, 0x5D, 0x93, 0x70,
+  0xA9, 0x30, 0x20, 0xA8, 0x6E, 0xC1, 0x9C, 0x6E, 0x73, 0xB1, 0xEC, 0x57, 0x69, 0xDD, 0xF2, 0x86,
+  0xE4, 0xA6, 0x76, 0x65, 0x6C, 0x20, 0xB9, 0x74, 0x61, 0xC0, 0x00, 0xA3, 0x61, 0x6D, 0x62, 0x69,
+  0xB4, 0x74, 0xBD, 0x22, 0x41, 0x36, 0x87, 0x5B, 0x5B, 0x34, 0x30, 0x2C, 0x32, 0xE2, 0x5B, 0x31,
+  0x36, 0x30, 0x2C, 0x33, 0xE2, 0x5B, 0x32, 0x35, 0x35, 0x2C, 0x32, 0x35, 0x35, 0x5D, 0x5D, 0xB3,
+  0x00, 0x41, 0x6D, 0x62, 0x69, 0xB4, 0x8A, 0x9C, 0x6E, 0x73, 0xDF, 0xF4, 0x41, 0x6D, 0x62, 0x69,
+  0xB4, 0x8A, 0x9C, 0x6E, 0x73, 0xDF, 0x70, 0xA9, 0xDB, 0x92, 0x6C, 0x88, 0x62, 0x8C, 0x41, 0x36,
+  0x93, 0x41, 0x37, 0x20, 0xDF, 0x30, 0x0A, 0x41, 0x6D, 0x62, 0x69, 0xB4, 0x8A, 0x74, 0x61, 0x62,
+  0x6C, 0x8C, 0xDB, 0x92, 0x6C, 0x88, 0x68, 0x61, 0x76, 0x8C, 0x61, 0x73, 0x63, 0xB4, 0x64, 0xFE,
+  0xDD, 0x85, 0xDB, 0x6F, 0x6C, 0x64, 0x86, 0xB9, 0xEF, 0xA7, 0x88, 0xCD, 0x73, 0x00, 0xBE, 0xD5,
+  0xB0, 0xCC, 0xC9, 0x85, 0x70, 0x8F, 0xC5, 0x64, 0x93, 0x69, 0xC8, 0x63, 0xF0, 0x96, 0x72, 0x86,
+  0xAB, 0x20, 0x63, 0xA6, 0xAB, 0x64, 0xF1, 0xD5, 0x93, 0xA7, 0x66, 0x65, 0x5F, 0x63, 0x79, 0x63,
+  0xA6, 0x73, 0xB0, 0x72, 0x61, 0x96, 0x88, 0xA7, 0x66, 0x65, 0xEC, 0x50, 0xD4, 0x63, 0xF0, 0x96,
+  0x72, 0x86, 0xB9, 0x64, 0x61, 0x79, 0x86, 0xC2, 0xA7, 0x66, 0x8C, 0xA6, 0x66, 0x74, 0x00, 0xA3,
+  0x75, 0xB2, 0x67, 0x65, 0xBD, 0x30, 0x2C, 0x32, 0x30, 0x30, 0x30, 0x30, 0x30, 0xB3, 0x00, 0x55,
+  0xB2, 0x67, 0x8C, 0x95, 0x63, 0xF0, 0x81, 0x6E, 0xC7, 0xF4, 0x52, 0x65, 0x8F, 0xC9, 0x6E, 0x75,
+  0x6D, 0x62, 0xD8, 0x20, 0xBA, 0xC2, 0x72, 0xE7, 0x65, 0x00, 0xBE, 0x9B, 0xD7, 0xDF, 0x5B, 0xCD,
+  0x93, 0x22, 0x6E, 0x61, 0xAE, 0x22, 0x5D, 0x93, 0x2E, 0x2E, 0x2E, 0xB0, 0xCD, 0x86, 0xE0, 0x70,
+  0xFA, 0x62, 0xC9, 0x64, 0x92, 0xC0, 0x2D, 0x63, 0xA7, 0x63, 0x6B, 0xF1, 0xB0, 0x61, 0x6C, 0x6C,
+  0x20, 0xCD, 0x73, 0xEC, 0x50, 0xD4, 0x9C, 0xEA, 0xC5, 0x00, 0xA3, 0x9C, 0xEA, 0xC5, 0xBD, 0x33,
+  0x2C, 0x5B, 0x31, 0x2C, 0x97, 0x6F, 0x6C, 0x64, 0x22, 0xE2, 0x5B, 0x32, 0x2C, 0x22, 0x77, 0x61,
+  0xAF, 0x22, 0x5D, 0xB3, 0x00, 0x4D, 0x6F, 0xD7, 0x9C, 0xEA, 0xE3, 0xF4, 0x53, 0x65, 0xEA, 0xE3,
+  0xDB, 0x92, 0x6C, 0x88, 0x68, 0x61, 0x76, 0x8C, 0xEF, 0xA7, 0x88, 0xCD, 0x86, 0xB9, 0xDB, 0xB1,
+  0x8A, 0x6E, 0x61, 0xAE, 0x73, 0x93, 0xED, 0x8A, 0x9B, 0x85, 0x20, 0xE0, 0x86, 0xDD, 0x90, 0x20,
+  0xBF, 0x20, 0x6B, 0x65, 0x65, 0x70, 0x73, 0x00, 0xBE, 0xE0, 0xB0, 0xDE, 0x8A, 0x9B, 0xD7, 0xC2,
+  0x9C, 0xEA, 0xE3, 0xE0, 0x20, 0x30, 0x20, 0x2E, 0xEC, 0xE0, 0x86, 0xA8, 0x31, 0xF1, 0x22, 0x6E,
+  0x61, 0xAE, 0x22, 0xB0, 0xC2, 0x6E, 0x61, 0xAE, 0x88, 0xE0, 0x00, 0xA3, 0xE0, 0xBD, 0x22, 0x77,
+  0x61, 0xAF, 0x22, 0xB3, 0x00, 0x4D, 0x6F, 0xD7, 0x9C, 0xEA, 0xE3, 0xF4, 0x53, 0x65, 0xEA, 0xE3,
+  0xE0, 0x20, 0xED, 0x8A, 0x66, 0xF0, 0x64, 0x00, 0xBE, 0x31, 0xB0, 0x70, 0x75, 0xDB, 0x20, 0xC6,
+  0xE7, 0x8C, 0x85, 0x63, 0xB1, 0x64, 0x73, 0xF1, 0x30, 0xB0, 0xD2, 0x8D, 0x20, 0x70, 0x75, 0xDB,
+  0x84, 0x67, 0xEC, 0x52, 0xF9, 0xB1, 0x88, 0xC2, 0x63, 0x75, 0x72, 0x85, 0x6E, 0x8A, 0xD2, 0xC4,
+  0x8C, 0x69, 0x86, 0x70, 0xCB, 0x96, 0x64, 0x00, 0xA3, 0x73, 0x75, 0x62, 0x73, 0x63, 0x72, 0x69,
+  0x62, 0x65, 0xBD, 0x31, 0xB3, 0x00, 0x43, 0x68, 0xE7, 0x8C, 0xED, 0x81, 0xA4, 0x63, 0x61, 0x82,
+  0x86, 0xF4, 0x43, 0x68, 0xE7, 0x8C, 0x85, 0x63, 0xB1, 0x64, 0x86, 0x63, 0x90, 0x27, 0x8A, 0x62,
+  0x8C, 0x70, 0x75, 0xDB, 0xFA, 0x62, 0xC9, 0xED, 0xD7, 0x80, 0x20, 0xD1, 0x73, 0x00, 0xE4, 0x63,
+  0x61, 0x70, 0x74, 0x75, 0x85, 0xA5, 0x22, 0x3C, 0x6D, 0x73, 0x3E, 0x20, 0x52, 0xEB, 0x61, 0x64,
+  0x64, 0x85, 0x98, 0x3E, 0xEB, 0x68, 0x65, 0x78, 0x3E, 0x87, 0x20, 0x22, 0x3C, 0x6D, 0x73, 0x3E,
+  0x20, 0x50, 0xEB, 0xFC, 0x3E, 0xEB, 0xA6, 0x76, 0x65, 0x6C, 0x3E, 0x87, 0x20, 0x22, 0x3C, 0x6D,
+  0x73, 0x3E, 0x20, 0x43, 0xEB, 0x99, 0x3E, 0xEB, 0x94, 0x3E, 0x87, 0x20, 0x22, 0x3C, 0x6D, 0x73,
+  0x3E, 0x20, 0x4F, 0xEB, 0x6D, 0x61, 0x73, 0x6B, 0x3E, 0x22, 0x00, 0xA3, 0x63, 0x61, 0x70, 0x74,
+  0x75, 0x85, 0xD6, 0x00, 0x49, 0x6E, 0x70, 0x75, 0x8A, 0x63, 0x61, 0x70, 0x74, 0x75, 0x85, 0x20,
+  0xD0, 0x00,
+};
+
+constexpr bool help_is_same(const char *a, const char *b)
+{
+  return *a == *b && (*a == 0 || help_is_same(a + 1, b + 1));
+}
+
+static_assert(help_is_same(STATUS, "status"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(BUTTONS, "buttons"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(RELAYS, "relays"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(REMOVE, "remove"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(SET_LIGHT_STATE, "light_state"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(SET_LIGHT_MODE, "light_mode"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(SET_AVG_DURATION, "set_timeout"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(CLEAR_ROM, "clear_rom"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(SET_CONFIG, "set_config"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(BATCH, "batch"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(ZC_STATUS, "zero_cross"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(LATENCY, "latency"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(MEMORY, "memory"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(HELP, "help"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(LOG, "log"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(BUS, "bus"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(AMBIENT_SENSOR, "ambient"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(USAGE_REPORT, "usage"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(SET_SEQUENCE, "sequence"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(SELECT_STEP, "step"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(SUBSCRIBE, "subscribe"), "help catalog is outdated, run tools/help/gen_help.py");
+static_assert(help_is_same(CAPTURE_DUMP, "capture"), "help catalog is outdated, run tools/help/gen_help.py");
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef STATIC_CONFIG_H
+#define STATIC_CONFIG_H
+
+/* Devices of STATIC_CONFIG build (env:nanoatmega328_static). Edit and rebuild to change wiring:
+   devices can not be added or removed from serial in this build.
+   Button<pin, front, type>: front - 0 if pushed button connects pin to GND, 1 if to VCC; type - 'M' momentary, 'L' locked
+   Relay<pin, type>: type - 'L' low triggered, 'H' high triggered
+   Order of relays sets bits of light mode: first relay is bit 0 */
+
+typedef ButtonSet<
+    Button<3, 0, 'M'>>
+    StaticButtons;
+
+typedef RelaySet<
+    Relay<A0, 'L'>,
+    Relay<A1, 'L'>>
+    StaticRelays;
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef STATIC_DEVICES_H
+#define STATIC_DEVICES_H
+
+/* Devices known at compile time (STATIC_CONFIG build).
+   Pin, front and type of every device are template parameters, so reading buttons and switching relays
+   are compiled to direct port instructions and type dispatch is resolved by compiler.
+   Included from main.cpp after structs and prototypes: uses BUTTON, RELAY, M_STATE and button action functions.
+   Devices are declared in static_config.h */
+
+#include "board.h"
+
+// Same as digitalReadDebounce() but for pin known at compile time. Learned interval isn't saved, there is no ROM record
+template <uint8_t pin>
+uint8_t static_read_debounce(BUTTON *btn)
+{
+  uint8_t level = FastPin<pin>::read(); // pin is pulled up;
+  if (level == btn->last_pin_state)
+    return level;
+
+  uint32_t start = micros();
+  uint32_t now = start;
+  uint32_t change_us = start;
+  uint32_t gap_us = 0;
+  while (now - change_us < btn->debounce_us && now - start < DEBOUNCE_READ_MAX_US)
+  {
+    frame_input(); // time of waiting is used for serial receiving, job is left to loop() so samples stay dense
+    uint8_t sample = FastPin<pin>::read();
+    now = micros();
+    if (sample != level)
+    {
+      gap_us = now - change_us > gap_us ? now - change_us : gap_us;
+      level = sample;
+      change_us = now;
+    }
+  }
+
+  uint8_t is_bounce = start - btn->settled_us < DEBOUNCE_MAX_US;
+  if (is_bounce && start - btn->settled_us > gap_us)
+    gap_us = start - btn->settled_us;
+  if (DEBOUNCE_ADAPTIVE && (is_bounce || level != btn->last_pin_state))
+    debounce_learn(btn, gap_us);
+  if (level != btn->last_pin_state)
+    btn->settled_us = change_us;
+  return level;
+}
+
+// Action on button edge. state: 1 - pressed, -1 - released
+template <char type>
+struct ButtonAction;
+
+template <>
+struct ButtonAction<'M'>
+{
+  static inline void handle(M_STATE *light, BUTTON *btn, uint8_t index, int8_t state, uint32_t now)
+  {
+    if (state == 1)
+      momentary_button_action(light, btn, index, now);
+  }
+};
+
+template <>
+struct ButtonAction<'L'>
+{
+  static inline void handle(M_STATE *light, BUTTON *btn, uint8_t index, int8_t state, uint32_t now)
+  {
+    (void)index; // same handle() for every type, locked button has no click gestures
+    (void)now;
+    if (state != 0)
+      locked_button_action(light, btn, state);
+  }
+};
+
+// front: 0 if pushed button connects pin to GND, 1 if to VCC. type: 'M' - momentary, 'L' - self locked
+template <uint8_t pin, uint8_t front, char type>
+struct Button
+{
+  static_assert(pin >= board_button_first && pin <= board_button_last, "Button pin out of range");
+  static_assert(board_has_port(pin), "Button pin has no digital port");
+  static_assert(!(ZERO_CROSS && pin == ZC_PIN), "Button pin is occupied by zero cross detector");
+  static_assert(!(BUS_MODE && pin == BUS_DE_PIN), "Button pin is occupied by bus transceiver");
+  static_assert(front <= 1, "Button front must be 0 or 1");
+  static_assert(type == 'M' || type == 'L', "Button type must be 'M' or 'L'");
+
+  static void init(BUTTON *btn)
+  {
+    btn->is_defined = 1;
+    btn->pin = pin;
+    btn->type = type;
+    btn->front = front;
+    btn->state = 0;
+    btn->last_state = 0;
+    btn->current_state_time = 0;
+    btn->last_state_time = 0;
+    btn->trace_us = 0;
+    btn->edge_us = 0;
+    fast_pin_init(&btn->io, pin); // for code which handles buttons in common way (status, trace)
+    FastPin<pin>::input_pullup();
+    btn->last_pin_state = FastPin<pin>::read();
+    debounce_init(btn, DEBOUNCE_DEFAULT_US);
+    if (TRACE && TRACE_PCINT)
+      trace_watch_pin(pin);
+  }
+
+  static int8_t read(BUTTON *btn, uint32_t now)
+  {
+    uint32_t read_us = TRACE ? micros() : 0;
+    uint8_t current_signal = static_read_debounce<pin>(btn);
+    int8_t state = 0;
+
+    if (current_signal != btn->last_pin_state)
+    {
+      state = current_signal == front ? 1 : -1;
+      if (state == 1)
+      {
+        // double click counts between two pressing fronts
+        btn->last_state_time = btn->current_state_time;
+        btn->current_state_time = now;
+      }
+    }
+    note_button_edge(btn, state, read_us);
+    btn->last_pin_state = current_signal;
+    btn->state = state;
+    return state;
+  }
+
+  static inline void handle(M_STATE *light, BUTTON *btn, uint8_t index, uint32_t now)
+  {
+    ButtonAction<type>::handle(light, btn, index, read(btn, now), now);
+  }
+};
+
+// type: 'L' - low triggered relay, 'H' - high triggered relay
+template <uint8_t pin, char type>
+struct Relay
+{
+  static_assert(pin >= board_relay_first && pin <= board_relay_last, "Relay pin out of range");
+  static_assert(board_has_port(pin), "Relay pin has no digital port");
+  static_assert(!(I2C_IN_USE && (pin == I2C_SDA_PIN || pin == I2C_SCL_PIN)), "Relay pin is occupied by I2C bus");
+  static_assert(type == 'L' || type == 'H', "Relay type must be 'L' or 'H'");
+
+  static void init(RELAY *relay)
+  {
+    relay->pin = pin;
+    relay->type = type;
+    relay->state = 0;
+    fast_pin_init(&relay->io, pin);
+  }
+
+  static inline void write(RELAY *relay, uint8_t to_state)
+  {
+    FastPin<pin>::write(type == 'H' ? to_state : !to_state);
+    relay->state = to_state;
+  }
+};
+
+// Lists of devices. Index of device in list is its index in buttons[] and relays[]
+template <typename... Buttons>
+struct ButtonSet;
+
+template <>
+struct ButtonSet<>
+{
+  static const uint8_t size = 0;
+  static inline void init(uint8_t) {}
+  static inline void scan(M_STATE *, uint8_t, uint32_t) {}
+};
+
+template <typename First, typename... Rest>
+struct ButtonSet<First, Rest...>
+{
+  static const uint8_t size = 1 + ButtonSet<Rest...>::size;
+
+  static inline void init(uint8_t index)
+  {
+    First::init(&buttons[index]);
+    ButtonSet<Rest...>::init(index + 1);
+  }
+
+  static inline void scan(M_STATE *light, uint8_t index, uint32_t now)
+  {
+    First::handle(light, &buttons[index], index, now);
+    ButtonSet<Rest...>::scan(light, index + 1, now);
+  }
+};
+
+template <typename... Relays>
+struct RelaySet;
+
+template <>
+struct RelaySet<>
+{
+  static const uint8_t size = 0;
+  static inline void init(uint8_t) {}
+  static inline void write(uint8_t, uint8_t) {}
+};
+
+template <typename First, typename... Rest>
+struct RelaySet<First, Rest...>
+{
+  static const uint8_t size = 1 + RelaySet<Rest...>::size;
+
+  static inline void init(uint8_t index)
+  {
+    First::init(&relays[index]);
+    RelaySet<Rest...>::init(index + 1);
+  }
+
+  // bit n of mask - state of relay n
+  static inline void write(uint8_t mask, uint8_t index)
+  {
+    First::write(&relays[index], (mask >> index) & 1);
+    RelaySet<Rest...>::write(mask, index + 1);
+  }
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+/* Persistence backends. Firmware keeps settings through rom object of type ROM_T with EEPROM library like
+   interface: read(), update(), get(), put(), length(), is_ready() and flush(). Backend is selected at build time
+   by STORAGE (see main.cpp), so calls are resolved by compiler and internal EEPROM build has no overhead.
+   Included from main.cpp after configuration defines */
+
+#include <EEPROM.h>
+#if STORAGE == STORAGE_I2C
+#include <Wire.h>
+#endif
+
+#ifndef I2C_ROM_ADDRESS
+#define I2C_ROM_ADDRESS 0x50 // 24Cxx and FRAM with A0..A2 tied to GND
+#endif
+#ifndef I2C_ROM_SIZE
+#define I2C_ROM_SIZE 4096U // 24C32 / FM24C32. Two address bytes are used, so 24C32 .. 24C512 and FRAM FM24Cxx are supported
+#endif
+#define I2C_ROM_PAGE 16          // Cached page: divides page of every 24Cxx, and with 2 address bytes fits 32 byte Wire buffer
+#define I2C_ROM_CLOCK 400000UL
+#define I2C_ROM_WRITE_MS 10      // Max write cycle of 24Cxx (FRAM has none). Longer busy memory is considered absent
+#define I2C_ROM_NO_PAGE 0xFFFF
+
+// get() and put() of any type over byte access of backend
+template <class BACKEND>
+class RomAccess
+{
+public:
+  template <typename T>
+  T &get(uint16_t address, T &t)
+  {
+    uint8_t *ptr = (uint8_t *)&t;
+    for (uint16_t i = 0; i < sizeof(T); i++)
+      ptr[i] = static_cast<BACKEND *>(this)->read(address + i);
+    return t;
+  }
+
+  template <typename T>
+  const T &put(uint16_t address, const T &t)
+  {
+    const uint8_t *ptr = (const uint8_t *)&t;
+    for (uint16_t i = 0; i < sizeof(T); i++)
+      static_cast<BACKEND *>(this)->update(address + i, ptr[i]);
+    return t;
+  }
+};
+
+// Internal EEPROM: every changed byte is written at once, ~3.3ms each
+class InternalRom : public RomAccess<InternalRom>
+{
+public:
+  void begin(void) {}
+  uint8_t read(uint16_t address) { return EEPROM.read(address); }
+  void update(uint16_t address, uint8_t value)
+  {
+    cycle_mark(MARK_ROM_UPDATE);
+    EEPROM.update(address, value);
+    cycle_mark(MARK_ROM_UPDATE | MARK_END);
+  }
+  uint16_t length(void) { return EEPROM.length(); }
+  uint8_t is_ready(void) { return eeprom_is_ready(); }
+  void flush(void) {}
+};
+
+#if STORAGE == STORAGE_I2C
+/* External I2C memory (24Cxx EEPROM or FRAM). One page is cached: reads of page are served from cache after one
+   bulk read, updates change cache only and the changed part of page is written by one sequential write when other
+   page is touched or flush() is called from loop(). So settings written byte by byte cost one write cycle per page */
+class I2cRom : public RomAccess<I2cRom>
+{
+public:
+  uint32_t page_writes; // sequential writes sent to memory since boot
+  uint8_t failures;     // transfers not acknowledged
+
+  void begin(void)
+  {
+    Wire.begin();
+    Wire.setClock(I2C_ROM_CLOCK);
+    page = I2C_ROM_NO_PAGE;
+    dirty_from = I2C_ROM_PAGE;
+    dirty_to = 0;
+    is_writing = 0;
+    page_writes = 0;
+    failures = 0;
+  }
+
+  uint8_t read(uint16_t address)
+  {
+    if (address >= I2C_ROM_SIZE)
+      return 0xFF;
+    select(address);
+    return cache[address % I2C_ROM_PAGE];
+  }
+
+  void update(uint16_t address, uint8_t value)
+  {
+    if (address >= I2C_ROM_SIZE)
+      return;
+    select(address);
+    uint8_t offset = address % I2C_ROM_PAGE;
+    if (cache[offset] == value)
+      return;
+    cache[offset] = value;
+    dirty_from = offset < dirty_from ? offset : dirty_from;
+    dirty_to = offset + 1 > dirty_to ? offset + 1 : dirty_to;
+  }
+
+  uint16_t length(void) { return I2C_ROM_SIZE; }
+
+  uint8_t is_ready(void)
+  {
+    // acknowledge polling: memory doesn't answer its address during write cycle. Bus is used only after write
+    if (!is_writing)
+      return 1;
+    Wire.beginTransmission(I2C_ROM_ADDRESS);
+    is_writing = Wire.endTransmission() != 0;
+    return !is_writing;
+  }
+
+  void flush(void)
+  {
+    // called every loop: writes when memory is ready, not acknowledged write stays dirty and is retried
+    if (dirty_from < dirty_to && is_ready())
+      write_dirty();
+  }
+
+private:
+  uint8_t cache[I2C_ROM_PAGE];
+  uint16_t page;      // address of cached page
+  uint8_t dirty_from; // changed bytes of cache not written yet: dirty_from .. dirty_to - 1
+  uint8_t dirty_to;
+  uint8_t is_writing; // write cycle may be in progress
+
+  uint8_t write_dirty(void)
+  {
+    uint16_t address = page + dirty_from;
+    Wire.beginTransmission(I2C_ROM_ADDRESS);
+    Wire.write((uint8_t)(address >> 8));
+    Wire.write((uint8_t)address);
+    Wire.write(cache + dirty_from, dirty_to - dirty_from);
+    if (Wire.endTransmission() != 0)
+    {
+      failures++;
+      return 0;
+    }
+    page_writes++;
+    is_writing = 1;
+    dirty_from = I2C_ROM_PAGE;
+    dirty_to = 0;
+    return 1;
+  }
+
+  void wait_ready(void)
+  {
+    // only callers which didn't check is_ready() wait here, memory busy longer than write cycle is absent
+    uint32_t start = millis();
+    while (!is_ready() && millis() - start < I2C_ROM_WRITE_MS)
+      ;
+  }
+
+  void select(uint16_t address)
+  {
+    uint16_t first = address - address % I2C_ROM_PAGE;
+    if (first == page)
+      return;
+
+    // new page is read before old one is written, so caller which checked is_ready() never waits for write cycle
+    uint8_t next[I2C_ROM_PAGE];
+    wait_ready();
+    Wire.beginTransmission(I2C_ROM_ADDRESS);
+    Wire.write((uint8_t)(first >> 8));
+    Wire.write((uint8_t)first);
+    uint8_t n = 0;
+    if (Wire.endTransmission(false) == 0 && Wire.requestFrom((uint8_t)I2C_ROM_ADDRESS, (uint8_t)I2C_ROM_PAGE) == I2C_ROM_PAGE)
+    {
+      for (; n < I2C_ROM_PAGE; n++)
+        next[n] = Wire.read();
+    }
+    else
+    {
+      failures++;
+    }
+    for (; n < I2C_ROM_PAGE; n++)
+      next[n] = 0; // absent memory reads as cleared one, firmware doesn't expect 0xFF of new chip
+
+    if (dirty_from < dirty_to)
+    {
+      // cache is reused, so write is retried until memory acknowledges it or write cycle time passes
+      uint32_t start = millis();
+      while (!write_dirty() && millis() - start < I2C_ROM_WRITE_MS)
+        ;
+    }
+    memcpy(cache, next, I2C_ROM_PAGE);
+    page = first;
+    dirty_from = I2C_ROM_PAGE;
+    dirty_to = 0;
+  }
+};
+
+typedef I2cRom ROM_T;
+#else
+typedef InternalRom ROM_T;
+#endif
+
+#endif
@@ -1,6 +1,9 @@
 #include <Arduino.h>
 #include <EEPROM.h>
 #include <ArduinoJson.h>
+#include <util/atomic.h>
+#include <util/twi.h>
+#include "board.h"
 
 // Todo:
 // + Timeout when light should turn off automaticaly
@@ -61,86 +64,441 @@
   |1 1 1 1 1 1 1 1|1 1 1 1 1 1 1 1|1 1 1 1 : 1 1 1 1|1 1 1 1 1 1 1 1|1 1 1 1 1 1 1 1|1 1 1 1 1 1 1 1 |  ....    |1 1 1 1 1 1 1 1|1 1 1 1 1 1 1 1| ....     |
    avg_on_duration   light_mode     devices count    BUTTON->pin     BUTTON->type     BUTTON->front    buttons   RELAY->pin      RELAY->type       relays
                                    buttons : relays
+  Optional modules store their data after relays starting from EXT_OFFSET. Their areas are reserved in every build,
+  also when module is disabled (event log slots without EVLOG_PERSIST too), so firmware of any env reads settings
+  written by other one at the same offsets:
+  |ZC_CFG_OFFSET                    |EVLOG_ROM_OFFSET                                                         |
+  |1 1 1 1 1 1 1 1 1 1 1 1 1 1 1 1 |1 1 1 1 1 1 1 1|1 1 1 1 1 1 1 1|1 1 1 1 ... 1 1 1 1|1 1 1 1 ... 1 1 1 1| ... slots
+   zero cross offset_us              slot seq        entries length  time before first   encoded entries
+                                                                     entry (4 bytes)
+  |LIGHT_STATE_OFFSET|AMBIENT_OFFSET                                                         |LATCH_OFFSET
+  |1 1 1 1 1 1 1 1 |1 1 1 1 1 1 1 1|1 1 1 1 1 1 1 1|1 1 1 1 ... 1 1 1 1|1 1 1 1 ... 1 1 1 1|1 1 1 1 1 1 1 1|1 1 1 1 1 1 1 1| ....   |
+   light_state       ambient pin     table steps     thresholds         modes              RELAY->reset_pin RELAY->pulse_ms relays
+   (saved only when CONFIG.init_light_state is 3)                                           (latching relays only)
+  |USAGE_OFFSET                                                                                       |
+  |1 1 1 1 ... 1 1 1 1|1 1 1 1 ... 1 1 1 1|1 1 1 1 ... 1 1 1 1|1 1 1 1 ... 1 1 1 1| .... |1 1 1 1 ... 1 1 1 1|1 1 1 1 ... 1 1 1 1| ....
+   counted seconds     relay cycles        relay on seconds    relay rated life     relays mode activations    mode on seconds     modes
+   (USAGE_COUNTERS_T, 4 byte words)
+  |SEQUENCE_OFFSET                                                     |DEBOUNCE_OFFSET          |
+  |1 1 1 1 1 1 1 1|1 1 1 1 1 1 1 1| .... |1 1 1 1 ... 1 1 1 1| .... |1 1 1 1 1 1 1 1| ....    |
+   steps           step mode        steps  step name (8 bytes)  steps  BUTTON->debounce  buttons
+                                                                       (100 us units)
+  |CAPTURE_ROM_OFFSET
+  |1 1 1 1 ... 1 1 1 1|  ....  up to end of memory
+   capture entries (capture build only, written again from boot)
 */
 
 #define member_size(type, member) (sizeof(((type *)0)->member))
 #define MIN_TIMEOUT 5U
 #define MAX_BUTTONS 5
 #define MAX_RELAYS 5
-#define START_BTN_PIN 2  // Define first GPIO in the row for buttons
-#define END_BTN_PIN 13   // Define last GPIO in the row for buttons
-#define START_REL_PIN A0 // Define first GPIO in the row for relays
-#define END_REL_PIN A7   // Define first GPIO in the row for relays
-#define JSON_BUFFER 128  // Buffer for incoming strings from Serial or other external sources
+#define START_BTN_PIN board_button_first // Define first GPIO in the row for buttons
+#define END_BTN_PIN board_button_last    // Define last GPIO in the row for buttons
+#define START_REL_PIN board_relay_first  // Define first GPIO in the row for relays
+#define END_REL_PIN board_relay_last     // Define first GPIO in the row for relays
+#define JSON_BUFFER 192  // Max length of one command from Serial or other external sources. Should fit batch command
+#define CMD_RING_SIZE 256 // Received commands waiting for execution. Host could send few commands without waiting for acknowledgements
+#define CMD_PER_TICK 2    // Max commands executed during one loop()
+#define CMD_ACK 1         // Print "@<seq> <result>" after every received line, seq counts lines from boot (0..255)
+#define TICK_BUDGET_US 2000U // Time per loop() for commands and background jobs, so buttons are scanned at full rate
+#define JOB_DEV_TABLE_SIZE (EXT_OFFSET - (CONFIG_OFFSET) + 1 + 2 * MAX_RELAYS + MAX_BUTTONS) // Config, light state and device table with latching data and intervals written by background job
+#define JOB_SEQUENCE_SIZE (DEBOUNCE_OFFSET - (SEQUENCE_OFFSET)) // Double-click sequence with step names written by background job
+#define JOB_SEGMENTS 6 // ROM ranges written by one job
+#define JOB_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define JOB_IMAGE_SIZE JOB_MAX(JOB_DEV_TABLE_SIZE, JOB_MAX(SEQUENCE ? JOB_SEQUENCE_SIZE : 0, EVLOG && EVLOG_PERSIST ? EVLOG_ROM_SLOT_SIZE : 0))
+#ifdef __AVR__
+#define JSON_ARENA_SIZE 384 // Static memory for parsing one command. Check high water mark with "memory" command
+#else
+#define JSON_ARENA_SIZE 4096 // Host build: pointers and ArduinoJson memory pools are bigger
+#endif
+#define ARENA_ALIGN sizeof(void *)
+#ifdef __AVR__
+#define FW_STATE
+#else
+#define FW_STATE thread_local // Host build: every thread has own firmware state, so tools/sim runs many boards at once
+#endif
 #define DEBUGING 0       // Switch some serial ouput for debuging purpose
 #define CLEAN_ROM 0      // Erase EEPROM during setup(). For debuging
+#ifndef STATIC_CONFIG
+#define STATIC_CONFIG 0 // Devices are declared in static_config.h at build time instead of loading from EEPROM (env:nanoatmega328_static)
+#endif
 #define DOUBLE_CLICK_TIME 500
 #define MIN_COUNTABLE_DURATION 1U // Minimun amount of time when light_state was in on state than will be taken to calculate average duration
 #define AVG_DURATION_ITERATION 4U
 #define CONFIG_OFFSET 0
-#define M_STATE_OFFSET CONFIG_OFFSET + sizeof(config)
+#define M_STATE_OFFSET CONFIG_OFFSET + sizeof(CONFIG)
 #define DEV_CNT_OFFSET M_STATE_OFFSET + member_size(M_STATE, avg_on_duration) + member_size(M_STATE, light_state)
 #define BUTTON_OFFSET DEV_CNT_OFFSET + sizeof(DEV_CNT_T)
 #define RELAY_OFFSET BUTTON_OFFSET + (member_size(BUTTON, pin) + member_size(BUTTON, type) + member_size(BUTTON, front)) * MAX_BUTTONS
+#define EXT_OFFSET RELAY_OFFSET + (member_size(RELAY, pin) + member_size(RELAY, type)) * MAX_RELAYS
+#define ZC_CFG_OFFSET EXT_OFFSET
+#define EVLOG_ROM_OFFSET ZC_CFG_OFFSET + sizeof(uint16_t)
+#define LIGHT_STATE_OFFSET EVLOG_ROM_OFFSET + EVLOG_ROM_SLOTS * EVLOG_ROM_SLOT_SIZE
+#define AMBIENT_OFFSET LIGHT_STATE_OFFSET + sizeof(uint8_t)
+#define LATCH_OFFSET AMBIENT_OFFSET + 2 + 2 * AMBIENT_STEPS
+#define USAGE_OFFSET LATCH_OFFSET + 2 * MAX_RELAYS
+#define SEQUENCE_OFFSET USAGE_OFFSET + sizeof(USAGE_COUNTERS_T)
+#define SEQUENCE_NAME_OFFSET(step) (SEQUENCE_OFFSET + 1 + SEQUENCE_STEPS + (step) * SEQUENCE_NAME_LEN)
+#define DEBOUNCE_OFFSET SEQUENCE_NAME_OFFSET(SEQUENCE_STEPS)
+#define CAPTURE_ROM_OFFSET (DEBOUNCE_OFFSET + MAX_BUTTONS)
+
+#ifndef ZERO_CROSS
+#define ZERO_CROSS 0               // Switch relays synchronously with mains zero crossing. Detector output connected to ICP1 (D8)
+#endif
+#ifndef ZC_SYNTHETIC
+#define ZC_SYNTHETIC 0             // Generate zero crossings with Timer1 instead of ICP1 input. For simulation without mains
+#endif
+#define ZC_PIN 8                   // ICP1 pin. Can't be used for buttons when ZERO_CROSS enabled
+#define ZC_TICKS_PER_US 2          // Timer1 runs with prescaler 8 -> 0.5us per tick
+#define ZC_OFFSET_US 500U          // Default delay from zero crossing to relay switching
+#define ZC_MAX_OFFSET_US 9000U     // Must be less than half period of mains
+#define ZC_MIN_LEAD_TICKS 8        // Compare A is set at least this ahead of counter, passed value would match after 32ms wrap
+#define ZC_TIMEOUT_MS 100U         // If no crossing happened during this time detector considered absent and relays switched immediately
+#define ZC_QUEUE_LEN 4             // Relay transitions waiting for zero crossing
+#define ZC_SYNTH_HALF_PERIOD_US 10000U // Half period of synthetic signal (50Hz mains)
+
+#ifndef LATCHING
+#define LATCHING 0 // Bistable latching relays (type 'P'): coil pulses on set pin (on) and reset pin (off) ended by Timer2 (env:nanoatmega328_latching)
+#endif
+#define LATCH_PULSE_MS 30          // Coil pulse of latching relay added without "pulse"
+#define LATCH_TICK_TOP 249         // Timer2 in CTC mode with prescaler 64 -> 1ms per tick
+#define LATCH_WAIT_MS 258          // Longest coil pulse (255ms) with its first and last tick, relay is released after it
+#define RELAY_STATE_UNKNOWN 2      // Contacts of latching relay before its first pulse, so first write always pulses
+
+#ifndef USAGE
+#define USAGE 0 // Count switch cycles and on time of relays and light modes (command "usage"), ~150 bytes of SRAM (env:nanoatmega328_usage)
+#endif
+#define USAGE_MODES 8              // Light modes counted apart: 1 .. USAGE_MODES - 1, higher modes share slot 0
+#define USAGE_SAVE_MIN 60          // Changed counters are saved to ROM at most once per this time...
+#define USAGE_SAVE_CYCLES 32       // ...or sooner when so many switch cycles are not saved yet
+#define USAGE_LIFE_CYCLES 100000UL // Rated electrical life of relay when it isn't set by "usage" command
+
+#define DEBOUNCE_ADAPTIVE 1        // Debounce interval of every button is learned from bounces of its switch
+#define DEBOUNCE_DEFAULT_US 5000U  // Interval of new button, and of every button without DEBOUNCE_ADAPTIVE
+#define DEBOUNCE_MIN_US 500U       // Learned interval is kept within these bounds
+#define DEBOUNCE_MAX_US 20000U
+#define DEBOUNCE_READ_MAX_US 40000UL // Chattering pin gives its last level after this time
+#define DEBOUNCE_UNIT_US 100U      // Interval is saved to ROM in these units
+#define DEBOUNCE_SAVE_EDGES 16     // Learned interval is saved after so many edges (only changed byte is written)
+/* Pin at accepted level is read once, so waiting is spent only on edges: new level is accepted when pin keeps it for
+   debounce interval. Longest time pin kept level between bounces of edge is learned like round trip time of TCP:
+   smoothed mean and mean deviation, interval is mean plus 4 deviations. Bounce seen soon after accepted edge shows
+   too short interval, time since that edge is learned then */
+
+#ifndef SEQUENCE
+#define SEQUENCE 0 // Double-click steps through user list of light modes (command "sequence") instead of all modes, ~45 bytes of SRAM with its job image (env:nanoatmega328_sequence)
+#endif
+#define SEQUENCE_STEPS 8           // Entries of list
+#define SEQUENCE_NAME_LEN 8        // Bytes of step name in ROM, with terminating 0
+#define SEQUENCE_NONE 255          // Step of light mode which is not in list, double-click goes to first step
+
+#ifndef AMBIENT
+#define AMBIENT 0 // Ambient light sensor on A6/A7 picks light mode at turn-on (command "ambient"), ~20 bytes of SRAM (env:nanoatmega328_ambient)
+#endif
+#define AMBIENT_STEPS 4            // Entries of threshold table
+#define AMBIENT_STAY_OFF 255       // Table mode: button doesn't turn light on at this level (daylight)
+#define AMBIENT_OVERSAMPLE_BITS 8  // 2^n free running conversions (104us each) are summed per block. Not less than 4
+#define AMBIENT_FILTER_SHIFT 6     // Blocks are filtered with time constant of 2^n blocks (~1.7s), so passing shadows are ignored
+/* Sensor is divider of photoresistor (or phototransistor) and resistor giving higher voltage with more light.
+   ADC converts it continuously and interrupt accumulates conversions, loop() never waits for conversion.
+   Level 0 (dark) .. 255 (bright) selects first table entry with level <= threshold, its mode is applied when
+   light is turned on. Above last threshold light is turned on in last mode */
+
+#ifndef EVLOG
+#define EVLOG 0 // Keep log of events (button edges, gestures, light changes, ROM writes) for field diagnostics, ~85 bytes of SRAM (env:nanoatmega328_evlog)
+#endif
+#define EVLOG_SIZE 64              // Bytes of SRAM for log. Must be power of 2 and not greater than 128
+#define EVLOG_PERSIST 0            // Flush log to EEPROM in batches, slot is written by background job
+#define EVLOG_ROM_SLOTS (STORAGE == STORAGE_I2C ? 32 : 4) // EEPROM slots written in turn so every cell is written once per EVLOG_ROM_SLOTS batches
+#define EVLOG_ROM_SLOT_SIZE 64     // Slot header (6 bytes) + entries
+#define EVLOG_FLUSH_BATCH 32       // Unflushed bytes which trigger writing of slot
+#define EVLOG_FLUSH_PERIOD_MS 900000UL // Unflushed entries are written at least every 15 minutes
+
+#ifndef TRACE
+#define TRACE 0 // Measure latency from button edge (or serial command) to relays write, ~120 bytes of SRAM (env:nanoatmega328_trace)
+#endif
+#define TRACE_PCINT 1              // Stamp button edges in pin change interrupt. If 0 edges are stamped when loop() reads buttons
+#define TRACE_BUCKETS 12           // Histogram buckets: 0 - below 1024us, n - from 2^(9+n) to 2^(10+n) us, last one - everything above
+#define TRACE_STALE_US 50000UL     // Edge stamp not followed by button state change during this time is dropped as noise
+
+#define NOTIFY 1                   // Push change record to subscribed host when light or devices change (command "subscribe")
+#define NOTIFY_VERSION 1           // Format of change record, increased when fields are added
+/* Change record: "!<version> <counter> <light_state> <light_mode> <timeout> <buttons>:<relays>"
+   Counter is increased on every change since boot (changes made during one loop() give one record), so host
+   which sees gap in counter has lost records and resyncs with "subscribe". Subscription is kept in CONFIG, after
+   reboot first record has counter 0. Records are not pushed by node with bus address */
+
+#ifndef HELP_CATALOG
+#define HELP_CATALOG 0 // Help of commands compressed in flash (include/help_catalog.h, generated by tools/help/gen_help.py), ~2.4 KB of flash (env:nanoatmega328_help)
+#endif
+#define HELP_CHUNK 16              // Bytes of expanded help written to Serial at once
+
+#ifndef CAPTURE
+#define CAPTURE 0 // Record inputs from boot for replay on host (tools/replay, env:nanoatmega328_capture)
+#endif
+#define CAPTURE_SIZE 256 // Bytes of SRAM for newest capture entries, older ones are streamed to ROM after settings
+#define CAPTURE_ANY_COMMAND 0xFF // Action of capture entry kept as whole command text
+/* Capture entries use event log coding: header (bits 7..4 - type, bits 1..0 - delta length code), time delta in ms.
+   Boot image of EEPROM settings is followed by button pin levels seen by loop(), executed commands and relay
+   masks commanded by firmware. Command is catalog index of action and options text, so usual one takes 6-10 bytes.
+   Entries are copied from SRAM to ROM from CAPTURE_ROM_OFFSET by loop(), one byte whenever ROM is ready, and
+   recording stops when ROM is full: ~500 bytes of internal EEPROM or ~3.5 KB of 24C32, capture always starts at boot.
+   clear_rom keeps capture. Replay feeds pins and commands to host build and compares relay masks */
+
+#ifndef CYCLE_MARKS
+#define CYCLE_MARKS 0 // Marks of hot paths in GPIOR0 for cycle counts in AVR emulator (tools/simavr, env:nanoatmega328_simavr)
+#endif
+
+#define STORAGE_EEPROM 0
+#define STORAGE_I2C 1
+#ifndef STORAGE
+#define STORAGE STORAGE_EEPROM // Settings memory: internal EEPROM or I2C FRAM/24Cxx on A4/A5 (env:nanoatmega328_i2c), see storage.h
+#endif
+#define I2C_SDA_PIN 18 // A4, can't be used for relays when STORAGE_I2C or REGMAP
+#define I2C_SCL_PIN 19 // A5
+#define I2C_IN_USE (STORAGE == STORAGE_I2C || REGMAP)
+
+#ifndef REGMAP
+#define REGMAP 0 // I2C slave register map for companion MCU (env:nanoatmega328_regmap). TWI is slave, so not with STORAGE_I2C
+#endif
+#ifndef REGMAP_ADDRESS
+#define REGMAP_ADDRESS 0x28
+#endif
+#define REGMAP_VERSION 1 // value of REG_VERSION, increased when registers are added
+/* First byte written by master sets register pointer, following written or read bytes go to pointer which increments
+   after every byte. Reads are served by TWI interrupt from current state. Writes of light and command registers are
+   executed by loop() with semantics of serial commands. Device commands: write REG_ARG_PIN and REG_ARG_TYPE, then
+   REG_COMMAND, and poll REG_STATUS. Adding button waits for its presses like "D" class command. Registers: */
+enum REGMAP_REGISTER
+{
+  REG_VERSION,      // R
+  REG_LIGHT_STATE,  // RW 0 or 1, like light_state command
+  REG_LIGHT_MODE,   // RW 1 .. max mode, like light_mode command
+  REG_MAX_MODE,     // R
+  REG_TIMEOUT,      // R  minutes
+  REG_AVG_DURATION, // RW minutes, like set_timeout command
+  REG_COUNTS,       // R  buttons << 4 | relays
+  REG_CHANGES_LOW,  // R  change counter of NOTIFY, reading low byte latches high byte
+  REG_CHANGES_HIGH, // R
+  REG_REJECTED,     // R  writes rejected since boot
+  REG_COMMAND,      // RW REGMAP_CMD_*
+  REG_ARG_PIN,      // RW
+  REG_ARG_TYPE,     // RW relay type 'H' or 'L'
+  REG_STATUS,       // R  REGMAP_STATUS_* of last command
+  REG_BUTTONS = 0x10, // R  pin, type, front of every button, MAX_BUTTONS
+  REG_RELAYS = 0x20,  // R  pin, type of every relay, MAX_RELAYS
+};
+enum REGMAP_COMMAND
+{
+  REGMAP_CMD_NONE,
+  REGMAP_CMD_ADD_BUTTON,
+  REGMAP_CMD_ADD_RELAY,
+  REGMAP_CMD_REMOVE_BUTTON,
+  REGMAP_CMD_REMOVE_RELAY,
+};
+enum REGMAP_STATUS
+{
+  REGMAP_STATUS_IDLE,
+  REGMAP_STATUS_PENDING,
+  REGMAP_STATUS_DONE,
+  REGMAP_STATUS_FAILED,
+};
+#define REGMAP_PENDING_STATE 1
+#define REGMAP_PENDING_MODE 2
+#define REGMAP_PENDING_DURATION 4
+#define REGMAP_PENDING_COMMAND 8
+#define REGMAP_DEVICE_LEN 40
+
+#ifndef BUS_MODE
+#define BUS_MODE 0 // Addressed RS-485 multi-drop bus instead of point-to-point serial. Changes CONFIG size, so EEPROM layout too
+#endif
+#define BUS_DE_PIN 2          // Transceiver driver enable (DE and /RE tied together). Can't be used for buttons when BUS_MODE enabled
+#define BUS_MAX_ADDRESS 247   // Node addresses 1..247, 0 - node is not on bus
+#define BUS_GROUPS 8          // Groups 1..8, node membership is bit mask
+/* Bus frames: ">" target ":" command "\n", target - node address, "*" - every node, "g" and number - every node of group.
+   Example: ">*:{...light_state...}" turns all lights off, ">g3:{...light_mode...}" sets mode on group 3. Every node applies
+   broadcast and group frames when the line ends, nobody answers them. Node answers (output and acknowledgement) only to frames
+   with its own address, enabling driver for the time of answer, so host sends next unicast frame after acknowledgement.
+   Lines without address are answers of other nodes and are ignored. Node with address 0 accepts plain lines as in
+   point-to-point mode and never enables driver: it is provisioned over USB with "bus" command */
 
 /* List of commands could receive from Serial and handle with handle_input_commands*/
 
-#define STATUS "status"
+#define STATUS "status" // prints devices count, light state and mode, timeout and boot time
 #define STATUS_FORMAT "\
 Buttons count: %d\n\
 Relays count: %d\n\
 Light state: %d\n\
 Light mode: %d\n\
 Average duration: %d\n\
-Timeout: %d"
-#define STATUS_FORMAT_LEN 128
+Timeout: %d\n\
+Boot to output us: %lu"
+#define STATUS_FORMAT_LEN 160
 
-#define BUTTONS "buttons"
+#define BUTTONS "buttons" // prints pin, type, front and learned debounce interval of every button
 #define BUTTONS_FORMAT "\
 Button %d ==================\n\
 Pin: %d\n\
 Type: %c\n\
-Front: %d"
+Front: %d\n\
+Debounce us: %u"
 #define BUTTONS_FORMAT_LEN 128
 #define ERR_BUTTONS_NO_BUTTONS "No button's defined yet"
 
-#define RELAYS "relays"
+#define RELAYS "relays" // prints pin and type of every relay, reset pin and pulse of latching one
 #define RELAYS_FORMAT "\
 Relay %d ==================\n\
 Pin: %d\n\
 Type: %c"
 #define RELAYS_FORMAT_LEN 64
+#define RELAYS_LATCH_FORMAT "\
+Reset pin: %d\n\
+Pulse ms: %d"
+#define RELAYS_LATCH_FORMAT_LEN 32
 #define ERR_RELAYS_NO_RELAYS "No relay's defined yet"
 
-#define REMOVE "remove"
+#define ERR_STATIC_DEVICES "Devices are fixed in firmware"
+
+#define REMOVE "remove" // device: {"pin", "device": "B" or "R"} to remove button or relay
 #define ERR_REMOVE_NOT_DEFINED "Device to remove not defined"
 
-#define SET_LIGHT_STATE "light_state"
+#define SET_LIGHT_STATE "light_state" // options: [1] - turn light on, [0] - off
 #define ERR_SET_LIGHT_STATE_NO_OPTIONS "No light state option's defined"
 
-#define SET_LIGHT_MODE "light_mode"
+#define SET_LIGHT_MODE "light_mode" // options: [mode] - relays combination 1 .. 2^relays - 1, without options - previous mode or next sequence step
 #define ERR_SET_LIGHT_MODE_NO_OPTIONS "No light mode option's defined"
 #define ERR_SET_LIGHT_MODE_UNSUCCESS "Set light mode failed"
 
-#define SET_AVG_DURATION "set_timeout"
+#define SET_AVG_DURATION "set_timeout" // options: [minutes] - average on duration which defines timeout
 #define MAX_AVG_DURATION 220U
 #define ERR_SET_AVG_DURATION_NO_OPTIONS "No timeout option's defined"
 #define ERR_SET_AVG_DURATION_OPTION_NOT_IN_RANGE "Provided timeout option's out of range"
 
-#define CLEAR_ROM "clear_rom"
+#define CLEAR_ROM "clear_rom" // erases settings memory in background
 
-#define SET_CONFIG "set_config"
+#define SET_CONFIG "set_config" // options: [init_light_state, default_light_mode, l_button_mode]
 #define ERR_SET_CONFIG_NO_OPTIONS "No config option's provided"
 
+#define BATCH "batch" // whole configuration in one command, validated before applying and saved to ROM at once
+#define BATCH_FORMAT "Batch applied: %d buttons, %d relays"
+#define BATCH_FORMAT_LEN 48
+#define ERR_BATCH_BUTTON "Batch rejected: invalid button" // followed by its index
+#define ERR_BATCH_RELAY "Batch rejected: invalid relay"   // followed by its index
+#define ERR_BATCH_TOO_MANY "Batch rejected: too many devices"
+#define ERR_BATCH_CONFIG "Batch rejected: invalid config"
+#define ERR_BATCH_TIMEOUT "Batch rejected: timeout out of range"
+
+#define ZC_STATUS "zero_cross" // options: [offset_us] to set new switching offset, without options prints statistics
+#define ZC_STATUS_FORMAT "\
+Zero cross detected: %d\n\
+Half period us: %u\n\
+Offset us: %u\n\
+Last phase us: %u\n\
+Min phase us: %u\n\
+Max phase us: %u\n\
+Switches: %u"
+#define ZC_STATUS_FORMAT_LEN 160
+#define ERR_ZC_DISABLED "Zero cross switching disabled in firmware"
+#define ERR_ZC_OPTION_NOT_IN_RANGE "Provided offset option's out of range"
+
+#define LATENCY "latency" // options: [1] - reset histograms after dump
+#define LATENCY_FORMAT "Path %s: count %u, max %lu us"
+#define LATENCY_FORMAT_LEN 64
+#define ERR_LATENCY_DISABLED "Latency tracing disabled in firmware"
+
+#define MEMORY "memory" // prints parser memory usage and free RAM
+#define MEMORY_FORMAT "\
+Arena size: %u\n\
+Arena high water: %u\n\
+Arena failures: %u\n\
+Free RAM: %d"
+#define MEMORY_FORMAT_LEN 96
+#define ERR_PARSER_NO_MEMORY "Command is too big for parser memory"
+
+#define HELP "help" // options: ["command"] - description, JSON example and errors of command. Without options lists commands
+#define HELP_EXAMPLE "Example: "
+#define HELP_ERRORS "Errors:"
+#define ERR_HELP_DISABLED "Help catalog disabled in firmware"
+#define ERR_HELP_UNKNOWN "Unknown command, send {\"class\":\"C\",\"action\":\"help\"} for command list"
+
+#define ACK_DONE "done"         // command executed
+#define ACK_OVERFLOW "overflow" // line longer than JSON_BUFFER, not executed
+#define ACK_DROPPED "dropped"   // no space in command queue, not executed
+#define ACK_NOT_JSON "not json" // line doesn't start with {
+#define ACK_INVALID "invalid"   // JSON parsing failed
+#define ACK_PROGRESS "progress" // long command is still running in background, followed by percents
+
+#define LOG "log" // options: [0] - dump log from SRAM (default), [1] - dump log persisted in EEPROM
+#define LOG_NAMES "PECDLMTAW" // event names in dump, indexed by event type
+#define ERR_LOG_DISABLED "Event log disabled in firmware"
+
+#define BUS "bus" // options: [address, groups] to set node address and groups bit mask, without options prints them
+#define BUS_FORMAT "Bus address: %u, groups: %u"
+#define BUS_FORMAT_LEN 40
+#define ERR_BUS_DISABLED "Bus mode disabled in firmware"
+#define ERR_BUS_OPTION_NOT_IN_RANGE "Provided bus option's out of range"
+#define ERR_BUS_NOT_UNICAST "Bus address can be set only by unicast frame"
+
+#define AMBIENT_SENSOR "ambient" // options: [pin] or [pin, [[threshold, mode], ...]], pin 0 - no sensor. Without options prints level and table
+#define AMBIENT_FORMAT "Ambient pin: %u, level: %u"
+#define AMBIENT_FORMAT_LEN 40
+#define AMBIENT_STEP_FORMAT "Up to %u: mode %u"
+#define AMBIENT_STEP_FORMAT_LEN 24
+#define ERR_AMBIENT_DISABLED "Ambient sensor disabled in firmware"
+#define ERR_AMBIENT_PIN "Ambient sensor pin should be A6, A7 or 0"
+#define ERR_AMBIENT_TABLE "Ambient table should have ascending thresholds and valid modes"
+
+#define USAGE_REPORT "usage" // options: [relay] - relay replaced, its counters are cleared, [relay, life_cycles] - rated life. Prints counters and days of life left
+#define USAGE_FORMAT "Counted hours: %lu"
+#define USAGE_FORMAT_LEN 32
+#define USAGE_RELAY_FORMAT "Relay %u: cycles %lu of %lu, on hours %lu"
+#define USAGE_RELAY_FORMAT_LEN 64
+#define USAGE_DAYS_LEFT ", days left: "
+#define USAGE_MODE_FORMAT "Mode %u: activations %lu, on hours %lu" // mode 0 - modes from USAGE_MODES
+#define USAGE_MODE_FORMAT_LEN 56
+#define ERR_USAGE_DISABLED "Usage accounting disabled in firmware"
+#define ERR_USAGE_RELAY "Relay number out of range"
+
+#define SET_SEQUENCE "sequence" // options: [mode or [mode, "name"], ...] - modes stepped by double-click, [] - all modes. Prints sequence
+#define SEQUENCE_FORMAT "Step %u: mode %u"
+#define SEQUENCE_FORMAT_LEN 24
+#define SEQUENCE_ALL "Double-click steps through all modes"
+#define SEQUENCE_LIT " *" // marks current step
+#define ERR_SEQUENCE_DISABLED "Mode sequence disabled in firmware"
+#define ERR_SEQUENCE_STEPS "Sequence should have valid modes and short names, not more steps than firmware keeps"
+
+#define SELECT_STEP "step" // options: [step] - light mode of sequence step 0 .. steps - 1, ["name"] - of named step
+#define ERR_SELECT_STEP "Sequence step not found"
+
+#define SUBSCRIBE "subscribe" // options: [1] - push change records, [0] - stop pushing. Record of current state is printed
+#define NOTIFY_FORMAT "!%u %u %u %u %u %u:%u"
+#define NOTIFY_FORMAT_LEN 40
+#define ERR_NOTIFY_DISABLED "Change notifications disabled in firmware"
+#define ERR_NOTIFY_BUS "Change records can't be pushed by node on bus"
+
+#define CAPTURE_DUMP "capture" // prints capture: "<ms> R <address> <hex>", "<ms> P <pin> <level>", "<ms> C <action> <options>", "<ms> O <mask>"
+#define CAPTURE_FORMAT "# capture %u/%u bytes%s"
+#define CAPTURE_FORMAT_LEN 40
+#define ERR_CAPTURE_DISABLED "Input capture disabled in firmware"
+
 /* end list of Serial commands*/
 
+#include "cycle_marks.h"
+#include "storage.h"
+#include "help_catalog.h"
+
 // Type and struct definitions:
 
 struct CONFIG
 {
-  uint8_t init_light_state : 2;   // light state after reboot: 00 - off, 01 - on, 11 - last state (this state not implementes)
+  uint8_t init_light_state : 2;   // light state after reboot: 00 - off, 01 - on, 11 - last state
   uint8_t default_light_mode : 4; // light mode applyed every time light turned on: 0 - last state, 1 .. n - corresponding mode
   uint8_t l_button_mode : 1;      // set up locked button behaviour: 0 - default behaveour (when pressed - on, unpressed - off), 1 - front or read edge change state
+  uint8_t notify : 1;             // push change records, see NOTIFY
+#if BUS_MODE
+  uint8_t bus_address; // node address on bus: 1..BUS_MAX_ADDRESS, 0 - not on bus
+  uint8_t bus_groups;  // bit n - member of group n + 1
+#endif
 };
 
 struct M_STATE
@@ -173,13 +531,342 @@ struct BUTTON
   uint8_t last_pin_state;      // previous cycle state on button pin: 0 - off state, 1 - on state
   uint32_t current_state_time; // time when current state was changed to ON state
   uint32_t last_state_time;    // last time when state was changed to ON state
+  volatile uint32_t trace_us;  // micros() of first edge on pin not handled yet (set from pin change interrupt), 0 - no edge
+  uint32_t edge_us;            // micros() of edge which caused current state
+  FAST_PIN io;                 // resolved port of pin
+  uint16_t debounce_us;        // pin has to keep new level so long to be accepted
+  uint16_t gap_avg_us;         // smoothed longest gap between bounces of edge, see DEBOUNCE_ADAPTIVE
+  uint16_t gap_dev_us;         // its mean deviation
+  uint32_t settled_us;         // micros() of last change of pin during accepted edge
+  uint8_t learned;             // edges learned after debounce_us was saved
 };
 
 struct RELAY
 {
-  uint8_t pin;   // that is pin relay connected to
-  char type;     // 'L' - low triggered relay, 'H' - high triggered relay
+  uint8_t pin;   // that is pin relay connected to. Set coil of latching relay
+  char type;     // 'L' - low triggered relay, 'H' - high triggered relay, 'P' - latching relay pulsed on pin or reset_pin
   uint8_t state; // 0 - relay is turned off, 1 - turned on
+  FAST_PIN io;   // resolved port of pin
+  uint8_t reset_pin;           // reset coil of latching relay
+  uint8_t pulse_ms;            // coil pulse of latching relay
+  volatile uint8_t pulse_left; // Timer2 ticks until coil is released, 0 - no pulse
+  FAST_PIN reset_io;           // resolved port of reset_pin
+};
+
+struct ZERO_CROSS_T
+{
+  volatile uint16_t offset_us;        // delay from zero crossing to switching relays, read by capture interrupt
+  volatile uint16_t last_capture;     // Timer1 value at last zero crossing
+  volatile uint16_t half_period;      // filtered time between crossings in Timer1 ticks. 0 - detector absent
+  volatile uint32_t last_seen;        // millis() of last zero crossing
+  volatile uint8_t queue[ZC_QUEUE_LEN]; // relay masks waiting for zero crossing: bit n - state of relay n
+  volatile uint8_t head;
+  volatile uint8_t tail;
+  volatile uint8_t armed;             // compare interrupt is scheduled for queue[tail]
+  volatile uint16_t phase_last;       // measured phase of last switching in us after zero crossing
+  volatile uint16_t phase_min;
+  volatile uint16_t phase_max;
+  volatile uint16_t switches;         // count of switchings made from interrupt
+};
+
+struct AMBIENT_T
+{
+  uint8_t pin;                       // A6 or A7, 0 - no sensor
+  uint8_t steps;                     // used entries of table
+  uint8_t thresholds[AMBIENT_STEPS]; // ascending levels, entry is selected when level <= threshold
+  uint8_t modes[AMBIENT_STEPS];      // 0 - last mode, 1 .. n - light mode, AMBIENT_STAY_OFF - button doesn't turn light on
+  volatile uint32_t sum;             // conversions of current block
+  volatile uint16_t samples;
+  volatile uint16_t filtered;        // filtered block average: 10 bits of conversion and 4 fractional bits
+  volatile uint8_t level;            // filtered >> 6
+  volatile uint8_t is_ready;         // first block is converted
+};
+
+struct REGMAP_T
+{
+  volatile uint8_t pointer;        // register of next byte
+  volatile uint8_t is_pointer_set; // first byte of write transfer is received
+  volatile uint8_t changes_high;   // latched by reading REG_CHANGES_LOW
+  volatile uint8_t pending;        // REGMAP_PENDING_* writes waiting for loop()
+  volatile uint8_t light_state;    // written values
+  volatile uint8_t light_mode;
+  volatile uint8_t avg_duration;
+  volatile uint8_t command;
+  volatile uint8_t arg_pin;
+  volatile uint8_t arg_type;
+  volatile uint8_t status;         // REGMAP_STATUS_*
+  volatile uint8_t rejected;
+};
+
+struct USAGE_RELAY_T
+{
+  uint32_t cycles;      // switches from off to on
+  uint32_t on_s;        // seconds turned on
+  uint32_t life_cycles; // rated electrical life, 0 - USAGE_LIFE_CYCLES
+};
+
+struct USAGE_MODE_T
+{
+  uint32_t activations; // times light was lit in mode
+  uint32_t on_s;
+};
+
+// Persisted part of usage accounting. It is saved by 4 byte words, every word is copied at once
+struct USAGE_COUNTERS_T
+{
+  uint32_t seconds; // time counted by firmware, gives switching rate for life estimation
+  USAGE_RELAY_T relays[MAX_RELAYS];
+  USAGE_MODE_T modes[USAGE_MODES];
+};
+
+/* Counters are increased in place: cycles by set_relay_state() (also from zero cross interrupt), activations when
+   handle_switching_light() applies mode, seconds once per second in loop(). ROM copy is updated in background one
+   byte per loop() when USAGE_SAVE_MIN passed since last save or USAGE_SAVE_CYCLES cycles are not saved. Counters of
+   relay belong to its place in relay table */
+struct USAGE_T
+{
+  USAGE_COUNTERS_T counters;
+  uint8_t mode;           // light mode lit now, 0 - light is off
+  uint32_t tick_ms;       // millis() of last counted second
+  uint32_t saved_ms;      // millis() when last save was started
+  uint8_t unsaved_cycles; // switch cycles after last save was started
+  uint8_t is_dirty;       // counters changed after last save was started
+  uint8_t is_saving;
+  uint8_t save_word;      // next word of counters to save
+  uint8_t save_byte;
+  uint32_t save_value;    // copy of word being saved
+};
+
+/* Double-click sequence. Modes of steps are fitted to relays present now once, when relay table changes, so step
+   change is one lookup. Names are read from ROM only for printing and selecting by name */
+struct SEQUENCE_T
+{
+  uint8_t steps;                 // used entries, 0 - double-click steps through all modes
+  uint8_t step;                  // step of current light mode, SEQUENCE_NONE - mode is not in list
+  uint8_t masks[SEQUENCE_STEPS]; // modes as they were set (saved to ROM)
+  uint8_t modes[SEQUENCE_STEPS]; // masks limited to present relays, step without them lights all relays
+};
+
+struct NOTIFY_T
+{
+  uint16_t changes;    // change counter since boot
+  uint8_t is_started;  // values of last record are taken
+  uint8_t light_state; // values of last record
+  uint8_t light_mode;
+  uint8_t timeout;
+  uint16_t devices;    // signature of device table
+};
+
+// Event log entry: header byte, 0..4 bytes of time delta in ms since previous entry, optional argument byte
+// header: bits 7..4 - event type, bit 2 - argument present, bits 1..0 - delta length code (0, 1, 2 or 4 bytes)
+enum EVENT_TYPE
+{
+  EV_BOOT,         // 'P' power on
+  EV_BTN_EDGE,     // 'E' arg: button index << 1 | 1 - pressed, 0 - released
+  EV_CLICK,        // 'C' arg: button index
+  EV_DOUBLE_CLICK, // 'D' arg: button index
+  EV_LIGHT,        // 'L' arg: light_state << 7 | cause ('B' - button, 'T' - timeout, 'S' - serial, 'I' - I2C)
+  EV_MODE,         // 'M' arg: new light_mode
+  EV_TIMEOUT_ADJ,  // 'T' arg: new timeout delay in minutes (signed)
+  EV_AVG_DURATION, // 'A' arg: avg_on_duration set from serial
+  EV_ROM_WRITE     // 'W' arg: 'M' - light, 'B' - button, 'R' - relay, 'D' - devices count, 'C' - config, 'Z' - zero cross, 'A' - ambient,
+                   //                'U' - usage, 'Q' - sequence
+};
+
+struct EVLOG_T
+{
+  uint8_t buf[EVLOG_SIZE];
+  uint8_t head;          // free running indexes, position in buffer is index & (EVLOG_SIZE - 1)
+  uint8_t tail;
+  uint32_t last_time;    // time of newest entry
+  uint32_t base_time;    // time of entry before tail (time deltas are counted from it)
+  uint8_t flush_pos;     // first entry not written to EEPROM yet
+  uint32_t flush_time;   // time of entry before flush_pos
+  uint32_t flushed_at;   // millis() of last flush
+  uint8_t rom_slot;      // next slot to write
+  uint8_t rom_seq;       // sequence number of next slot
+};
+
+enum TRACE_PATH
+{
+  TRACE_CLICK,  // momentary button click -> toggle light (includes waiting for double click)
+  TRACE_DOUBLE, // double click -> light mode change
+  TRACE_LOCKED, // locked button edge -> toggle light
+  TRACE_SERIAL, // serial command -> light state or mode change
+  TRACE_PATHS
+};
+
+enum CAPTURE_TYPE
+{
+  CAP_ROM,     // 'R' [address low][address high][length][bytes]: EEPROM at boot
+  CAP_PIN,     // 'P' [pin << 1 | level]: level of button pin changed
+  CAP_COMMAND, // 'C' [action][length][text]: executed command. Action is help catalog index of "C" class command
+               // which has only options, text is options JSON. CAPTURE_ANY_COMMAND - text is whole command
+  CAP_RELAY    // 'O' [mask]: relays commanded, bit n - state of relay n
+};
+
+struct CAPTURE_T
+{
+  uint8_t buf[CAPTURE_SIZE]; // entries from stream position base
+  uint16_t len;
+  uint16_t base;      // stream bytes before buf, they are in ROM
+  uint16_t saved;     // bytes of buf copied to ROM
+  uint32_t last_time; // time of newest entry
+  uint8_t pins;       // bit n - recorded level of button n
+  uint8_t pins_known; // bit n - level of button n is recorded
+  uint8_t is_full;
+};
+
+struct TRACE_T
+{
+  uint32_t start_us; // stamp of input which started traced action
+  uint8_t path;
+  uint8_t pending;   // action started and relays not written yet
+  uint16_t hist[TRACE_PATHS][TRACE_BUCKETS];
+  uint32_t max_us[TRACE_PATHS];
+};
+
+// Bump allocator over static buffer for ArduinoJson. It is reset before every command so memory never fragments.
+// Every block is preceded by its size, so the last block could be freed or grown in place
+class ArenaAllocator : public ArduinoJson::Allocator
+{
+public:
+  void *allocate(size_t size) override;
+  void deallocate(void *ptr) override;
+  void *reallocate(void *ptr, size_t new_size) override;
+  void reset(void);
+
+  uint16_t high_water; // max used bytes since boot
+  uint16_t failures;   // allocations which did not fit
+
+private:
+  uint8_t buf[JSON_ARENA_SIZE];
+  uint16_t used;
+  uint16_t last; // offset of last block payload, 0 - no blocks
+};
+
+// Devices received from serial are kept in pool until they are copied to global arrays
+struct DEV_POOL
+{
+  struct BUTTON button;
+  uint8_t is_button_used;
+  struct RELAY relay;
+  uint8_t is_relay_used;
+};
+
+enum FRAME_STATE
+{
+  FRAME_IDLE,      // waiting for first byte of line
+  FRAME_RECEIVING, // storing bytes of line
+  FRAME_SKIP_KEEP, // skipping rest of line, frame is kept to report error in order
+  FRAME_SKIP_DROP, // skipping rest of line, frame is already dropped
+  FRAME_ADDRESS    // receiving bus address of line
+};
+
+enum BUS_TARGET
+{
+  BUS_UNICAST,
+  BUS_GROUP,
+  BUS_BROADCAST
+};
+
+struct BUS_T
+{
+  uint8_t rx_kind;    // BUS_TARGET of line being received
+  uint16_t rx_target; // address or group number of line being received
+  uint8_t rx_flags;   // FRAME_BUS_* flags of line being received, set when address matched
+  uint8_t matched;    // address of current line is received and matched
+  uint8_t driver;     // driver is enabled
+};
+
+// Received lines are stored in ring one after another as frames: [length][seq][status][text][\0]
+struct CMD_QUEUE_T
+{
+  char buf[CMD_RING_SIZE];
+  uint16_t head;     // position for next byte
+  uint16_t tail;     // first byte of oldest frame
+  uint16_t used;     // occupied bytes including frame being received
+  uint16_t rx_start; // header of frame being received
+  uint16_t last_start; // header of newest complete frame
+  uint8_t rx_len;    // text length of frame being received
+  uint8_t rx_status; // one of ACK_* codes below
+  uint8_t rx_state;  // FRAME_STATE
+  uint8_t seq;       // seq for next line
+  uint8_t frames;    // complete frames waiting for execution
+  uint8_t exec_seq;  // seq of frame being executed
+  uint8_t exec_flags; // FRAME_BUS_* flags of frame being executed
+};
+#define FRAME_HEADER 3
+#define FRAME_OK 0
+#define FRAME_OVERFLOW 1
+#define FRAME_NOT_JSON 2
+#define FRAME_BUS_REPLY 0x80  // status flag: frame addressed to this node, answer is sent to bus
+#define FRAME_BUS_SILENT 0x40 // status flag: broadcast or group frame, executed without answer
+#define FRAME_BUS_MASK (FRAME_BUS_REPLY | FRAME_BUS_SILENT)
+#define FRAME_STATUS_MASK 0x03
+#define FRAME_DROPPED_UNIT 0x04 // status bits 5..2: lines dropped after frame, acknowledged right after it
+#define FRAME_DROPPED_MASK 0x3C
+
+// ArduinoJson custom reader over text of one frame in ring, so frame is parsed without copying
+struct CMD_READER
+{
+  uint16_t pos;
+  int read();
+  size_t readBytes(char *buffer, size_t length);
+};
+
+enum JOB_TYPE
+{
+  JOB_NONE,
+  JOB_CLEAR_ROM,  // writes 0 to every EEPROM byte
+  JOB_DEV_TABLE,  // writes device table image to EEPROM
+  JOB_SEQUENCE,   // writes double-click sequence image to EEPROM
+  JOB_EVLOG       // writes event log slot to EEPROM, without acknowledgement
+};
+
+// Long running command split into steps. Every step writes one EEPROM byte when EEPROM is ready, so waiting
+// for ~3.3ms write never blocks loop(). Commands are not executed until job is finished
+struct JOB_T
+{
+  uint8_t type;    // JOB_TYPE
+  uint8_t seq;     // seq of command which started job, acknowledged when job is finished
+  uint8_t bus_flags; // FRAME_BUS_* flags of command which started job
+  uint16_t address; // next address to write
+  uint16_t end;     // address after last one of current segment
+  uint16_t pos;     // bytes written, index of next image byte
+  uint16_t len;     // bytes of all segments
+  uint8_t seg;      // current segment
+  uint8_t segs;
+  uint16_t seg_start[JOB_SEGMENTS]; // ROM ranges written in order, image keeps their bytes one after another
+  uint16_t seg_len[JOB_SEGMENTS];
+  uint8_t progress; // last reported progress in percents
+  uint8_t dropped;  // lines dropped after command which started job, acknowledged after it
+  uint8_t image[JOB_IMAGE_SIZE];
+};
+
+// Waiting for second click of momentary button
+struct CLICK_T
+{
+  uint8_t is_double_click_waiting;
+  uint32_t timestamp; // time of first click
+  uint8_t button;     // button waiting for double click
+  uint32_t edge_us;   // edge stamp of first click for latency tracing
+};
+
+// Adaptive part of timeout, changed when light is turned on again soon after timeout
+struct TIMEOUT_ADJ_T
+{
+  uint8_t prev_light_state : 1;
+  uint8_t is_timeout : 1;   // if state was changed by timeout
+  int8_t timeout_delay : 6; // additional time in minutes for id->average_on_duration to produce appropriate timeout time
+  uint32_t timeout_timestamp : 32;
+};
+
+// Durations of last turns on, averaged into avg_on_duration
+struct ON_DURATIONS_T
+{
+  uint8_t durations[AVG_DURATION_ITERATION];
+  uint8_t index;
 };
 
 struct PERIPHERALS
@@ -191,84 +878,281 @@ struct PERIPHERALS
 };
 
 // Global variables:
-struct CONFIG config = {0, 0, 1};
+FW_STATE ROM_T rom; // settings memory, see STORAGE
+
+FW_STATE struct CONFIG config = {
+    0, // init_light_state
+    0, // default_light_mode
+    1, // l_button_mode
+    0, // notify
+#if BUS_MODE
+    0, // bus_address
+    0, // bus_groups
+#endif
+};
+
+FW_STATE struct BUTTON buttons[MAX_BUTTONS];
+
+FW_STATE struct RELAY relays[MAX_RELAYS];
+
+FW_STATE struct DEV_CNT_T count;
+
+FW_STATE struct M_STATE light; // need to initialize in runtime
+
+FW_STATE struct CLICK_T click;
 
-struct BUTTON buttons[MAX_BUTTONS];
+FW_STATE uint32_t boot_us; // micros() when relays got their boot state
 
-struct RELAY relays[MAX_RELAYS];
+FW_STATE struct CMD_QUEUE_T cmdq;
 
-struct DEV_CNT_T count;
+FW_STATE struct JOB_T job;
 
-struct M_STATE light; // need to initialize in runtime
+FW_STATE struct BUS_T bus;
 
-char input_buffer[JSON_BUFFER];
+FW_STATE struct ZERO_CROSS_T zc = {ZC_OFFSET_US, 0, 0, 0, {0}, 0, 0, 0, 0, 0xFFFF, 0, 0};
+
+FW_STATE struct AMBIENT_T ambient;
+
+FW_STATE struct USAGE_T usage;
+
+FW_STATE struct SEQUENCE_T sequence;
+
+FW_STATE struct NOTIFY_T notify;
+
+FW_STATE struct REGMAP_T regmap;
+
+FW_STATE struct EVLOG_T evlog;
+
+FW_STATE struct TRACE_T trace;
+
+FW_STATE struct CAPTURE_T capture;
+
+FW_STATE ArenaAllocator json_arena;
+
+FW_STATE struct DEV_POOL dev_pool;
+
+FW_STATE struct TIMEOUT_ADJ_T timeout_adj = {0, 0, 1, 0};
+
+FW_STATE struct ON_DURATIONS_T on_durations;
+
+// Globals making state of one board. Host simulator (tools/sim) saves and loads them to switch boards on thread.
+// json_arena is left out, it is reset before every command
+#define FW_STATE_LIST(X) X(rom) X(config) X(buttons) X(relays) X(count) X(light) X(click) X(boot_us) X(cmdq) X(job) \
+  X(bus) X(zc) X(ambient) X(usage) X(sequence) X(notify) X(regmap) X(evlog) X(trace) X(capture) X(dev_pool) X(timeout_adj) X(on_durations)
 
 // put function declarations here:
-int digitalReadDebounce(int pin);
+int digitalReadDebounce(BUTTON *btn);
+void debounce_init(BUTTON *btn, uint16_t debounce_us);
+void debounce_learn(BUTTON *btn, uint16_t gap_us);
+int debounce_rom(BUTTON *btn, uint8_t btn_number, char action);
 void define_new_button(BUTTON *btn);
 int handle_press_button(BUTTON *btn);
 uint8_t m_state_rom(M_STATE *id, char action);
 int button_rom(BUTTON *btn, uint8_t btn_number, char action);
 int relay_rom(RELAY *relay, uint8_t relay_number, char action);
 void watching_buttons_state_changes(M_STATE *light, BUTTON *btns, int btn_count);
+void note_button_edge(BUTTON *btn, int8_t state, uint32_t read_us);
+void check_click_timeout(M_STATE *light, uint32_t current_time);
+void momentary_button_action(M_STATE *light, BUTTON *btn, uint8_t index, uint32_t current_time);
+void locked_button_action(M_STATE *light, BUTTON *btn, int8_t state);
+void write_relays(uint8_t mask);
 uint8_t set_relay_state(RELAY *relay, uint8_t to_state);
-void handle_relays_switching(RELAY relays[], uint8_t control[]);
-uint8_t dec_to_bin_arr(uint8_t number, uint8_t *arr, uint8_t arr_size);
+void relay_mode(RELAY *relay, uint8_t mode);
+uint8_t relay_uses_pin(const RELAY *relay, uint8_t pin);
+void latch_init(void);
+void latch_pulse(RELAY *relay, uint8_t to_state);
+void latch_release(RELAY *relay);
+void latch_wait(void);
+uint8_t latch_check(const RELAY *relay);
+int latch_rom(RELAY *relay, uint8_t relay_number, char action);
+void handle_relays_switching(uint8_t mask);
 uint8_t change_light_mode(M_STATE *light, int8_t to_mode);
-int toggle_light(M_STATE *light, uint8_t state);
+int toggle_light(M_STATE *light, uint8_t state, char cause);
 void handle_switching_light(M_STATE *id);
-uint8_t read_input(char *buf, int len);
+void frame_input(void);
+void frame_drop(void);
+void execute_frame(void);
+void cmd_ack(uint8_t seq, const __FlashStringHelper *result);
+void bus_ack(uint8_t seq, const __FlashStringHelper *result, uint8_t bus_flags);
+uint8_t bus_address_byte(char byte);
+void bus_driver(uint8_t on);
 PERIPHERALS handle_input(char *input);
 uint8_t pin_to_int(const char *pin);
 int power(int x, int y);
-void handle_input_commands(char *input);
+void handle_input_commands(JsonDocument &json, uint32_t received_us);
+uint8_t add_device(char *device);
 void remove_device(uint8_t pin, const char *device);
+void handle_batch(JsonDocument &json);
+BUTTON *button_alloc(void);
+RELAY *relay_alloc(void);
+void button_release(BUTTON *btn);
+void relay_release(RELAY *relay);
+int free_ram(void);
+uint8_t json_to_pin(JsonVariant value);
 int clean_rom(void);
 int dev_count_rom(DEV_CNT_T *ctn, char action);
 int config_rom(CONFIG *cfg, char action);
+void zc_init(void);
+void zc_on_crossing(uint16_t stamp);
+void zc_watchdog(void);
+uint8_t zc_is_present(void);
+uint8_t zc_enqueue(uint8_t mask);
+int zc_rom(ZERO_CROSS_T *z, char action);
+void ambient_init(void);
+uint8_t ambient_mode(void);
+int ambient_rom(AMBIENT_T *a, char action);
+uint16_t notify_devices(void);
+void notify_check(void);
+void notify_print(void);
+void usage_cycle(uint8_t relay);
+void usage_mode(uint8_t mode);
+void usage_check(void);
+void usage_save_step(void);
+int usage_rom(USAGE_T *u, char action);
+void usage_print(void);
+void sequence_fit(void);
+uint8_t sequence_find(uint8_t mode);
+uint8_t sequence_find_name(const char *name);
+int sequence_rom(SEQUENCE_T *s, char action);
+int sequence_name_rom(uint8_t step, char *name, char action);
+void sequence_print(void);
+void regmap_init(void);
+int8_t help_find(const char *name);
+uint16_t help_print(uint16_t pos);
+void help_list(void);
+void help_command(uint8_t index);
+uint8_t regmap_read(uint8_t reg);
+void regmap_write(uint8_t reg, uint8_t value);
+void regmap_poll(void);
+uint8_t regmap_command(uint8_t command, uint8_t pin, char type);
+void evlog_append(uint8_t type, int16_t arg);
+void evlog_drop(void);
+uint32_t evlog_read_delta(const uint8_t *buf, uint8_t mask, uint8_t pos, uint8_t header);
+void evlog_print_entries(const uint8_t *buf, uint8_t mask, uint8_t from, uint8_t to, uint32_t time);
+void evlog_dump(uint8_t from_rom);
+void evlog_flush(uint8_t force);
+void evlog_rom_scan(void);
+void trace_watch_pin(uint8_t pin);
+void trace_on_pin_change(void);
+void trace_begin(uint8_t path, uint32_t start_us);
+void trace_end(void);
+void trace_dump(uint8_t reset);
+void capture_start(void);
+uint8_t capture_begin(uint8_t type, uint8_t payload);
+void capture_rom(uint16_t address, uint8_t len);
+void capture_pins(void);
+void capture_command(JsonDocument &json);
+void capture_save(void);
+uint8_t capture_byte(uint16_t pos);
+void capture_relays(uint8_t mask);
+void capture_dump(void);
+void job_start(uint8_t type);
+uint8_t *job_segment(uint16_t address, uint16_t len);
+uint8_t job_step(uint32_t budget_us);
+
+#if STATIC_CONFIG
+#include "static_devices.h"
+#include "static_config.h"
+static_assert(StaticButtons::size <= MAX_BUTTONS, "Too many static buttons");
+static_assert(StaticRelays::size <= MAX_RELAYS, "Too many static relays");
+static_assert(!CAPTURE, "Capture records buttons loaded from EEPROM, static buttons are not supported");
+#endif
+static_assert(!(REGMAP && STORAGE == STORAGE_I2C), "TWI can't be register map slave and memory master at once");
 
 void setup()
 {
   // put your setup code here, to run once:
+  // Boot order is chosen to get relays into correct state as soon as possible: devices and light state are read from ROM,
+  // output latches are preloaded while relay pins are still inputs, and only then pins become outputs.
+  // Serial, buttons and other modules are initialized after that
+  rom.begin();
+  if (CAPTURE)
+    capture_start(); // before anything is read from ROM
   // Clean ROM before start
   if (CLEAN_ROM)
   {
-    for (uint16_t i = 0; i < EEPROM.length(); i++)
+    for (uint16_t i = 0; i < rom.length(); i++)
     {
-      EEPROM.put(i, 0);
+      rom.put(i, 0);
     }
   }
-  Serial.begin(9600);
+  config_rom(&config, 'L');
+#if BUS_MODE
+  if (config.bus_address > BUS_MAX_ADDRESS)
+    config.bus_address = 0; // erased EEPROM, node waits for provisioning
+#endif
+#if STATIC_CONFIG
+  StaticRelays::init(0);
+  count.relays = StaticRelays::size;
+#else
   dev_count_rom(&count, 'L');
   uint8_t dev_count = count.relays == 0 ? MAX_RELAYS : count.relays;
-  // Serial.println(F("Loading relays..."));
   for (int i = 0; i < dev_count; i++)
   {
     uint8_t is_loaded = relay_rom(&relays[i], i, 'L');
     if (is_loaded)
-    {
-      // Serial.println(F("Relay loaded succesfully"));
-      pinMode(relays[i].pin, OUTPUT);
-      set_relay_state(&relays[i], 0);
       count.relays = i + 1;
-    }
-    else
-    {
-      // Serial.println(F("Failed to load relay config from ROM"));
-    }
   }
-  // Serial.print(F("Relays count: "));
-  // Serial.println(count.relays);
+#endif
+
+  uint8_t is_loaded = m_state_rom(&light, 'L');
+  if (!is_loaded)
+  {
+    light.light_mode = power(2, count.relays) - 1;
+    light.avg_on_duration = 0;
+  }
+  light.max_light_mode = power(2, count.relays) - 1;
+  light.timeout_cooldown = 60;
+  if (config.default_light_mode > light.max_light_mode)
+  {
+    config.default_light_mode = light.max_light_mode;
+  }
+  if (config.init_light_state != 3) // 3 - keep state loaded from ROM
+    light.light_state = config.init_light_state == 1;
+
+  uint8_t light_mode = config.default_light_mode != 0 ? config.default_light_mode : light.light_mode;
+  uint8_t boot_mask = light.light_state ? light_mode : 0;
+  if (LATCHING)
+    latch_init();
+  write_relays(boot_mask); // writing to input pin sets output latch (and pull-up), so relay does not click
+  if (CAPTURE)
+    capture_relays(boot_mask);
+  for (int i = 0; i < count.relays; i++)
+    relay_mode(&relays[i], OUTPUT);
+  light.timestamp = millis();
+  light.trigger = 0;
+  boot_us = micros();
+
+  // outputs are correct, the rest is not time critical
+  if (BUS_MODE)
+  {
+    FastPin<BUS_DE_PIN>::low(); // receiving until node is addressed
+    FastPin<BUS_DE_PIN>::output();
+  }
+  Serial.begin(9600);
+  if (!is_loaded)
+    Serial.println(F("Light config failed to load from ROM"));
+  if (EVLOG)
+  {
+    evlog_append(EV_BOOT, -1);
+    if (EVLOG_PERSIST)
+      evlog_rom_scan();
+  }
 
-  // Serial.println(F("Loading buttons..."));
+#if STATIC_CONFIG
+  StaticButtons::init(0);
+  count.buttons = StaticButtons::size;
+#else
   dev_count = count.buttons == 0 ? MAX_BUTTONS : count.buttons;
   for (int i = 0; i < dev_count; i++)
   {
     uint8_t is_loaded = button_rom(&buttons[i], i, 'L');
     if (is_loaded)
     {
-      pinMode(buttons[i].pin, INPUT_PULLUP);
-      buttons[i].last_pin_state = digitalReadDebounce(buttons[i].pin);
+      fast_mode(&buttons[i].io, INPUT_PULLUP);
+      buttons[i].last_pin_state = fast_read(&buttons[i].io); // handle_press_button() debounces following changes
+      if (TRACE && TRACE_PCINT)
+        trace_watch_pin(buttons[i].pin);
       count.buttons = i + 1;
     }
     else
@@ -277,49 +1161,85 @@ void setup()
     }
   }
   dev_count_rom(&count, 'S');
-  // Serial.print(F("Buttons count: "));
-  // Serial.println(count.buttons);
+#endif
 
-  uint8_t is_loaded = m_state_rom(&light, 'L');
-  if (!is_loaded)
+  if (ZERO_CROSS)
   {
-    Serial.println(F("Light config failed to load from ROM"));
-    light.light_state = config.init_light_state;
-    light.max_light_mode = power(2, count.relays) - 1;
-    light.light_mode = light.max_light_mode;
-    light.avg_on_duration = 0;
-    light.timeout_cooldown = 60;
+    zc_rom(&zc, 'L');
+    zc_init();
   }
-  else
+
+  if (AMBIENT)
   {
-    light.light_state = config.init_light_state; //
-    light.max_light_mode = power(2, count.relays) - 1;
-    light.timeout_cooldown = 60;
+    ambient_rom(&ambient, 'L');
+    ambient_init();
   }
 
-  config_rom(&config, 'L');
-  if (config.default_light_mode > light.max_light_mode)
+  if (USAGE)
   {
-    config.default_light_mode = light.max_light_mode;
+    usage_rom(&usage, 'L');
+    usage.tick_ms = millis();
+    usage.saved_ms = usage.tick_ms;
+  }
+
+  if (SEQUENCE)
+  {
+    sequence_rom(&sequence, 'L');
+    sequence_fit();
   }
+
+  if (REGMAP)
+    regmap_init();
 }
 
 void loop()
 {
   // put your main code here, to run repeatedly:
-
+  cycle_mark(MARK_LOOP);
+  cycle_mark(MARK_BUTTONS);
+#if STATIC_CONFIG
+  uint32_t current_time = millis();
+  check_click_timeout(&light, current_time);
+  StaticButtons::scan(&light, 0, current_time);
+#else
+  if (CAPTURE)
+  {
+    capture_pins();
+    capture_save();
+  }
   for (int i = 0; i < count.buttons; i++)
     handle_press_button(&buttons[i]);
 
   watching_buttons_state_changes(&light, buttons, count.buttons);
+#endif
+  cycle_mark(MARK_BUTTONS | MARK_END);
+  cycle_mark(MARK_LIGHT);
   handle_switching_light(&light);
-  uint8_t new_data = read_input(input_buffer, JSON_BUFFER);
-
-  if (new_data)
+  cycle_mark(MARK_LIGHT | MARK_END);
+  if (ZERO_CROSS)
+    zc_watchdog();
+  if (EVLOG && EVLOG_PERSIST && job.type == JOB_NONE)
+    evlog_flush(0);
+  rom.flush(); // batched writes of external memory
+  cycle_mark(MARK_FRAME_INPUT);
+  frame_input();
+  cycle_mark(MARK_FRAME_INPUT | MARK_END);
+  uint32_t tick_start = micros();
+  if (job.type != JOB_NONE)
   {
-    handle_input_commands(input_buffer);
-    new_data = 0;
+    cycle_mark(MARK_JOB);
+    job_step(TICK_BUDGET_US);
+    cycle_mark(MARK_JOB | MARK_END);
   }
+  for (uint8_t i = 0; i < CMD_PER_TICK && cmdq.frames && job.type == JOB_NONE && micros() - tick_start < TICK_BUDGET_US; i++)
+    execute_frame();
+  if (REGMAP)
+    regmap_poll();
+  if (USAGE)
+    usage_check();
+  if (NOTIFY)
+    notify_check();
+  cycle_mark(MARK_LOOP | MARK_END);
 }
 // put function definitions here:
 void define_new_button(BUTTON *btn)
@@ -332,8 +1252,13 @@ void define_new_button(BUTTON *btn)
   if (btn->pin < START_BTN_PIN || btn->pin > END_BTN_PIN)
     return;
 
-  pinMode(btn->pin, INPUT_PULLUP);
-  int current_signal_state = digitalReadDebounce(btn->pin);
+  btn->trace_us = 0;
+  btn->edge_us = 0;
+  fast_pin_init(&btn->io, btn->pin);
+  fast_mode(&btn->io, INPUT_PULLUP);
+  debounce_init(btn, DEBOUNCE_DEFAULT_US);
+  btn->last_pin_state = fast_read(&btn->io);
+  int current_signal_state = digitalReadDebounce(btn);
   int btn_prev_state = current_signal_state;
 
   // Debug purpose
@@ -347,10 +1272,12 @@ void define_new_button(BUTTON *btn)
   }
   //
 
+  bus_driver(0); // waiting for press may take long, other nodes can use bus meanwhile
   while (btn->is_defined != 1)
   {
     // need insert periodicaly changing pinMode between INPUT and INPUT_PULLUP to recognize LOW and HIGH buttons
-    current_signal_state = digitalReadDebounce(btn->pin);
+    current_signal_state = digitalReadDebounce(btn);
+    btn->last_pin_state = current_signal_state;
     current_time = millis();
     if (current_signal_state != btn_prev_state)
     {
@@ -376,12 +1303,14 @@ void define_new_button(BUTTON *btn)
       }
     }
   }
+  bus_driver(cmdq.exec_flags & FRAME_BUS_REPLY);
 }
 
 int handle_press_button(BUTTON *btn)
 {
   // this function handle presses on buttons and write this data to button struct
-  uint8_t current_signal = digitalReadDebounce(btn->pin);
+  uint32_t read_us = TRACE ? micros() : 0;
+  uint8_t current_signal = digitalReadDebounce(btn);
   uint8_t last_signal = btn->last_pin_state;
   uint8_t front = btn->front;
   int8_t state = 0;
@@ -422,70 +1351,131 @@ int handle_press_button(BUTTON *btn)
   {
     state = 0;
   }
+  note_button_edge(btn, state, read_us);
   btn->last_pin_state = current_signal;
   btn->state = state;
+  if (DEBOUNCE_ADAPTIVE && btn->learned >= DEBOUNCE_SAVE_EDGES)
+  {
+    btn->learned = 0;
+    debounce_rom(btn, btn - buttons, 'S');
+  }
   return btn->state;
 }
 
+void note_button_edge(BUTTON *btn, int8_t state, uint32_t read_us)
+{
+  // Stamps edge for latency tracing and saves it to event log. read_us - time when pin reading started
+  if (TRACE)
+  {
+    // edge stamp from interrupt is more precise than time of reading pin
+    uint32_t edge_us;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      edge_us = btn->trace_us;
+      if (state != 0 || (edge_us != 0 && read_us - edge_us > TRACE_STALE_US))
+        btn->trace_us = 0;
+    }
+    if (state != 0)
+      btn->edge_us = edge_us != 0 ? edge_us : read_us;
+  }
+  if (EVLOG && state != 0)
+    evlog_append(EV_BTN_EDGE, (uint8_t)((btn - buttons) << 1) | (state == 1));
+}
+
 void watching_buttons_state_changes(M_STATE *light, BUTTON *btns, int btn_count)
 {
   // This function watching for changing states of buttons and triggers nessesary functions or states of objects
   uint32_t current_time = millis();
-  static uint8_t is_double_click_waiting = 0;
-  static uint32_t timestamp;
 
-  if (is_double_click_waiting == 1 && current_time - timestamp > DOUBLE_CLICK_TIME)
-  {
-    is_double_click_waiting = 0;
-    timestamp = 0;
-    toggle_light(light, !light->light_state);
-  }
+  check_click_timeout(light, current_time);
 
   for (int i = 0; i < btn_count; i++)
   {
     int8_t state = btns[i].state;
     int8_t type = btns[i].type;
 
-    if (state == 1)
+    if (type == 'M')
     {
-      if (type == 'M')
-      {
-        if (is_double_click_waiting == 1)
-        {
-          is_double_click_waiting = 0;
-          timestamp = 0;
-          change_light_mode(light, -1);
+      if (state == 1)
+        momentary_button_action(light, &btns[i], i, current_time);
+    }
+    else if (type == 'L') // Locked button can not perform double clicks
+    {
+      if (state != 0)
+        locked_button_action(light, &btns[i], state);
+    }
+  }
+}
 
-          // when light_mode changed during light is turned off need to light turn on
-          if (light->light_state == 0)
-            toggle_light(light, !light->light_state);
-        }
-        else
-        {
-          is_double_click_waiting = 1;
-          timestamp = current_time;
-        }
-      }
-      else if (type == 'L') // Locked button can not perform double clicks
+void check_click_timeout(M_STATE *light, uint32_t current_time)
+{
+  // When second click didn't come during DOUBLE_CLICK_TIME it was single click
+  if (click.is_double_click_waiting == 1 && current_time - click.timestamp > DOUBLE_CLICK_TIME)
+  {
+    click.is_double_click_waiting = 0;
+    click.timestamp = 0;
+    if (EVLOG)
+      evlog_append(EV_CLICK, click.button);
+    if (TRACE)
+      trace_begin(TRACE_CLICK, click.edge_us);
+    toggle_light(light, !light->light_state, 'B');
+  }
+}
+
+void momentary_button_action(M_STATE *light, BUTTON *btn, uint8_t index, uint32_t current_time)
+{
+  // Called when momentary button is pressed. Second press during DOUBLE_CLICK_TIME changes light mode
+  if (click.is_double_click_waiting == 1)
+  {
+    click.is_double_click_waiting = 0;
+    click.timestamp = 0;
+    if (EVLOG)
+      evlog_append(EV_DOUBLE_CLICK, index);
+    if (TRACE)
+      trace_begin(TRACE_DOUBLE, btn->edge_us);
+    change_light_mode(light, -1);
+
+    // when light_mode changed during light is turned off need to light turn on
+    if (light->light_state == 0)
+      toggle_light(light, !light->light_state, 'B');
+  }
+  else
+  {
+    click.is_double_click_waiting = 1;
+    click.timestamp = current_time;
+    click.button = index;
+    click.edge_us = btn->edge_us;
+  }
+}
+
+void locked_button_action(M_STATE *light, BUTTON *btn, int8_t state)
+{
+  // Called on both edges of locked button: state 1 - pressed, -1 - released
+  if (state == 1)
+  {
+    if (config.l_button_mode == 0)
+    {
+      if (light->light_state != 1)
       {
-        if (config.l_button_mode == 0)
-        {
-          if (light->light_state != 1)
-            toggle_light(light, !light->light_state);
-        }
-        else if (config.l_button_mode == 1)
-        {
-          toggle_light(light, !light->light_state);
-        }
+        if (TRACE)
+          trace_begin(TRACE_LOCKED, btn->edge_us);
+        toggle_light(light, !light->light_state, 'B');
       }
     }
-    else if (state == -1)
+    else if (config.l_button_mode == 1)
     {
-      if (type == 'L')
-      {
-        if (config.l_button_mode || light->light_state)
-          toggle_light(light, !light->light_state);
-      }
+      if (TRACE)
+        trace_begin(TRACE_LOCKED, btn->edge_us);
+      toggle_light(light, !light->light_state, 'B');
+    }
+  }
+  else if (state == -1)
+  {
+    if (config.l_button_mode || light->light_state)
+    {
+      if (TRACE)
+        trace_begin(TRACE_LOCKED, btn->edge_us);
+      toggle_light(light, !light->light_state, 'B');
     }
   }
 }
@@ -493,16 +1483,18 @@ void watching_buttons_state_changes(M_STATE *light, BUTTON *btns, int btn_count)
 uint8_t set_relay_state(RELAY *relay, uint8_t to_state)
 {
   // Function take relay pointer and change state to on(1) or off(0)
+  if (USAGE && to_state == 1 && relay->state != 1)
+    usage_cycle(relay - relays);
   if (relay->type == 'H')
   {
     if (to_state == 1)
     {
-      digitalWrite(relay->pin, HIGH);
+      fast_write(&relay->io, HIGH);
       relay->state = to_state;
     }
     else if (to_state == 0)
     {
-      digitalWrite(relay->pin, LOW);
+      fast_write(&relay->io, LOW);
       relay->state = to_state;
     }
   }
@@ -510,15 +1502,21 @@ uint8_t set_relay_state(RELAY *relay, uint8_t to_state)
   {
     if (to_state == 1)
     {
-      digitalWrite(relay->pin, LOW);
+      fast_write(&relay->io, LOW);
       relay->state = to_state;
     }
     else if (to_state == 0)
     {
-      digitalWrite(relay->pin, HIGH);
+      fast_write(&relay->io, HIGH);
       relay->state = to_state;
     }
   }
+  else if (LATCHING && relay->type == 'P')
+  {
+    // contacts stay where last pulse left them, so only change of state costs coil current
+    if (to_state <= 1 && to_state != relay->state)
+      latch_pulse(relay, to_state);
+  }
   else
   {
     relay->state = 0;
@@ -526,49 +1524,57 @@ uint8_t set_relay_state(RELAY *relay, uint8_t to_state)
   return relay->state;
 }
 
-void handle_relays_switching(RELAY relays[], uint8_t control[])
+void relay_mode(RELAY *relay, uint8_t mode)
 {
-  // Function iterates throug relays array and swiched state according control byte
-
-  // check if control have valid values (0 or 1)
-
-  for (int i = 0; i < count.relays; i++)
+  // Makes pins of relay outputs or releases them. Released coils of latching relay are not left energized
+  if (relay->type == 'P')
   {
-    if (control[i] > 1)
-      continue;
-    set_relay_state(&relays[i], control[i]);
+    if (mode != OUTPUT)
+      latch_release(relay);
+    fast_mode(&relay->reset_io, mode);
   }
+  fast_mode(&relay->io, mode);
 }
 
-uint8_t dec_to_bin_arr(uint8_t number, uint8_t *arr, uint8_t arr_size)
+uint8_t relay_uses_pin(const RELAY *relay, uint8_t pin)
 {
-  // function convert number (represent light_mode) to array of 0 and 1 to control array of relays with this array. Nuber represent byte, every bit in this byte meaning relay state need to set up so it convert dec number to binary representation
-  int dividend = number;
-  for (int i = 0; i < arr_size; i++)
-  {
-    arr[i] = dividend % 2;
-    dividend = dividend / 2;
-  }
-  return 1;
+  return relay->pin == pin || (relay->type == 'P' && relay->reset_pin == pin);
+}
+
+void handle_relays_switching(uint8_t mask)
+{
+  // Switches relays according to mask: bit n - state of relay n. Light mode is such mask, so it is passed as is
+  if (CAPTURE)
+    capture_relays(mask);
+
+  // relays are switched from Timer1 interrupt at configured offset after next zero crossing
+  if (ZERO_CROSS && zc_is_present() && zc_enqueue(mask))
+    return;
+
+  write_relays(mask);
+  if (TRACE)
+    trace_end();
+}
+
+void write_relays(uint8_t mask)
+{
+  // Sets every relay according to mask: bit n - state of relay n
+#if STATIC_CONFIG
+  StaticRelays::write(mask, 0);
+#else
+  for (int i = 0; i < count.relays; i++)
+    set_relay_state(&relays[i], (mask >> i) & 1);
+#endif
 }
 
 void handle_switching_light(M_STATE *id)
 {
-  struct light_state
-  {
-    uint8_t prev_light_state : 1;
-    uint8_t is_timeout : 1;   // if state was changed by timeout
-    int8_t timeout_delay : 6; // additional time in minutes for id->average_on_duration to produce appropriate timeout time
-    uint32_t timeout_timestamp : 32;
-  };
   uint32_t current_time = millis();
-  static struct light_state conf = {0, 0, 1, 0};
-  uint32_t timeout_ms = (uint32_t)(id->avg_on_duration + conf.timeout_delay) * 60U * 1000U;
-  uint8_t arr[count.relays];
+  uint32_t timeout_ms = (uint32_t)(id->avg_on_duration + timeout_adj.timeout_delay) * 60U * 1000U;
 
   if (timeout_ms < (uint32_t)MIN_TIMEOUT * 60U * 1000U) // Set min amount of timeout
   {
-    timeout_ms = (uint32_t)((MIN_TIMEOUT + conf.timeout_delay) * 60U * 1000U);
+    timeout_ms = (uint32_t)((MIN_TIMEOUT + timeout_adj.timeout_delay) * 60U * 1000U);
     timeout_ms = timeout_ms < (uint32_t)(MIN_TIMEOUT * 60U * 1000U) ? (uint32_t)(MIN_TIMEOUT * 60U * 1000U) : timeout_ms;
     id->timeout = (uint8_t)(timeout_ms / (uint32_t)(1000U * 60U));
   }
@@ -580,45 +1586,48 @@ void handle_switching_light(M_STATE *id)
   // handling timeout
   if (current_time - id->timestamp > timeout_ms && id->light_state == 1 && id->avg_on_duration != 0)
   {
-    toggle_light(id, 0);
-    conf.is_timeout = 1;
-    conf.timeout_timestamp = current_time;
+    toggle_light(id, 0, 'T');
+    timeout_adj.is_timeout = 1;
+    timeout_adj.timeout_timestamp = current_time;
   }
 
   if (id->trigger)
   {
     if (id->light_state == 0)
     {
-      uint8_t result = dec_to_bin_arr(0, arr, count.relays);
-      if (result)
-        handle_relays_switching(relays, arr);
+      handle_relays_switching(0);
+      if (USAGE)
+        usage_mode(0);
 
       id->trigger = 0;
     }
     else if (id->light_state == 1)
     {
       uint8_t light_mode = id->light_mode;
-      // implementation to turn on light with config light_mode
-      if (config.default_light_mode != 0 && config.default_light_mode <= id->max_light_mode && conf.prev_light_state != 1)
-        light_mode = config.default_light_mode;
+      // implementation to turn on light with config light_mode (or mode of ambient level)
+      uint8_t on_mode = ambient_mode();
+      if (on_mode != 0 && on_mode <= id->max_light_mode && timeout_adj.prev_light_state != 1)
+        light_mode = on_mode;
 
-      uint8_t result = dec_to_bin_arr(light_mode, arr, count.relays);
-      if (result)
-        handle_relays_switching(relays, arr);
+      handle_relays_switching(light_mode);
+      if (USAGE)
+        usage_mode(light_mode);
 
-      if (conf.is_timeout)
+      if (timeout_adj.is_timeout)
       {
         uint32_t t = (uint32_t)id->timeout_cooldown * 1000U;
-        int8_t td = conf.timeout_delay;
+        int8_t td = timeout_adj.timeout_delay;
         uint8_t abs_td = abs(td);
-        if (current_time - conf.timeout_timestamp < t)
+        if (current_time - timeout_adj.timeout_timestamp < t)
         {
           int8_t delay = td > 0 ? (td + abs_td) : (td + abs_td / 2);
 
           delay = delay > 31 ? 31 : delay;
           delay = delay == -1 ? 1 : delay;
-          conf.timeout_delay = delay;
-          conf.is_timeout = 0;
+          timeout_adj.timeout_delay = delay;
+          timeout_adj.is_timeout = 0;
+          if (EVLOG)
+            evlog_append(EV_TIMEOUT_ADJ, (uint8_t)delay);
         }
         else
         {
@@ -626,14 +1635,16 @@ void handle_switching_light(M_STATE *id)
 
           delay = delay < -31 ? -31 : delay;
           delay = delay == 1 ? -1 : delay;
-          conf.timeout_delay = delay;
-          conf.is_timeout = 0;
+          timeout_adj.timeout_delay = delay;
+          timeout_adj.is_timeout = 0;
+          if (EVLOG)
+            evlog_append(EV_TIMEOUT_ADJ, (uint8_t)delay);
         }
       }
       id->trigger = 0;
     }
   }
-  conf.prev_light_state = id->light_state;
+  timeout_adj.prev_light_state = id->light_state;
 
   return;
 }
@@ -642,6 +1653,7 @@ uint8_t change_light_mode(M_STATE *light, int8_t to_mode)
 {
 
   uint8_t max_light_mode = light->max_light_mode;
+  uint8_t prev_light_mode = light->light_mode;
 
   if (max_light_mode == 0 && count.relays != 0)
     max_light_mode = power(2, count.relays) - 1;
@@ -649,13 +1661,27 @@ uint8_t change_light_mode(M_STATE *light, int8_t to_mode)
   if (to_mode > 0 && to_mode <= max_light_mode)
   {
     light->light_mode = to_mode;
+    if (SEQUENCE)
+      sequence.step = sequence_find(to_mode);
+    if (EVLOG && light->light_mode != prev_light_mode)
+      evlog_append(EV_MODE, light->light_mode);
     m_state_rom(light, 'S');
     light->trigger = 1;
     return 1;
   }
   else if (to_mode == -1)
   {
-    light->light_mode = light->light_mode > 1 ? light->light_mode - 1 : max_light_mode;
+    if (SEQUENCE && sequence.steps != 0)
+    {
+      sequence.step = sequence.step + 1 < sequence.steps ? sequence.step + 1 : 0;
+      light->light_mode = sequence.modes[sequence.step];
+    }
+    else
+    {
+      light->light_mode = light->light_mode > 1 ? light->light_mode - 1 : max_light_mode;
+    }
+    if (EVLOG && light->light_mode != prev_light_mode)
+      evlog_append(EV_MODE, light->light_mode);
     m_state_rom(light, 'S');
     light->trigger = 1;
     return 1;
@@ -663,6 +1689,8 @@ uint8_t change_light_mode(M_STATE *light, int8_t to_mode)
   else
   {
     light->light_mode = light->light_mode > max_light_mode ? max_light_mode : light->light_mode;
+    if (EVLOG && light->light_mode != prev_light_mode)
+      evlog_append(EV_MODE, light->light_mode);
     m_state_rom(light, 'S');
     light->trigger = 1;
     return 0;
@@ -671,11 +1699,16 @@ uint8_t change_light_mode(M_STATE *light, int8_t to_mode)
   return 0;
 }
 
-int toggle_light(M_STATE *light, uint8_t state)
+int toggle_light(M_STATE *light, uint8_t state, char cause)
 {
+  // cause is saved to event log: 'B' - button, 'T' - timeout, 'S' - serial command, 'I' - register map
   uint32_t current_time = millis();
-  static uint8_t durations[AVG_DURATION_ITERATION];
-  static uint8_t index = 0;
+
+  if (state == 1 && cause == 'B' && ambient_mode() == AMBIENT_STAY_OFF)
+    return 255; // daylight: press is ignored
+
+  if (EVLOG && state <= 1)
+    evlog_append(EV_LIGHT, (state << 7) | cause);
 
   if (light->avg_on_duration == 0 && light->timestamp != 0) // during first light on defining first avg_on_duration
   {
@@ -692,21 +1725,23 @@ int toggle_light(M_STATE *light, uint8_t state)
     uint8_t duration = (current_time - light->timestamp) / (1000U * 60U);
     if (duration > MIN_COUNTABLE_DURATION) // to avoiding impact short switches to average duration
     {
-      durations[index] = duration;
-      index++;
+      on_durations.durations[on_durations.index] = duration;
+      on_durations.index++;
     }
-    if (index >= AVG_DURATION_ITERATION)
+    if (on_durations.index >= AVG_DURATION_ITERATION)
     {
       uint16_t summ = 0;
       for (uint8_t i = 0; i < AVG_DURATION_ITERATION; i++)
-        summ += durations[i];
+        summ += on_durations.durations[i];
       light->avg_on_duration = (uint8_t)((uint16_t)(light->avg_on_duration + summ) / (uint16_t)(AVG_DURATION_ITERATION + 1));
-      index = 0;
+      on_durations.index = 0;
     }
 
     light->light_state = state;
     light->timestamp = current_time;
     light->trigger = 1;
+    if (config.init_light_state == 3)
+      m_state_rom(light, 'S');
 
     return 0;
   }
@@ -715,6 +1750,8 @@ int toggle_light(M_STATE *light, uint8_t state)
     light->light_state = state;
     light->timestamp = current_time;
     light->trigger = 1;
+    if (config.init_light_state == 3)
+      m_state_rom(light, 'S');
 
     return 1;
   }
@@ -722,53 +1759,124 @@ int toggle_light(M_STATE *light, uint8_t state)
   return 255;
 }
 
-int digitalReadDebounce(int pin)
+int digitalReadDebounce(BUTTON *btn)
 {
-  uint8_t bounce_time = 5;
-  unsigned long start = millis();
-  unsigned long current_time = start;
-  int counter = 0;
-  int pin_state_accumulator = digitalRead(pin); // pin is pulled up;
-  while (current_time - start < bounce_time)
+  // Returns level accepted by debounce, see DEBOUNCE_ADAPTIVE. btn->last_pin_state is level accepted before
+  uint8_t level = fast_read(&btn->io); // pin is pulled up;
+  if (level == btn->last_pin_state)
+    return level;
+
+  uint32_t start = micros();
+  uint32_t now = start;
+  uint32_t change_us = start; // last change of level
+  uint32_t gap_us = 0;        // longest time level was kept before it changed
+  while (now - change_us < btn->debounce_us && now - start < DEBOUNCE_READ_MAX_US)
   {
-    counter++;
-    pin_state_accumulator += digitalRead(pin);
-    current_time = millis();
+    frame_input(); // time of waiting is used for serial receiving, job is left to loop() so samples stay dense
+    uint8_t sample = fast_read(&btn->io);
+    now = micros();
+    if (sample != level)
+    {
+      gap_us = now - change_us > gap_us ? now - change_us : gap_us;
+      level = sample;
+      change_us = now;
+    }
   }
 
-  return pin_state_accumulator / counter;
+  uint8_t is_bounce = start - btn->settled_us < DEBOUNCE_MAX_US; // previous edge is still bouncing
+  if (is_bounce && start - btn->settled_us > gap_us)
+    gap_us = start - btn->settled_us;
+  if (DEBOUNCE_ADAPTIVE && (is_bounce || level != btn->last_pin_state))
+    debounce_learn(btn, gap_us);
+  if (level != btn->last_pin_state)
+    btn->settled_us = change_us;
+  return level;
 }
 
-uint8_t m_state_rom(M_STATE *id, char action)
+void debounce_init(BUTTON *btn, uint16_t debounce_us)
 {
-  // Need to verify saving and loaded data
-  int address_offset_duration = M_STATE_OFFSET;
-  int address_offset_mode = address_offset_duration + sizeof(id->avg_on_duration);
-  uint8_t max_mode = power(2, count.relays) - 1;
+  // Estimator starts from debounce_us: mean 0 and deviation of quarter
+  btn->debounce_us = debounce_us;
+  btn->gap_avg_us = 0;
+  btn->gap_dev_us = debounce_us / 4;
+  btn->settled_us = micros() - DEBOUNCE_MAX_US;
+  btn->learned = 0;
+}
+
+void debounce_learn(BUTTON *btn, uint16_t gap_us)
+{
+  int32_t error = (int32_t)gap_us - btn->gap_avg_us;
+  btn->gap_avg_us += error / 8;
+  btn->gap_dev_us += ((error < 0 ? -error : error) - btn->gap_dev_us) / 4;
+  uint32_t debounce_us = btn->gap_avg_us + 4UL * btn->gap_dev_us;
+  debounce_us = debounce_us < DEBOUNCE_MIN_US ? DEBOUNCE_MIN_US : debounce_us;
+  btn->debounce_us = debounce_us > DEBOUNCE_MAX_US ? DEBOUNCE_MAX_US : debounce_us;
+  if (btn->learned < 255)
+    btn->learned++;
+}
+
+int debounce_rom(BUTTON *btn, uint8_t btn_number, char action)
+{
+  // Learned interval is kept apart from button table, which has 3 bytes per button
+  uint16_t address = DEBOUNCE_OFFSET + btn_number;
+
   if (action == 'S')
   {
-    if (id->avg_on_duration != EEPROM.put(address_offset_duration, id->avg_on_duration))
-      return 0;
-    if (id->light_mode != EEPROM.put(address_offset_mode, id->light_mode))
-      return 0;
-
+    rom.put(address, (uint8_t)(btn->debounce_us / DEBOUNCE_UNIT_US));
     return 1;
   }
   else if (action == 'L')
-  /* Need to check loaded data*/
   {
-    // EEPROM.get(address_offset_state, id->light_state);
-    // id->light_state = 0; // set light off when boot
-    EEPROM.get(address_offset_duration, id->avg_on_duration);
-    EEPROM.get(address_offset_mode, id->light_mode);
-    if (id->light_mode < 1 || id->light_mode > max_mode)
-      id->light_mode = max_mode;
-
+    uint16_t debounce_us = rom.read(address) * DEBOUNCE_UNIT_US;
+    if (!DEBOUNCE_ADAPTIVE || debounce_us < DEBOUNCE_MIN_US || debounce_us > DEBOUNCE_MAX_US)
+      debounce_us = DEBOUNCE_DEFAULT_US; // erased or never learned
+    debounce_init(btn, debounce_us);
     return 1;
   }
-  return 0;
-}
-
+  else if (action == 'E')
+  {
+    rom.put(address, (uint8_t)0);
+    return 1;
+  }
+  return 0;
+}
+
+uint8_t m_state_rom(M_STATE *id, char action)
+{
+  // Need to verify saving and loaded data
+  int address_offset_duration = M_STATE_OFFSET;
+  int address_offset_mode = address_offset_duration + sizeof(id->avg_on_duration);
+  uint8_t max_mode = power(2, count.relays) - 1;
+  if (action == 'S')
+  {
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'M');
+    if (id->avg_on_duration != rom.put(address_offset_duration, id->avg_on_duration))
+      return 0;
+    if (id->light_mode != rom.put(address_offset_mode, id->light_mode))
+      return 0;
+    // light state is written on every toggle, so it is kept only when needed. rom.put skips unchanged bytes
+    if (config.init_light_state == 3 && id->light_state != rom.put(LIGHT_STATE_OFFSET, id->light_state))
+      return 0;
+
+    return 1;
+  }
+  else if (action == 'L')
+  /* Need to check loaded data*/
+  {
+    rom.get(LIGHT_STATE_OFFSET, id->light_state);
+    if (id->light_state > 1)
+      id->light_state = 0;
+    rom.get(address_offset_duration, id->avg_on_duration);
+    rom.get(address_offset_mode, id->light_mode);
+    if (id->light_mode < 1 || id->light_mode > max_mode)
+      id->light_mode = max_mode;
+
+    return 1;
+  }
+  return 0;
+}
+
 int button_rom(BUTTON *btn, uint8_t btn_number, char action)
 {
   // Function save or load button state from EEPROM. action has 2 options: 'S' - save, 'L' - load
@@ -794,24 +1902,26 @@ int button_rom(BUTTON *btn, uint8_t btn_number, char action)
     if (btn->type != 'L' && btn->type != 'M')
       return 0;
 
-    if (btn->pin != EEPROM.put(pin_offset, btn->pin))
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'B');
+    if (btn->pin != rom.put(pin_offset, btn->pin))
       return 0;
 
-    if (btn->type != EEPROM.put(type_offset, btn->type))
+    if (btn->type != rom.put(type_offset, btn->type))
       return 0;
 
-    if (btn->front != EEPROM.put(front_offset, btn->front))
+    if (btn->front != rom.put(front_offset, btn->front))
       return 0;
 
-    return 1;
+    return debounce_rom(btn, btn_number, 'S');
   }
   else if (action == 'L') // Load buttons from EEPROM
   {
     // Serial.println(F("Button loading..."));
     BUTTON backup;
-    EEPROM.get(pin_offset, backup.pin);
-    EEPROM.get(type_offset, backup.type);
-    EEPROM.get(front_offset, backup.front);
+    rom.get(pin_offset, backup.pin);
+    rom.get(type_offset, backup.type);
+    rom.get(front_offset, backup.front);
     if (backup.pin > END_BTN_PIN || backup.pin < START_BTN_PIN)
     {
       return 0;
@@ -829,15 +1939,22 @@ int button_rom(BUTTON *btn, uint8_t btn_number, char action)
     backup.last_pin_state = !backup.front;
     backup.current_state_time = millis();
     backup.last_state_time = 0;
+    backup.trace_us = 0;
+    backup.edge_us = 0;
+    fast_pin_init(&backup.io, backup.pin);
+    debounce_rom(&backup, btn_number, 'L');
     *btn = backup;
     return 1;
   }
   else if (action == 'E') // Erase buttom from EEPROM
   {
     uint8_t result = 1;
-    result = result && !EEPROM.put(pin_offset, 0);
-    result = result && !EEPROM.put(type_offset, 0);
-    result = result && !EEPROM.put(front_offset, 0);
+    result = result && !rom.put(pin_offset, 0);
+    result = result && !rom.put(type_offset, 0);
+    result = result && !rom.put(front_offset, 0);
+    debounce_rom(btn, btn_number, 'E');
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'B');
     return result;
   }
   return 0;
@@ -856,12 +1973,16 @@ int relay_rom(RELAY *relay, uint8_t relay_number, char action) // Function save
     // Serial.println(F("Saving relay..."));
     if (relay->pin < START_REL_PIN || relay->pin > END_REL_PIN)
       return 0;
-    if (relay->type != 'H' && relay->type != 'L')
+    if (relay->type != 'H' && relay->type != 'L' && !(LATCHING && relay->type == 'P' && latch_check(relay)))
       return 0;
-    if (relay->pin != EEPROM.put(pin_offset, relay->pin))
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'R');
+    if (relay->pin != rom.put(pin_offset, relay->pin))
       return 0;
-    if (relay->type != EEPROM.put(type_offset, relay->type))
+    if (relay->type != rom.put(type_offset, relay->type))
       return 0;
+    if (relay->type == 'P')
+      return latch_rom(relay, relay_number, 'S');
 
     return 1;
   }
@@ -869,14 +1990,24 @@ int relay_rom(RELAY *relay, uint8_t relay_number, char action) // Function save
   {
     // Serial.println(F("Loading relay..."));
     RELAY temp_rel;
-    EEPROM.get(pin_offset, temp_rel.pin);
-    EEPROM.get(type_offset, temp_rel.type);
+    rom.get(pin_offset, temp_rel.pin);
+    rom.get(type_offset, temp_rel.type);
 
     temp_rel.state = 0;
+    temp_rel.pulse_left = 0;
     if (temp_rel.pin < START_REL_PIN || temp_rel.pin > END_REL_PIN)
       return 0;
-    if (temp_rel.type != 'H' && temp_rel.type != 'L')
+    if (temp_rel.type == 'P' && LATCHING)
+    {
+      temp_rel.state = RELAY_STATE_UNKNOWN;
+      if (!latch_rom(&temp_rel, relay_number, 'L'))
+        return 0;
+    }
+    else if (temp_rel.type != 'H' && temp_rel.type != 'L')
+    {
       return 0;
+    }
+    fast_pin_init(&temp_rel.io, temp_rel.pin);
     *relay = temp_rel;
 
     return 1;
@@ -884,59 +2015,308 @@ int relay_rom(RELAY *relay, uint8_t relay_number, char action) // Function save
   else if (action == 'E')
   {
     uint8_t result = 1;
-    result = result && !EEPROM.put(pin_offset, 0);
-    result = result && !EEPROM.put(type_offset, 0);
+    result = result && !rom.put(pin_offset, 0);
+    result = result && !rom.put(type_offset, 0);
+    if (LATCHING)
+      latch_rom(relay, relay_number, 'E');
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'R');
     return result;
   }
   return 0;
 }
 
-uint8_t read_input(char *buf, int len)
+void frame_input(void)
 {
-  // Function read data from serial to array and emits 0 if data still not finish or nothing and 1 when receiving data finish
-  static uint8_t ndx = 0;
-  static uint8_t receiving = 0;
-  char starting_byte = '{'; // receiving only json formated string started from { and ending with \n
-  char finish_byte = '\n';
-  char byte;
-
+  // Function moves bytes from serial to command ring and splits them to frames by new line.
+  // Every line gets seq number and later exactly one acknowledgement, so host could send commands without waiting
   while (Serial.available() > 0)
   {
-    byte = Serial.read();
-    if (ndx >= len)
+    char byte = Serial.read();
+    if (byte == '\r')
+      continue;
+
+    if (cmdq.rx_state == FRAME_ADDRESS)
     {
-      ndx = len - 1;
+      if (byte == '\n')
+        cmdq.rx_state = FRAME_IDLE;
+      else if (!bus_address_byte(byte))
+        cmdq.rx_state = FRAME_SKIP_DROP; // malformed or not for this node
+      continue;
     }
-    if (receiving)
+
+    if (cmdq.rx_state == FRAME_IDLE)
     {
-      if (byte != finish_byte)
+      if (byte == '\n')
+        bus.matched = 0;
+      if (byte == ' ' || byte == '\t' || byte == '\n')
+        continue;
+#if BUS_MODE
+      if (config.bus_address != 0 && !bus.matched)
       {
-        buf[ndx] = byte;
-        ndx++;
+        // line must start with address
+        cmdq.rx_state = byte == '>' ? FRAME_ADDRESS : FRAME_SKIP_DROP;
+        bus.rx_kind = BUS_UNICAST;
+        bus.rx_target = 0;
+        continue;
+      }
+      if (!bus.matched)
+        bus.rx_flags = 0;
+#endif
+      if (CMD_RING_SIZE - cmdq.used < FRAME_HEADER + 2)
+      {
+        frame_drop();
+        cmdq.rx_state = FRAME_SKIP_DROP;
+        continue;
       }
-      else if (byte == finish_byte)
+      cmdq.rx_start = cmdq.head;
+      cmdq.rx_len = 0;
+      cmdq.rx_status = byte == '{' ? FRAME_OK : FRAME_NOT_JSON;
+      cmdq.rx_state = byte == '{' ? FRAME_RECEIVING : FRAME_SKIP_KEEP;
+      cmdq.head = (cmdq.head + FRAME_HEADER) % CMD_RING_SIZE;
+      cmdq.used += FRAME_HEADER;
+    }
+
+    if (byte == '\n')
+    {
+      if (cmdq.rx_state != FRAME_SKIP_DROP)
       {
-        buf[ndx] = '\0';
-        receiving = 0;
-        ndx = 0;
-        return 1;
+        cmdq.buf[cmdq.rx_start] = cmdq.rx_len;
+        cmdq.buf[(cmdq.rx_start + 1) % CMD_RING_SIZE] = cmdq.seq;
+        cmdq.buf[(cmdq.rx_start + 2) % CMD_RING_SIZE] = cmdq.rx_status | bus.rx_flags;
+        cmdq.buf[cmdq.head] = '\0';
+        cmdq.head = (cmdq.head + 1) % CMD_RING_SIZE;
+        cmdq.used++;
+        cmdq.frames++;
+        cmdq.seq++;
+        cmdq.last_start = cmdq.rx_start;
       }
+      cmdq.rx_state = FRAME_IDLE;
+      bus.matched = 0;
+    }
+    else if (cmdq.rx_state != FRAME_RECEIVING)
+    {
+      continue;
+    }
+    else if (cmdq.rx_len >= JSON_BUFFER - 1)
+    {
+      // too long command. Text is thrown away, header is kept to acknowledge error in order
+      cmdq.head = (cmdq.rx_start + FRAME_HEADER) % CMD_RING_SIZE;
+      cmdq.used -= cmdq.rx_len;
+      cmdq.rx_len = 0;
+      cmdq.rx_status = FRAME_OVERFLOW;
+      cmdq.rx_state = FRAME_SKIP_KEEP;
+    }
+    else if (cmdq.used >= CMD_RING_SIZE - 1) // one byte is kept for \0
+    {
+      cmdq.head = cmdq.rx_start;
+      cmdq.used -= FRAME_HEADER + cmdq.rx_len;
+      frame_drop();
+      cmdq.rx_state = FRAME_SKIP_DROP;
+    }
+    else
+    {
+      cmdq.buf[cmdq.head] = byte;
+      cmdq.head = (cmdq.head + 1) % CMD_RING_SIZE;
+      cmdq.used++;
+      cmdq.rx_len++;
+    }
+  }
+}
+
+void frame_drop(void)
+{
+  // Dropped line is acknowledged in order, after older lines: it's counted in status of newest frame or in job which
+  // acknowledges last executed one. Ack is printed at once only when it can't be counted there
+  uint8_t seq = cmdq.seq++;
+  if (!CMD_ACK || (bus.rx_flags & FRAME_BUS_SILENT))
+    return;
+  if (cmdq.frames > 0)
+  {
+    char *status = &cmdq.buf[(cmdq.last_start + 2) % CMD_RING_SIZE];
+    uint8_t frame_seq = cmdq.buf[(cmdq.last_start + 1) % CMD_RING_SIZE];
+    uint8_t dropped = (*status & FRAME_DROPPED_MASK) / FRAME_DROPPED_UNIT;
+    if ((uint8_t)(frame_seq + dropped + 1) == seq && dropped < FRAME_DROPPED_MASK / FRAME_DROPPED_UNIT &&
+        (*status & FRAME_BUS_MASK) == bus.rx_flags)
+    {
+      *status += FRAME_DROPPED_UNIT;
+      return;
+    }
+  }
+  else if (job.type != JOB_NONE && (uint8_t)(job.seq + job.dropped + 1) == seq && job.dropped < 255 &&
+           job.bus_flags == bus.rx_flags)
+  {
+    job.dropped++;
+    return;
+  }
+  bus_ack(seq, F(ACK_DROPPED), bus.rx_flags);
+}
+
+int CMD_READER::read()
+{
+  char byte = cmdq.buf[pos];
+  if (byte == '\0')
+    return -1;
+  pos = (pos + 1) % CMD_RING_SIZE;
+  return (uint8_t)byte;
+}
+
+size_t CMD_READER::readBytes(char *buffer, size_t length)
+{
+  size_t n = 0;
+  int byte;
+  while (n < length && (byte = read()) >= 0)
+    buffer[n++] = byte;
+  return n;
+}
+
+void execute_frame(void)
+{
+  // Executes oldest frame and removes it from ring
+  uint16_t tail = cmdq.tail;
+  uint8_t len = cmdq.buf[tail];
+  uint8_t seq = cmdq.buf[(tail + 1) % CMD_RING_SIZE];
+  uint8_t status = cmdq.buf[(tail + 2) % CMD_RING_SIZE];
+  uint8_t bus_flags = status & FRAME_BUS_MASK;
+  const __FlashStringHelper *result = F(ACK_DONE);
+
+  status &= FRAME_STATUS_MASK;
+  bus_driver(bus_flags & FRAME_BUS_REPLY); // output of command goes to bus
+
+  if (status == FRAME_OVERFLOW)
+  {
+    result = F(ACK_OVERFLOW);
+  }
+  else if (status == FRAME_NOT_JSON)
+  {
+    result = F(ACK_NOT_JSON);
+  }
+  else
+  {
+    uint32_t received_us = TRACE ? micros() : 0;
+    CMD_READER reader = {(uint16_t)((tail + FRAME_HEADER) % CMD_RING_SIZE)};
+    json_arena.reset();
+    JsonDocument json(&json_arena);
+    cycle_mark(MARK_PARSE);
+    DeserializationError err = deserializeJson(json, reader);
+    cycle_mark(MARK_PARSE | MARK_END);
+    if (err)
+    {
+      if (err == DeserializationError::NoMemory)
+        Serial.println(F(ERR_PARSER_NO_MEMORY));
+      result = F(ACK_INVALID);
     }
-    else if (byte == starting_byte)
+    else
     {
-      receiving = 1;
-      buf[ndx] = byte;
-      ndx++;
+      cmdq.exec_seq = seq;
+      cmdq.exec_flags = bus_flags;
+      if (CAPTURE)
+        capture_command(json);
+      cycle_mark(MARK_COMMAND);
+      handle_input_commands(json, received_us);
+      cycle_mark(MARK_COMMAND | MARK_END);
+      if (job.type != JOB_NONE)
+        result = 0; // acknowledged when job is finished
     }
   }
+
+  // lines dropped while frame waited or was executed follow its acknowledgement
+  uint8_t dropped = (cmdq.buf[(tail + 2) % CMD_RING_SIZE] & FRAME_DROPPED_MASK) / FRAME_DROPPED_UNIT;
+  uint16_t size = FRAME_HEADER + len + 1;
+  cmdq.tail = (tail + size) % CMD_RING_SIZE;
+  cmdq.used -= size;
+  cmdq.frames--;
+  if (CMD_ACK && result && !(bus_flags & FRAME_BUS_SILENT))
+    cmd_ack(seq, result);
+  if (!result)
+    job.dropped = dropped;
+  for (uint8_t i = 1; result && i <= dropped; i++)
+    cmd_ack(seq + i, F(ACK_DROPPED));
+  bus_driver(0); // job progress and acknowledgement take own short windows, bus is free while job runs
+}
+
+void cmd_ack(uint8_t seq, const __FlashStringHelper *result)
+{
+  Serial.print('@');
+  Serial.print(seq);
+  Serial.print(' ');
+  Serial.println(result);
+}
+
+void bus_ack(uint8_t seq, const __FlashStringHelper *result, uint8_t bus_flags)
+{
+  // Acknowledges frame outside of its execution: rejected before it or finished by background job. On bus only
+  // frames addressed to this node are answered, in own short driver window
+  if (bus_flags & FRAME_BUS_SILENT)
+    return;
+  bus_driver(bus_flags & FRAME_BUS_REPLY);
+  cmd_ack(seq, result);
+  bus_driver(0);
+}
+
+uint8_t bus_address_byte(char byte)
+{
+  // Parses byte of line address ">" target ":". Returns 0 when line has to be skipped
+#if BUS_MODE
+  if (byte == '*' && bus.rx_target == 0 && bus.rx_kind == BUS_UNICAST)
+  {
+    bus.rx_kind = BUS_BROADCAST;
+    return 1;
+  }
+  if (byte == 'g' && bus.rx_target == 0 && bus.rx_kind == BUS_UNICAST)
+  {
+    bus.rx_kind = BUS_GROUP;
+    return 1;
+  }
+  if (byte >= '0' && byte <= '9' && bus.rx_kind != BUS_BROADCAST)
+  {
+    bus.rx_target = bus.rx_target * 10 + (byte - '0');
+    return bus.rx_target <= BUS_MAX_ADDRESS;
+  }
+  if (byte != ':')
+    return 0;
+
+  uint8_t is_matched = 0;
+  if (bus.rx_kind == BUS_UNICAST)
+    is_matched = bus.rx_target == config.bus_address;
+  else if (bus.rx_kind == BUS_GROUP)
+    is_matched = bus.rx_target >= 1 && bus.rx_target <= BUS_GROUPS && (config.bus_groups >> (bus.rx_target - 1)) & 1;
+  else
+    is_matched = 1;
+  if (!is_matched)
+    return 0;
+
+  bus.rx_flags = bus.rx_kind == BUS_UNICAST ? FRAME_BUS_REPLY : FRAME_BUS_SILENT;
+  bus.matched = 1;
+  cmdq.rx_state = FRAME_IDLE; // command text follows
+  return 1;
+#else
+  (void)byte;
   return 0;
+#endif
+}
+
+void bus_driver(uint8_t on)
+{
+  // Enables transceiver driver for answer of node. Driver is released after last byte left UART, so answer isn't cut
+#if BUS_MODE
+  on = on != 0;
+  if (on == bus.driver || (on && config.bus_address == 0))
+    return;
+  if (!on)
+    Serial.flush();
+  FastPin<BUS_DE_PIN>::write(on);
+  bus.driver = on;
+#else
+  (void)on;
+#endif
 }
 
 PERIPHERALS handle_input(char *input)
 {
   // This functions get received string from serial and tranform to json and analize what device is being added and return struct with pointer to cell in global arrays of devices and what kind of device it is being added
   PERIPHERALS dev;
-  JsonDocument json;
+  JsonDocument json(&json_arena);
   uint8_t invalid_param = 127;
   // need to handle case when array reaches maximum buttons
 
@@ -968,7 +2348,7 @@ PERIPHERALS handle_input(char *input)
 
   if (device_type[0] == 'B') // May use strcmp() instead
   {
-    BUTTON *btn = (BUTTON *)malloc(sizeof(BUTTON));
+    BUTTON *btn = button_alloc();
     if (!btn)
     {
       dev.is_button = 0;
@@ -982,8 +2362,13 @@ PERIPHERALS handle_input(char *input)
     dev.relay = 0;
 
     btn->pin = (pin >= START_BTN_PIN ? (pin <= END_BTN_PIN ? pin : invalid_param) : invalid_param);
+    if (ZERO_CROSS && btn->pin == ZC_PIN)
+      btn->pin = invalid_param; // pin is occupied by zero cross detector
+    if (BUS_MODE && btn->pin == BUS_DE_PIN)
+      btn->pin = invalid_param; // pin is occupied by bus transceiver
     if (btn->pin == invalid_param)
     {
+      button_release(btn);
       dev.is_button = 0;
       dev.button = 0;
     }
@@ -996,7 +2381,7 @@ PERIPHERALS handle_input(char *input)
   }
   else if (device_type[0] == 'R')
   {
-    RELAY *relay = (RELAY *)malloc(sizeof(RELAY));
+    RELAY *relay = relay_alloc();
     if (!relay)
     {
       dev.is_button = 0;
@@ -1011,13 +2396,30 @@ PERIPHERALS handle_input(char *input)
     dev.button = 0;
     relay->pin = (pin >= START_REL_PIN ? (pin <= END_REL_PIN ? pin : invalid_param) : invalid_param); // Check if pin in right range
     relay->type = ((rel_type[0] == 'L') || (rel_type[0] == 'H') ? rel_type[0] : invalid_param);       // Check if json have only H of L for relay type
+    if (I2C_IN_USE && (relay->pin == I2C_SDA_PIN || relay->pin == I2C_SCL_PIN))
+      relay->pin = invalid_param; // pin is occupied by I2C bus of settings memory
+    relay->pulse_left = 0;
+    if (LATCHING && rel_type[0] == 'P')
+    {
+      // {"pin":"A0","device":"R","type":"P","reset":"A1","pulse":30}
+      uint8_t pulse_ms = json["pulse"];
+      relay->type = 'P';
+      relay->state = RELAY_STATE_UNKNOWN;
+      relay->reset_pin = json_to_pin(json["reset"]);
+      relay->pulse_ms = pulse_ms ? pulse_ms : LATCH_PULSE_MS;
+      if (!latch_check(relay))
+        relay->type = invalid_param;
+      fast_pin_init(&relay->reset_io, relay->reset_pin);
+    }
     if (relay->pin == invalid_param || relay->type == invalid_param)
     {
+      relay_release(relay);
       dev.is_relay = 0;
       dev.relay = 0;
     }
     else
     {
+      fast_pin_init(&relay->io, relay->pin);
       dev.is_relay = 1;
       dev.relay = relay;
     }
@@ -1076,14 +2478,10 @@ int power(int x, int y)
   return res;
 }
 
-void handle_input_commands(char *input)
+void handle_input_commands(JsonDocument &json, uint32_t received_us)
 {
+  // received_us - time when command was received, used for latency tracing
   const uint8_t device_max_chars = 64;
-  JsonDocument json;
-  DeserializationError err = deserializeJson(json, input);
-
-  if (err)
-    return;
 
   uint8_t is_pin = json["pin"].is<JsonVariant>();
 
@@ -1092,6 +2490,11 @@ void handle_input_commands(char *input)
 
   if (strcmp(json["class"], "D") == 0 || is_pin) // incoming devices. Handling new and old style json in the same time
   {
+    if (STATIC_CONFIG)
+    {
+      Serial.println(F(ERR_STATIC_DEVICES));
+      return;
+    }
     if (!json["device"].is<JsonVariant>() && !is_pin)
       return;
 
@@ -1101,92 +2504,14 @@ void handle_input_commands(char *input)
     else
       serializeJson(json["device"].as<JsonObject>(), device);
 
-    PERIPHERALS new_dev = handle_input(device);
-    if (new_dev.is_button || new_dev.is_relay)
-    {
-      Serial.print(F("New device - "));
-      if (new_dev.is_button)
-        Serial.println(F("button"));
-      else if (new_dev.is_relay)
-        Serial.println(F("relay"));
-    }
-    else
-    {
-      Serial.println("No new device received. Check sent data!");
-    }
-
-    if (new_dev.is_button)
-    {
-      // !done: Check if provided pin not already used if it is re-define that button
-      // !done: If it is new button and pin not used check if array of buttons not full
-      define_new_button(new_dev.button);
-      if (new_dev.button->is_defined && count.buttons < MAX_BUTTONS - 1)
-      {
-        // !done: should check if there is button on this pin and rewrite this button is buttons array
-        uint8_t ndx = -1;
-        for (int i = 0; i < count.buttons; i++)
-        {
-          if (buttons[i].pin == new_dev.button->pin) // looking for existing button on provided pin
-            ndx = i;
-        }
-        if (ndx < 0 || ndx >= MAX_BUTTONS)
-        {
-          ndx = count.buttons; // If button on provided pin not exists add new button to array
-        }
-
-        int is_saved = button_rom(new_dev.button, ndx, 'S');
-        if (is_saved)
-        {
-          buttons[ndx] = *new_dev.button;
-          Serial.println(F("Button saved to ROM"));
-        }
-        else
-        {
-          Serial.println(F("Button saving failed"));
-        }
-        count.buttons = (ndx == count.buttons) ? (count.buttons + 1) : count.buttons;
-        dev_count_rom(&count, 'S');
-      }
-
-      free(new_dev.button);
-    }
-    else if (new_dev.is_relay)
-    {
-      if (count.relays < MAX_RELAYS - 1)
-      {
-        uint8_t ndx = -1;
-        for (int i = 0; i < count.relays; i++)
-        {
-          if (relays[i].pin == new_dev.relay->pin)
-            ndx = i;
-        }
-        if (ndx < 0 || ndx >= MAX_RELAYS)
-          ndx = count.relays;
-
-        relays[ndx] = *new_dev.relay;
-        int is_saved = relay_rom(&relays[ndx], ndx, 'S');
-        if (is_saved)
-          Serial.println("Relay saved to ROM");
-
-        pinMode(relays[ndx].pin, OUTPUT);
-        count.relays = (ndx == count.relays) ? (count.relays + 1) : count.relays;
-        dev_count_rom(&count, 'S');
-
-        uint8_t max_mode = power(2, count.relays) - 1;
-        light.max_light_mode = max_mode;
-        if (light.light_mode < 1 || light.light_mode > light.max_light_mode)
-          light.light_mode = light.max_light_mode; // when new relay added change max_mode and current light_mode if it is not valid value
-      }
-
-      free(new_dev.relay);
-    }
+    add_device(device);
   }
   /*=================This block handling incoming commands =================*/
   else if (strcmp(json["class"], "C") == 0)
   {
     if (!json["action"].is<JsonVariant>())
     {
-      Serial.println("Type \"help\" for command list"); // placeholder
+      Serial.println(F(ERR_HELP_UNKNOWN));
       return;
     }
     const char *action = json["action"];
@@ -1198,7 +2523,7 @@ void handle_input_commands(char *input)
     if (strcmp(action, STATUS) == 0)
     {
       char status[STATUS_FORMAT_LEN];
-      sprintf(status, STATUS_FORMAT, count.buttons, count.relays, light.light_state, light.light_mode, light.avg_on_duration, light.timeout);
+      sprintf(status, STATUS_FORMAT, count.buttons, count.relays, light.light_state, light.light_mode, light.avg_on_duration, light.timeout, (unsigned long)boot_us);
       Serial.println(status);
     }
     else if (strcmp(action, BUTTONS) == 0)
@@ -1209,7 +2534,7 @@ void handle_input_commands(char *input)
       for (int i = 0; i < count.buttons; i++)
       {
         char button_print[BUTTONS_FORMAT_LEN];
-        sprintf(button_print, BUTTONS_FORMAT, i, buttons[i].pin, buttons[i].type, buttons[i].front);
+        sprintf(button_print, BUTTONS_FORMAT, i, buttons[i].pin, buttons[i].type, buttons[i].front, buttons[i].debounce_us);
         Serial.println(button_print);
       }
     }
@@ -1223,6 +2548,12 @@ void handle_input_commands(char *input)
         char relay_print[RELAYS_FORMAT_LEN];
         sprintf(relay_print, RELAYS_FORMAT, i, relays[i].pin, relays[i].type);
         Serial.println(relay_print);
+        if (relays[i].type == 'P')
+        {
+          char latch_print[RELAYS_LATCH_FORMAT_LEN];
+          sprintf(latch_print, RELAYS_LATCH_FORMAT, relays[i].reset_pin, relays[i].pulse_ms);
+          Serial.println(latch_print);
+        }
       }
     }
     else if (strcmp(action, REMOVE) == 0)
@@ -1235,6 +2566,11 @@ void handle_input_commands(char *input)
         }
       */
       // remove device here
+      if (STATIC_CONFIG)
+      {
+        Serial.println(F(ERR_STATIC_DEVICES));
+        return;
+      }
       if (!json["device"].is<JsonVariant>())
       {
         Serial.println(F(ERR_REMOVE_NOT_DEFINED));
@@ -1257,6 +2593,13 @@ void handle_input_commands(char *input)
     }
     else if (strcmp(action, SET_LIGHT_STATE) == 0)
     {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"light_state",
+          "options":[1]
+        }
+      */
       if (!json["options"].is<JsonVariant>())
       {
         Serial.println(F(ERR_SET_LIGHT_STATE_NO_OPTIONS));
@@ -1264,11 +2607,22 @@ void handle_input_commands(char *input)
       }
       uint8_t to_state = json["options"][0];
       // check if state received in valid range
-      toggle_light(&light, to_state);
+      if (TRACE)
+        trace_begin(TRACE_SERIAL, received_us);
+      toggle_light(&light, to_state, 'S');
     }
     else if (strcmp(action, SET_LIGHT_MODE) == 0)
     {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"light_mode",
+          "options":[3]
+        }
+      */
       // Need to set certain light mode. May need to make function
+      if (TRACE)
+        trace_begin(TRACE_SERIAL, received_us);
       if (!json["options"].is<JsonVariant>())
       {
         change_light_mode(&light, -1);
@@ -1283,6 +2637,13 @@ void handle_input_commands(char *input)
     }
     else if (strcmp(action, SET_AVG_DURATION) == 0)
     {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"set_timeout",
+          "options":[30]
+        }
+      */
       if (!json["options"].is<JsonVariant>())
       {
         Serial.println(F(ERR_SET_AVG_DURATION_NO_OPTIONS));
@@ -1295,13 +2656,22 @@ void handle_input_commands(char *input)
         return;
       }
       light.avg_on_duration = duration_m;
+      if (EVLOG)
+        evlog_append(EV_AVG_DURATION, duration_m);
     }
     else if (strcmp(action, CLEAR_ROM) == 0)
     {
-      clean_rom();
+      job_start(JOB_CLEAR_ROM);
     }
     else if (strcmp(action, SET_CONFIG) == 0)
     {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"set_config",
+          "options":[0,3,1]
+        }
+      */
       if (!json["options"].is<JsonVariant>())
       {
         Serial.println(F(ERR_SET_CONFIG_NO_OPTIONS));
@@ -1313,97 +2683,2509 @@ void handle_input_commands(char *input)
       config.l_button_mode = json["options"][2];
       config_rom(&config, 'S');
     }
-  }
-}
-
-void remove_device(uint8_t pin, const char *device)
-{
-  int8_t ndx = -1;
-  if (strcmp(device, "B") == 0)
-  {
-    for (int i = 0; i < count.buttons; i++)
+    else if (strcmp(action, BATCH) == 0)
     {
-      if (ndx != -1)
+      /* JSON example. Every section is optional, missing section keeps current settings
+        {
+          "class":"C",
+          "action":"batch",
+          "buttons":[[3,"M",0],[4,"L",1]], // [pin, type, front]
+          "relays":[["A0","L"],["A1","P","A2",30]], // [pin, type] or [pin, "P", reset pin, pulse ms]
+          "config":[0,3,1],                 // like set_config options
+          "timeout":30                      // like set_timeout option
+        }
+      */
+      if (STATIC_CONFIG && (json["buttons"].is<JsonVariant>() || json["relays"].is<JsonVariant>()))
       {
-        buttons[ndx] = buttons[i];
-        button_rom(&buttons[ndx], ndx, 'S');
-        ndx++;
+        Serial.println(F(ERR_STATIC_DEVICES));
+        return;
       }
-      if (buttons[i].pin == pin)
-        ndx = i;
+      handle_batch(json);
     }
-    if (ndx != -1)
+    else if (strcmp(action, LATENCY) == 0)
     {
-      count.buttons--;
-      button_rom(&buttons[count.buttons], count.buttons, 'E');
-      pinMode(pin, INPUT);
+      /* JSON example
+        {
+          "class":"C",
+          "action":"latency",
+          "options":[1]
+        }
+      */
+      if (!TRACE)
+      {
+        Serial.println(F(ERR_LATENCY_DISABLED));
+        return;
+      }
+      uint8_t reset = json["options"][0];
+      trace_dump(reset);
     }
-  }
-  else if (strcmp(device, "R") == 0)
-  {
-    for (int i = 0; i < count.relays; i++)
+    else if (strcmp(action, MEMORY) == 0)
     {
-      if (ndx != -1)
+      char memory_print[MEMORY_FORMAT_LEN];
+      sprintf(memory_print, MEMORY_FORMAT, JSON_ARENA_SIZE, json_arena.high_water, json_arena.failures, free_ram());
+      Serial.println(memory_print);
+    }
+    else if (strcmp(action, HELP) == 0)
+    {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"help",
+          "options":["batch"]
+        }
+      */
+      if (!HELP_CATALOG)
       {
-        relays[ndx] = relays[i];
-        relay_rom(&relays[ndx], ndx, 'S');
-        ndx++;
+        Serial.println(F(ERR_HELP_DISABLED));
+        return;
       }
-      if (relays[i].pin == pin)
-        ndx = i;
+      const char *name = json["options"][0];
+      if (!name)
+      {
+        help_list();
+        return;
+      }
+      int8_t index = help_find(name);
+      if (index < 0)
+      {
+        Serial.println(F(ERR_HELP_UNKNOWN));
+        return;
+      }
+      help_command(index);
     }
-    if (ndx != -1)
+    else if (strcmp(action, LOG) == 0)
     {
-      count.relays--;
-      relay_rom(&relays[count.relays], count.relays, 'E');
-      pinMode(pin, INPUT);
+      /* JSON example
+        {
+          "class":"C",
+          "action":"log",
+          "options":[1]
+        }
+      */
+      if (!EVLOG)
+      {
+        Serial.println(F(ERR_LOG_DISABLED));
+        return;
+      }
+      uint8_t from_rom = json["options"][0];
+      evlog_dump(from_rom);
     }
-  }
-  else
-  {
-    Serial.println(F("Device to remove not found"));
-  }
-}
-
-int clean_rom(void)
-{
-  for (uint16_t i = 0; i < EEPROM.length(); i++)
-    EEPROM.put(i, 0);
-
-  return 1;
+    else if (strcmp(action, CAPTURE_DUMP) == 0)
+    {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"capture"
+        }
+      */
+      if (!CAPTURE)
+      {
+        Serial.println(F(ERR_CAPTURE_DISABLED));
+        return;
+      }
+      capture_dump();
+    }
+    else if (strcmp(action, BUS) == 0)
+    {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"bus",
+          "options":[12, 5] // address 12, member of groups 1 and 3
+        }
+      */
+#if BUS_MODE
+      if (json["options"].is<JsonVariant>())
+      {
+        if (cmdq.exec_flags & FRAME_BUS_SILENT)
+        {
+          Serial.println(F(ERR_BUS_NOT_UNICAST));
+          return;
+        }
+        int address = json["options"][0] | -1;
+        int groups = json["options"][1] | (int)config.bus_groups;
+        if (address < 0 || address > BUS_MAX_ADDRESS || groups < 0 || groups >= (1 << BUS_GROUPS))
+        {
+          Serial.println(F(ERR_BUS_OPTION_NOT_IN_RANGE));
+          return;
+        }
+        config.bus_address = address;
+        config.bus_groups = groups;
+        config_rom(&config, 'S');
+      }
+      char output[BUS_FORMAT_LEN];
+      sprintf(output, BUS_FORMAT, config.bus_address, config.bus_groups);
+      Serial.println(output);
+#else
+      Serial.println(F(ERR_BUS_DISABLED));
+#endif
+    }
+    else if (strcmp(action, ZC_STATUS) == 0)
+    {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"zero_cross",
+          "options":[800]
+        }
+      */
+      if (!ZERO_CROSS)
+      {
+        Serial.println(F(ERR_ZC_DISABLED));
+        return;
+      }
+      if (json["options"].is<JsonVariant>())
+      {
+        uint16_t offset_us = json["options"][0];
+        if (offset_us > ZC_MAX_OFFSET_US)
+        {
+          Serial.println(F(ERR_ZC_OPTION_NOT_IN_RANGE));
+          return;
+        }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+          zc.offset_us = offset_us;
+        }
+        zc_rom(&zc, 'S');
+      }
+      char zc_print[ZC_STATUS_FORMAT_LEN];
+      uint16_t half_period, offset_us, phase_last, phase_min, phase_max, switches;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        half_period = zc.half_period / ZC_TICKS_PER_US;
+        offset_us = zc.offset_us;
+        phase_last = zc.phase_last;
+        phase_min = zc.phase_min;
+        phase_max = zc.phase_max;
+        switches = zc.switches;
+      }
+      sprintf(zc_print, ZC_STATUS_FORMAT, zc_is_present(), half_period, offset_us, phase_last, phase_min, phase_max, switches);
+      Serial.println(zc_print);
+    }
+    else if (strcmp(action, USAGE_REPORT) == 0)
+    {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"usage",
+          "options":[0, 200000]
+        }
+      */
+      if (!USAGE)
+      {
+        Serial.println(F(ERR_USAGE_DISABLED));
+        return;
+      }
+      if (json["options"].is<JsonVariant>())
+      {
+        uint8_t relay = json["options"][0];
+        uint8_t is_life = json["options"][1].is<JsonVariant>();
+        uint32_t life_cycles = json["options"][1];
+        if (relay >= MAX_RELAYS)
+        {
+          Serial.println(F(ERR_USAGE_RELAY));
+          return;
+        }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+          USAGE_RELAY_T *counters = &usage.counters.relays[relay];
+          if (is_life)
+          {
+            counters->life_cycles = life_cycles;
+          }
+          else
+          {
+            counters->cycles = 0;
+            counters->on_s = 0;
+          }
+        }
+        usage_rom(&usage, 'S');
+      }
+      usage_print();
+    }
+    else if (strcmp(action, SUBSCRIBE) == 0)
+    {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"subscribe",
+          "options":[1]
+        }
+      */
+      if (!NOTIFY)
+      {
+        Serial.println(F(ERR_NOTIFY_DISABLED));
+        return;
+      }
+      if (json["options"].is<JsonVariant>())
+      {
+        uint8_t is_on = json["options"][0];
+#if BUS_MODE
+        if (is_on && config.bus_address != 0)
+        {
+          Serial.println(F(ERR_NOTIFY_BUS));
+          return;
+        }
+#endif
+        config.notify = is_on != 0;
+        config_rom(&config, 'S');
+      }
+      notify_print();
+    }
+    else if (strcmp(action, AMBIENT_SENSOR) == 0)
+    {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"ambient",
+          "options":["A6", [[40, 2], [160, 3], [255, 255]]]
+        }
+      */
+      if (!AMBIENT)
+      {
+        Serial.println(F(ERR_AMBIENT_DISABLED));
+        return;
+      }
+      if (json["options"].is<JsonVariant>())
+      {
+        AMBIENT_T new_ambient = ambient;
+        JsonVariant table = json["options"][1];
+        new_ambient.pin = json_to_pin(json["options"][0]);
+        if (new_ambient.pin != 0 && (new_ambient.pin < board_sensor_first || new_ambient.pin > board_sensor_last))
+        {
+          Serial.println(F(ERR_AMBIENT_PIN));
+          return;
+        }
+        if (table.is<JsonArray>())
+        {
+          uint8_t steps = table.size();
+          uint8_t is_valid = steps <= AMBIENT_STEPS;
+          for (uint8_t i = 0; is_valid && i < steps; i++)
+          {
+            uint16_t threshold = table[i][0];
+            uint8_t mode = table[i][1];
+            is_valid = table[i].size() == 2 && threshold <= 255 && (i == 0 || threshold > new_ambient.thresholds[i - 1]) &&
+                       (mode <= light.max_light_mode || mode == AMBIENT_STAY_OFF);
+            new_ambient.thresholds[i] = threshold;
+            new_ambient.modes[i] = mode;
+          }
+          if (!is_valid)
+          {
+            Serial.println(F(ERR_AMBIENT_TABLE));
+            return;
+          }
+          new_ambient.steps = steps;
+        }
+        ambient.pin = new_ambient.pin;
+        ambient.steps = new_ambient.steps;
+        memcpy(ambient.thresholds, new_ambient.thresholds, sizeof(ambient.thresholds));
+        memcpy(ambient.modes, new_ambient.modes, sizeof(ambient.modes));
+        ambient_rom(&ambient, 'S');
+        ambient_init();
+      }
+      char ambient_print[AMBIENT_FORMAT_LEN];
+      sprintf(ambient_print, AMBIENT_FORMAT, ambient.pin, ambient.level);
+      Serial.println(ambient_print);
+      for (uint8_t i = 0; i < ambient.steps; i++)
+      {
+        char step_print[AMBIENT_STEP_FORMAT_LEN];
+        sprintf(step_print, AMBIENT_STEP_FORMAT, ambient.thresholds[i], ambient.modes[i]);
+        Serial.println(step_print);
+      }
+    }
+    else if (strcmp(action, SET_SEQUENCE) == 0)
+    {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"sequence",
+          "options":[3, [1, "cold"], [2, "warm"]]
+        }
+      */
+      if (!SEQUENCE)
+      {
+        Serial.println(F(ERR_SEQUENCE_DISABLED));
+        return;
+      }
+      if (json["options"].is<JsonArray>())
+      {
+        JsonVariant steps = json["options"];
+        uint8_t is_valid = steps.size() <= SEQUENCE_STEPS;
+        for (uint8_t i = 0; is_valid && i < steps.size(); i++)
+        {
+          JsonVariant step = steps[i];
+          uint16_t mode = step.is<JsonArray>() ? step[0] : step;
+          const char *name = step[1] | "";
+          is_valid = mode >= 1 && mode <= light.max_light_mode && strlen(name) < SEQUENCE_NAME_LEN &&
+                     (!step.is<JsonArray>() || step.size() <= 2);
+        }
+        if (!is_valid)
+        {
+          Serial.println(F(ERR_SEQUENCE_STEPS));
+          return;
+        }
+        sequence.steps = steps.size();
+        for (uint8_t i = 0; i < sequence.steps; i++)
+          sequence.masks[i] = steps[i].is<JsonArray>() ? steps[i][0] : steps[i];
+        job_start(JOB_SEQUENCE); // names are added to image below
+        for (uint8_t i = 0; i < sequence.steps; i++)
+          strncpy((char *)job.image + SEQUENCE_NAME_OFFSET(i) - (SEQUENCE_OFFSET), steps[i][1] | "", SEQUENCE_NAME_LEN - 1);
+        sequence_fit();
+      }
+      sequence_print();
+    }
+    else if (strcmp(action, SELECT_STEP) == 0)
+    {
+      /* JSON example
+        {
+          "class":"C",
+          "action":"step",
+          "options":["warm"]
+        }
+      */
+      if (!SEQUENCE)
+      {
+        Serial.println(F(ERR_SEQUENCE_DISABLED));
+        return;
+      }
+      JsonVariant option = json["options"][0];
+      uint8_t step = SEQUENCE_NONE;
+      if (option.is<const char *>())
+        step = sequence_find_name(option);
+      else if (option.is<uint8_t>())
+        step = option;
+      if (step >= sequence.steps)
+      {
+        Serial.println(F(ERR_SELECT_STEP));
+        return;
+      }
+      if (TRACE)
+        trace_begin(TRACE_SERIAL, received_us);
+      change_light_mode(&light, sequence.modes[step]);
+      sequence.step = step; // mode can be in list twice
+    }
+    else
+    {
+      Serial.println(F(ERR_HELP_UNKNOWN)); // catalog is printed only on request, it takes seconds to send
+    }
+  }
+}
+
+void *ArenaAllocator::allocate(size_t size)
+{
+  // block layout: [size aligned to ARENA_ALIGN][payload aligned to ARENA_ALIGN]
+  size_t payload = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if (used + ARENA_ALIGN + payload > JSON_ARENA_SIZE)
+  {
+    failures++;
+    return 0;
+  }
+  uint8_t *block = buf + used;
+  *(uint16_t *)block = payload;
+  last = used + ARENA_ALIGN;
+  used += ARENA_ALIGN + payload;
+  if (used > high_water)
+    high_water = used;
+  return buf + last;
+}
+
+void ArenaAllocator::deallocate(void *ptr)
+{
+  // Only last block returns memory to arena, the rest is freed by reset()
+  if (ptr && (uint8_t *)ptr == buf + last)
+  {
+    used = last - ARENA_ALIGN;
+    last = 0;
+  }
+}
+
+void *ArenaAllocator::reallocate(void *ptr, size_t new_size)
+{
+  if (!ptr)
+    return allocate(new_size);
+
+  uint16_t old_size = *(uint16_t *)((uint8_t *)ptr - ARENA_ALIGN);
+  size_t payload = (new_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if ((uint8_t *)ptr == buf + last)
+  {
+    // last block grows or shrinks in place
+    if (last + payload > JSON_ARENA_SIZE)
+    {
+      failures++;
+      return 0;
+    }
+    *(uint16_t *)((uint8_t *)ptr - ARENA_ALIGN) = payload;
+    used = last + payload;
+    if (used > high_water)
+      high_water = used;
+    return ptr;
+  }
+  if (payload <= old_size)
+    return ptr;
+
+  void *moved = allocate(new_size);
+  if (moved)
+    memcpy(moved, ptr, old_size);
+  return moved;
+}
+
+void ArenaAllocator::reset(void)
+{
+  used = 0;
+  last = 0;
+}
+
+BUTTON *button_alloc(void)
+{
+  if (dev_pool.is_button_used)
+    return 0;
+  dev_pool.is_button_used = 1;
+  return &dev_pool.button;
+}
+
+RELAY *relay_alloc(void)
+{
+  if (dev_pool.is_relay_used)
+    return 0;
+  dev_pool.is_relay_used = 1;
+  return &dev_pool.relay;
+}
+
+void button_release(BUTTON *btn)
+{
+  if (btn == &dev_pool.button)
+    dev_pool.is_button_used = 0;
+}
+
+void relay_release(RELAY *relay)
+{
+  if (relay == &dev_pool.relay)
+    dev_pool.is_relay_used = 0;
+}
+
+int free_ram(void)
+{
+  // Distance between top of heap and stack
+#ifdef __AVR__
+  extern char __heap_start, *__brkval;
+  char top;
+  return (int)(&top - (__brkval == 0 ? &__heap_start : __brkval));
+#else
+  return -1;
+#endif
+}
+
+uint8_t json_to_pin(JsonVariant value)
+{
+  // Pin could be provided as number or as string like "A0" or "D3"
+  const char *char_pin = value;
+  if (char_pin)
+    return pin_to_int(char_pin);
+  uint8_t int_pin = value;
+  return int_pin;
+}
+
+void handle_batch(JsonDocument &json)
+{
+  // Validates whole configuration in staging copies first. Nothing is changed if any part is invalid.
+  // Then configuration is applied in RAM at once and saved to ROM by background job
+  BUTTON new_buttons[MAX_BUTTONS];
+  RELAY new_relays[MAX_RELAYS];
+  DEV_CNT_T new_count = count;
+  CONFIG new_config = config;
+  uint8_t new_duration = light.avg_on_duration;
+  uint8_t has_buttons = json["buttons"].is<JsonArray>();
+  uint8_t has_relays = json["relays"].is<JsonArray>();
+
+  if ((has_buttons && json["buttons"].size() > MAX_BUTTONS) || (has_relays && json["relays"].size() > MAX_RELAYS))
+  {
+    Serial.println(F(ERR_BATCH_TOO_MANY));
+    return;
+  }
+
+  if (has_buttons)
+  {
+    new_count.buttons = json["buttons"].size();
+    for (uint8_t i = 0; i < new_count.buttons; i++)
+    {
+      JsonVariant item = json["buttons"][i];
+      BUTTON *btn = &new_buttons[i];
+      const char *type = item[1];
+      uint8_t front = item[2] | 255;
+      btn->pin = json_to_pin(item[0]);
+      btn->type = type ? type[0] : 0;
+      btn->front = front;
+      uint8_t is_valid = btn->pin >= START_BTN_PIN && btn->pin <= END_BTN_PIN && (btn->type == 'M' || btn->type == 'L') && btn->front <= 1;
+      if (ZERO_CROSS && btn->pin == ZC_PIN)
+        is_valid = 0;
+      if (BUS_MODE && btn->pin == BUS_DE_PIN)
+        is_valid = 0;
+      for (uint8_t j = 0; j < i; j++)
+      {
+        if (new_buttons[j].pin == btn->pin)
+          is_valid = 0;
+      }
+      if (!is_valid)
+      {
+        Serial.print(F(ERR_BATCH_BUTTON));
+        Serial.print(' ');
+        Serial.println(i);
+        return;
+      }
+      btn->is_defined = 1;
+      btn->state = 0;
+      btn->last_state = 0;
+      btn->last_pin_state = !btn->front;
+      btn->current_state_time = millis();
+      btn->last_state_time = 0;
+      btn->trace_us = 0;
+      btn->edge_us = 0;
+      fast_pin_init(&btn->io, btn->pin);
+      debounce_init(btn, DEBOUNCE_DEFAULT_US);
+      for (uint8_t j = 0; j < count.buttons; j++)
+      {
+        if (buttons[j].pin == btn->pin)
+          debounce_init(btn, buttons[j].debounce_us); // same switch keeps learned interval
+      }
+    }
+  }
+  else
+  {
+    memcpy(new_buttons, buttons, sizeof(new_buttons));
+  }
+
+  if (has_relays)
+  {
+    new_count.relays = json["relays"].size();
+    for (uint8_t i = 0; i < new_count.relays; i++)
+    {
+      JsonVariant item = json["relays"][i];
+      RELAY *relay = &new_relays[i];
+      const char *type = item[1];
+      relay->pin = json_to_pin(item[0]);
+      relay->type = type ? type[0] : 0;
+      relay->state = 0;
+      relay->pulse_left = 0;
+      fast_pin_init(&relay->io, relay->pin);
+      uint8_t is_valid = relay->pin >= START_REL_PIN && relay->pin <= END_REL_PIN && (relay->type == 'H' || relay->type == 'L');
+      if (LATCHING && relay->type == 'P')
+      {
+        uint8_t pulse_ms = item[3];
+        relay->state = RELAY_STATE_UNKNOWN;
+        relay->reset_pin = json_to_pin(item[2]);
+        relay->pulse_ms = pulse_ms ? pulse_ms : LATCH_PULSE_MS;
+        fast_pin_init(&relay->reset_io, relay->reset_pin);
+        is_valid = relay->pin >= START_REL_PIN && relay->pin <= END_REL_PIN && latch_check(relay);
+      }
+      if (I2C_IN_USE && (relay->pin == I2C_SDA_PIN || relay->pin == I2C_SCL_PIN))
+        is_valid = 0;
+      for (uint8_t j = 0; j < i; j++)
+      {
+        if (relay_uses_pin(&new_relays[j], relay->pin) || (relay->type == 'P' && relay_uses_pin(&new_relays[j], relay->reset_pin)))
+          is_valid = 0;
+      }
+      if (!is_valid)
+      {
+        Serial.print(F(ERR_BATCH_RELAY));
+        Serial.print(' ');
+        Serial.println(i);
+        return;
+      }
+    }
+  }
+  else
+  {
+    memcpy(new_relays, relays, sizeof(new_relays));
+  }
+
+  uint8_t new_max_mode = power(2, new_count.relays) - 1;
+  if (json["config"].is<JsonArray>())
+  {
+    uint8_t init_light_state = json["config"][0];
+    uint8_t default_light_mode = json["config"][1];
+    uint8_t l_button_mode = json["config"][2];
+    if (init_light_state == 2 || init_light_state > 3 || default_light_mode > new_max_mode || default_light_mode > 15 || l_button_mode > 1)
+    {
+      Serial.println(F(ERR_BATCH_CONFIG));
+      return;
+    }
+    new_config.init_light_state = init_light_state;
+    new_config.default_light_mode = default_light_mode;
+    new_config.l_button_mode = l_button_mode;
+  }
+  else if (new_config.default_light_mode > new_max_mode)
+  {
+    new_config.default_light_mode = new_max_mode;
+  }
+
+  if (json["timeout"].is<JsonVariant>())
+  {
+    uint16_t duration_m = json["timeout"];
+    if (duration_m > MAX_AVG_DURATION)
+    {
+      Serial.println(F(ERR_BATCH_TIMEOUT));
+      return;
+    }
+    new_duration = duration_m;
+  }
+
+  // applying. Pins of removed devices are released, relays are turned off and switched to new set
+  for (uint8_t i = 0; i < count.buttons; i++)
+    fast_mode(&buttons[i].io, INPUT);
+  for (uint8_t i = 0; i < count.relays; i++)
+    set_relay_state(&relays[i], 0);
+  if (LATCHING)
+    latch_wait(); // off pulses are ended by Timer2 while relays are still in table
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (uint8_t i = 0; i < count.relays; i++)
+      relay_mode(&relays[i], INPUT);
+    memcpy(buttons, new_buttons, sizeof(new_buttons));
+    memcpy(relays, new_relays, sizeof(new_relays));
+    count = new_count;
+    for (uint8_t i = 0; i < count.relays; i++)
+    {
+      set_relay_state(&relays[i], 0);
+      relay_mode(&relays[i], OUTPUT);
+    }
+  }
+  for (uint8_t i = 0; i < count.buttons; i++)
+  {
+    fast_mode(&buttons[i].io, INPUT_PULLUP);
+    if (TRACE && TRACE_PCINT)
+      trace_watch_pin(buttons[i].pin);
+  }
+  config = new_config;
+  light.avg_on_duration = new_duration;
+  light.max_light_mode = new_max_mode;
+  if (light.light_mode < 1 || light.light_mode > light.max_light_mode)
+    light.light_mode = light.max_light_mode;
+  if (SEQUENCE)
+    sequence_fit();
+  light.trigger = 1;
+
+  // committing. Job image is taken from new configuration, slots left by smaller table are erased with it
+  job_start(JOB_DEV_TABLE);
+
+  char batch_print[BATCH_FORMAT_LEN];
+  sprintf(batch_print, BATCH_FORMAT, count.buttons, count.relays);
+  Serial.println(batch_print);
+}
+
+uint8_t add_device(char *device)
+{
+  // Adds or redefines device described by JSON text like {"pin":10,"device":"B"}. Buttons are defined by pressing them.
+  // Returns 1 when device is saved
+  PERIPHERALS new_dev = handle_input(device);
+  uint8_t is_added = 0;
+  if (new_dev.is_button || new_dev.is_relay)
+  {
+    Serial.print(F("New device - "));
+    if (new_dev.is_button)
+      Serial.println(F("button"));
+    else if (new_dev.is_relay)
+      Serial.println(F("relay"));
+  }
+  else
+  {
+    Serial.println("No new device received. Check sent data!");
+  }
+
+  if (new_dev.is_button)
+  {
+    // !done: Check if provided pin not already used if it is re-define that button
+    // !done: If it is new button and pin not used check if array of buttons not full
+    define_new_button(new_dev.button);
+    if (new_dev.button->is_defined && count.buttons < MAX_BUTTONS - 1)
+    {
+      // !done: should check if there is button on this pin and rewrite this button is buttons array
+      uint8_t ndx = -1;
+      for (int i = 0; i < count.buttons; i++)
+      {
+        if (buttons[i].pin == new_dev.button->pin) // looking for existing button on provided pin
+          ndx = i;
+      }
+      if (ndx >= MAX_BUTTONS) // -1 wraps to 255
+      {
+        ndx = count.buttons; // If button on provided pin not exists add new button to array
+      }
+
+      int is_saved = button_rom(new_dev.button, ndx, 'S');
+      if (is_saved)
+      {
+        buttons[ndx] = *new_dev.button;
+        if (TRACE && TRACE_PCINT)
+          trace_watch_pin(buttons[ndx].pin);
+        Serial.println(F("Button saved to ROM"));
+        is_added = 1;
+      }
+      else
+      {
+        Serial.println(F("Button saving failed"));
+      }
+      count.buttons = (ndx == count.buttons) ? (count.buttons + 1) : count.buttons;
+      dev_count_rom(&count, 'S');
+    }
+
+    button_release(new_dev.button);
+  }
+  else if (new_dev.is_relay)
+  {
+    if (count.relays < MAX_RELAYS - 1)
+    {
+      uint8_t ndx = -1;
+      for (int i = 0; i < count.relays; i++)
+      {
+        if (relays[i].pin == new_dev.relay->pin)
+          ndx = i;
+      }
+      if (ndx >= MAX_RELAYS) // -1 wraps to 255
+        ndx = count.relays;
+
+      relays[ndx] = *new_dev.relay;
+      is_added = relay_rom(&relays[ndx], ndx, 'S');
+      if (is_added)
+        Serial.println("Relay saved to ROM");
+
+      set_relay_state(&relays[ndx], 0); // preload output latch before pin becomes output
+      relay_mode(&relays[ndx], OUTPUT);
+      count.relays = (ndx == count.relays) ? (count.relays + 1) : count.relays;
+      dev_count_rom(&count, 'S');
+
+      uint8_t max_mode = power(2, count.relays) - 1;
+      light.max_light_mode = max_mode;
+      if (light.light_mode < 1 || light.light_mode > light.max_light_mode)
+        light.light_mode = light.max_light_mode; // when new relay added change max_mode and current light_mode if it is not valid value
+      if (SEQUENCE)
+        sequence_fit();
+    }
+
+    relay_release(new_dev.relay);
+  }
+
+  return is_added;
+}
+
+void remove_device(uint8_t pin, const char *device)
+{
+  int8_t ndx = -1;
+  if (strcmp(device, "B") == 0)
+  {
+    for (int i = 0; i < count.buttons; i++)
+    {
+      if (ndx != -1)
+      {
+        buttons[ndx] = buttons[i];
+        ndx++;
+      }
+      if (buttons[i].pin == pin)
+        ndx = i;
+    }
+    if (ndx != -1)
+    {
+      count.buttons--;
+      pinMode(pin, INPUT);
+      job_start(JOB_DEV_TABLE); // intervals of shifted buttons move with them
+    }
+  }
+  else if (strcmp(device, "R") == 0)
+  {
+    RELAY removed;
+    int8_t removed_ndx = -1;
+    for (int i = 0; i < count.relays; i++)
+    {
+      if (relays[i].pin == pin)
+        removed_ndx = i;
+    }
+    if (removed_ndx != -1)
+    {
+      // removed relay is turned off first, off pulse of latching one is ended by Timer2 while it is still in table
+      set_relay_state(&relays[removed_ndx], 0);
+      if (LATCHING)
+        latch_wait();
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) // Timer2 ISR walks relays, it must not see table half shifted
+      {
+        removed = relays[removed_ndx];
+        for (uint8_t i = removed_ndx; i + 1 < count.relays; i++)
+          relays[i] = relays[i + 1];
+        count.relays--;
+        relays[count.relays].pulse_left = 0; // last slot is copy of shifted relay
+      }
+      relay_mode(&removed, INPUT);
+      if (USAGE)
+      {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+          USAGE_RELAY_T *counters = usage.counters.relays;
+          memmove(&counters[removed_ndx], &counters[removed_ndx + 1], (count.relays - removed_ndx) * sizeof(USAGE_RELAY_T));
+          memset(&counters[count.relays], 0, sizeof(USAGE_RELAY_T));
+        }
+        usage_rom(&usage, 'S');
+      }
+      light.max_light_mode = power(2, count.relays) - 1;
+      if (light.light_mode > light.max_light_mode)
+        light.light_mode = light.max_light_mode;
+      if (SEQUENCE)
+      {
+        // steps keep their relays: bit of removed relay is dropped, higher bits move down
+        uint8_t low = (1 << removed_ndx) - 1;
+        for (uint8_t i = 0; i < sequence.steps; i++)
+          sequence.masks[i] = (sequence.masks[i] & low) | (sequence.masks[i] >> 1 & ~low);
+        sequence_rom(&sequence, 'S');
+        sequence_fit();
+      }
+      job_start(JOB_DEV_TABLE);
+    }
+  }
+  else
+  {
+    Serial.println(F("Device to remove not found"));
+  }
+}
+
+int clean_rom(void)
+{
+  for (uint16_t i = 0; i < rom.length(); i++)
+    rom.put(i, 0);
+
+  return 1;
+}
+
+int dev_count_rom(DEV_CNT_T *cnt, char action)
+{
+  uint16_t address = DEV_CNT_OFFSET;
+
+  if (action == 'S')
+  {
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'D');
+    rom.put(address, *cnt);
+    return 1;
+  }
+  else if (action == 'L')
+  {
+    rom.get(address, *cnt);
+    return 1;
+  }
+  return 0;
+}
+
+int config_rom(CONFIG *cfg, char action)
+{
+  uint16_t address = CONFIG_OFFSET;
+
+  if (action == 'S')
+  {
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'C');
+    rom.put(address, *cfg);
+    return 1;
+  }
+  else if (action == 'L')
+  {
+    rom.get(address, *cfg);
+    return 1;
+  }
+
+  return 0;
+}
+
+void zc_init(void)
+{
+  // Timer1 counts freely with 0.5us resolution. Zero crossing captured by ICP1 (or generated by compare B in synthetic mode),
+  // relay switching scheduled by compare A
+  pinMode(ZC_PIN, INPUT);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    TCCR1A = 0;
+    TCCR1B = _BV(ICNC1) | _BV(ICES1) | _BV(CS11); // noise canceler, rising edge, prescaler 8
+    TCNT1 = 0;
+    TIFR1 = _BV(ICF1) | _BV(OCF1A) | _BV(OCF1B);
+    if (ZC_SYNTHETIC)
+    {
+      OCR1B = ZC_SYNTH_HALF_PERIOD_US * ZC_TICKS_PER_US;
+      TIMSK1 = _BV(OCIE1B);
+    }
+    else
+    {
+      TIMSK1 = _BV(ICIE1);
+    }
+  }
+}
+
+void zc_on_crossing(uint16_t stamp)
+{
+  // Called from interrupt on every zero crossing. Tracks mains period and arms switching of next queued relay transition
+  uint16_t period = stamp - zc.last_capture;
+  uint8_t is_recent = zc.last_seen != 0 && millis() - zc.last_seen <= ZC_TIMEOUT_MS;
+
+  if (is_recent && zc.half_period > 1 && period < zc.half_period / 2)
+    return; // glitch on detector input
+
+  if (!is_recent)
+    zc.half_period = 1; // detector just appeared and period is unknown yet, 1 only marks detector present
+  else if (zc.half_period <= 1)
+    zc.half_period = period;
+  else
+    zc.half_period = (uint16_t)(((uint32_t)zc.half_period * 3 + period) / 4);
+
+  zc.last_capture = stamp;
+  zc.last_seen = millis();
+
+  if (zc.head != zc.tail && !zc.armed)
+  {
+    uint16_t at = stamp + zc.offset_us * ZC_TICKS_PER_US;
+    if ((int16_t)(at - TCNT1) < ZC_MIN_LEAD_TICKS) // offset shorter than interrupt latency
+      at = TCNT1 + ZC_MIN_LEAD_TICKS;
+    OCR1A = at;
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 |= _BV(OCIE1A);
+    zc.armed = 1;
+  }
+}
+
+#if ZERO_CROSS
+ISR(TIMER1_CAPT_vect)
+{
+  zc_on_crossing(ICR1);
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+  // synthetic zero crossing for simulation
+  uint16_t stamp = OCR1B;
+  OCR1B = stamp + ZC_SYNTH_HALF_PERIOD_US * ZC_TICKS_PER_US;
+  zc_on_crossing(stamp);
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+  uint8_t mask = zc.queue[zc.tail];
+  zc.tail = (zc.tail + 1) % ZC_QUEUE_LEN;
+
+  write_relays(mask);
+
+  // measuring actual phase of switching
+  uint16_t phase = (uint16_t)(TCNT1 - zc.last_capture) / ZC_TICKS_PER_US;
+  zc.phase_last = phase;
+  zc.phase_min = phase < zc.phase_min ? phase : zc.phase_min;
+  zc.phase_max = phase > zc.phase_max ? phase : zc.phase_max;
+  zc.switches++;
+  if (TRACE)
+    trace_end();
+
+  TIMSK1 &= ~_BV(OCIE1A);
+  zc.armed = 0;
+}
+#endif
+
+uint8_t zc_is_present(void)
+{
+  return zc.half_period != 0;
+}
+
+uint8_t zc_enqueue(uint8_t mask)
+{
+  // Put relay transition to queue. If queue is full the newest transition is replaced because only final state matters
+  uint8_t result = 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (zc.half_period != 0)
+    {
+      uint8_t next = (zc.head + 1) % ZC_QUEUE_LEN;
+      if (next == zc.tail)
+      {
+        zc.queue[(zc.head + ZC_QUEUE_LEN - 1) % ZC_QUEUE_LEN] = mask;
+      }
+      else
+      {
+        zc.queue[zc.head] = mask;
+        zc.head = next;
+      }
+      result = 1;
+    }
+  }
+  return result;
+}
+
+void zc_watchdog(void)
+{
+  // When zero crossings disappear relays are switched immediately and pending transitions are applied at once
+  uint8_t pending = 0;
+  uint8_t mask = 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (zc.half_period != 0 && millis() - zc.last_seen > ZC_TIMEOUT_MS)
+    {
+      zc.half_period = 0;
+      if (zc.head != zc.tail)
+      {
+        pending = 1;
+        mask = zc.queue[(zc.head + ZC_QUEUE_LEN - 1) % ZC_QUEUE_LEN];
+      }
+      zc.head = zc.tail = 0;
+      zc.armed = 0;
+      TIMSK1 &= ~_BV(OCIE1A);
+    }
+  }
+  if (pending)
+    write_relays(mask);
+}
+
+int zc_rom(ZERO_CROSS_T *z, char action)
+{
+  uint16_t address = ZC_CFG_OFFSET;
+
+  if (action == 'S')
+  {
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'Z');
+    uint16_t offset_us = z->offset_us; // only loop() writes it
+    rom.put(address, offset_us);
+    return 1;
+  }
+  else if (action == 'L')
+  {
+    uint16_t offset_us;
+    rom.get(address, offset_us);
+    if (offset_us > ZC_MAX_OFFSET_US) // erased or never saved
+      offset_us = ZC_OFFSET_US;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      z->offset_us = offset_us;
+    }
+    return 1;
+  }
+  return 0;
+}
+
+void ambient_init(void)
+{
+  // ADC converts sensor pin in free running mode with prescaler 128 (104us per conversion), every result is taken by
+  // ADC interrupt. Without sensor ADC is switched off
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ADCSRA = 0;
+    ambient.sum = 0;
+    ambient.samples = 0;
+    ambient.is_ready = 0;
+    if (ambient.pin != 0)
+    {
+      ADMUX = _BV(REFS0) | ((ambient.pin - A0) & 7); // AVcc reference, right adjusted result
+      ADCSRB = 0;                                    // free running
+      ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+    }
+  }
+}
+
+ISR(ADC_vect)
+{
+  ambient.sum += ADC;
+  if (++ambient.samples < (1U << AMBIENT_OVERSAMPLE_BITS))
+    return;
+  uint16_t block = ambient.sum >> (AMBIENT_OVERSAMPLE_BITS - 4); // average with 4 fractional bits
+  ambient.sum = 0;
+  ambient.samples = 0;
+  if (!ambient.is_ready)
+    ambient.filtered = block;
+  else
+    ambient.filtered += ((int16_t)(block - ambient.filtered) + (1 << (AMBIENT_FILTER_SHIFT - 1))) >> AMBIENT_FILTER_SHIFT; // rounded, plain shift settles low
+  ambient.level = ambient.filtered >> 6;
+  ambient.is_ready = 1;
+}
+
+void latch_init(void)
+{
+  // Timer2 ticks every 1ms in CTC mode, its interrupt is enabled only while some coil is pulsed
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22);
+  OCR2A = LATCH_TICK_TOP;
+  TIMSK2 = 0;
+}
+
+void latch_pulse(RELAY *relay, uint8_t to_state)
+{
+  // Energizes coil of to_state (opposite one is released first). Pulse lasts at least pulse_ms, first tick comes
+  // within 1ms. Called from loop() and from zero cross interrupt
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    fast_write(to_state ? &relay->reset_io : &relay->io, LOW);
+    fast_write(to_state ? &relay->io : &relay->reset_io, HIGH);
+    relay->state = to_state;
+    relay->pulse_left = relay->pulse_ms + 1;
+    TIMSK2 |= _BV(OCIE2A);
+  }
+}
+
+void latch_release(RELAY *relay)
+{
+  fast_write(&relay->io, LOW);
+  fast_write(&relay->reset_io, LOW);
+  relay->pulse_left = 0;
+}
+
+void latch_wait(void)
+{
+  // Waits until Timer2 ends running coil pulses, so pins of relays could be released without cutting them
+  uint32_t start = millis();
+  for (uint8_t i = 0; i < MAX_RELAYS; i++)
+  {
+    while (relays[i].pulse_left != 0 && millis() - start < LATCH_WAIT_MS)
+      frame_input();
+  }
+}
+
+ISR(TIMER2_COMPA_vect)
+{
+  // Whole table is scanned: relay being added gets its first pulse before it is counted
+  uint8_t is_pulsing = 0;
+  for (uint8_t i = 0; i < MAX_RELAYS; i++)
+  {
+    if (relays[i].pulse_left == 0)
+      continue;
+    if (--relays[i].pulse_left == 0)
+      latch_release(&relays[i]);
+    else
+      is_pulsing = 1;
+  }
+  if (!is_pulsing)
+    TIMSK2 &= ~_BV(OCIE2A);
+}
+
+uint8_t latch_check(const RELAY *relay)
+{
+  // Reset coil is on other relay pin, not used by I2C bus, and pulse is not zero
+  if (relay->reset_pin < START_REL_PIN || relay->reset_pin > END_REL_PIN || relay->reset_pin == relay->pin)
+    return 0;
+  if (I2C_IN_USE && (relay->reset_pin == I2C_SDA_PIN || relay->reset_pin == I2C_SCL_PIN))
+    return 0;
+  return relay->pulse_ms > 0;
+}
+
+int latch_rom(RELAY *relay, uint8_t relay_number, char action)
+{
+  // Reset pin and pulse of latching relay are kept apart from relay table, which has 2 bytes per relay
+  uint16_t address = LATCH_OFFSET + 2 * relay_number;
+
+  if (action == 'S')
+  {
+    rom.put(address, relay->reset_pin);
+    rom.put(address + 1, relay->pulse_ms);
+    return 1;
+  }
+  else if (action == 'L')
+  {
+    rom.get(address, relay->reset_pin);
+    rom.get(address + 1, relay->pulse_ms);
+    fast_pin_init(&relay->reset_io, relay->reset_pin);
+    return latch_check(relay);
+  }
+  else if (action == 'E')
+  {
+    rom.put(address, (uint8_t)0);
+    rom.put(address + 1, (uint8_t)0);
+    return 1;
+  }
+  return 0;
+}
+
+uint8_t ambient_mode(void)
+{
+  // Light mode for turning light on: 0 - last mode, AMBIENT_STAY_OFF - stay off. Without sensor (or before its
+  // first block) it is CONFIG.default_light_mode
+  if (!AMBIENT || ambient.pin == 0 || ambient.steps == 0 || !ambient.is_ready)
+    return config.default_light_mode;
+  uint8_t level = ambient.level;
+  for (uint8_t i = 0; i < ambient.steps; i++)
+  {
+    if (level <= ambient.thresholds[i])
+      return ambient.modes[i];
+  }
+  return 0;
+}
+
+int ambient_rom(AMBIENT_T *a, char action)
+{
+  uint16_t address = AMBIENT_OFFSET;
+
+  if (action == 'S')
+  {
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'A');
+    rom.put(address, a->pin);
+    rom.put(address + 1, a->steps);
+    rom.put(address + 2, a->thresholds);
+    rom.put(address + 2 + AMBIENT_STEPS, a->modes);
+    return 1;
+  }
+  else if (action == 'L')
+  {
+    rom.get(address, a->pin);
+    rom.get(address + 1, a->steps);
+    rom.get(address + 2, a->thresholds);
+    rom.get(address + 2 + AMBIENT_STEPS, a->modes);
+    if ((a->pin != 0 && (a->pin < board_sensor_first || a->pin > board_sensor_last)) || a->steps > AMBIENT_STEPS)
+    {
+      a->pin = 0; // erased or never saved
+      a->steps = 0;
+    }
+    return 1;
+  }
+  return 0;
+}
+
+uint16_t notify_devices(void)
+{
+  // Signature of device table: changes when device is added, removed or gets other pin or type
+  uint16_t signature = count.buttons << 4 | count.relays;
+  for (uint8_t i = 0; i < count.buttons; i++)
+    signature = signature * 31 + (buttons[i].pin << 8 | buttons[i].type);
+  for (uint8_t i = 0; i < count.relays; i++)
+    signature = signature * 31 + (relays[i].pin << 8 | relays[i].type);
+  return signature;
+}
+
+void notify_check(void)
+{
+  // Compares state with values of last record. Called at the end of loop(), so changes made by buttons and
+  // commands of one loop() give one record
+  uint16_t devices = notify_devices();
+  if (notify.is_started && notify.light_state == light.light_state && notify.light_mode == light.light_mode &&
+      notify.timeout == light.timeout && notify.devices == devices)
+    return;
+
+  if (notify.is_started)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) // counter is read by register map in TWI interrupt
+    {
+      notify.changes++;
+    }
+  }
+  notify.is_started = 1;
+  notify.light_state = light.light_state;
+  notify.light_mode = light.light_mode;
+  notify.timeout = light.timeout;
+  notify.devices = devices;
+  if (!config.notify)
+    return;
+#if BUS_MODE
+  if (config.bus_address != 0)
+    return; // node answers only to its frames
+#endif
+  notify_print();
+}
+
+void notify_print(void)
+{
+  char record[NOTIFY_FORMAT_LEN];
+  sprintf(record, NOTIFY_FORMAT, NOTIFY_VERSION, notify.changes, light.light_state, light.light_mode, light.timeout,
+          count.buttons, count.relays);
+  Serial.println(record);
+}
+
+void usage_cycle(uint8_t relay)
+{
+  // Relay is switched on: one more switch cycle. Called from zero cross interrupt too
+  if (relay >= MAX_RELAYS)
+    return;
+  usage.counters.relays[relay].cycles++;
+  if (usage.unsaved_cycles < 255)
+    usage.unsaved_cycles++;
+  usage.is_dirty = 1;
+}
+
+void usage_mode(uint8_t mode)
+{
+  // Light is lit in mode (0 - turned off). Coming to other mode is its activation
+  if (mode != 0 && mode != usage.mode)
+  {
+    usage.counters.modes[mode < USAGE_MODES ? mode : 0].activations++;
+    usage.is_dirty = 1;
+  }
+  usage.mode = mode;
+}
+
+void usage_check(void)
+{
+  // Counts on time once per second and starts save of changed counters
+  uint32_t now = millis();
+  while (now - usage.tick_ms >= 1000)
+  {
+    usage.tick_ms += 1000;
+    usage.counters.seconds++;
+    for (uint8_t i = 0; i < count.relays; i++)
+    {
+      if (relays[i].state == 1)
+      {
+        usage.counters.relays[i].on_s++;
+        usage.is_dirty = 1;
+      }
+    }
+    if (usage.mode != 0)
+      usage.counters.modes[usage.mode < USAGE_MODES ? usage.mode : 0].on_s++;
+  }
+
+  if (usage.is_saving)
+  {
+    usage_save_step();
+  }
+  else if (usage.is_dirty && (now - usage.saved_ms >= USAGE_SAVE_MIN * 60000UL || usage.unsaved_cycles >= USAGE_SAVE_CYCLES))
+  {
+    usage_rom(&usage, 'S');
+  }
+}
+
+void usage_save_step(void)
+{
+  // Writes changed bytes while ROM is ready, only bytes of one word per call. Word is copied with interrupts
+  // disabled, so cycles counted from interrupt don't tear it
+  const uint8_t words = sizeof(USAGE_COUNTERS_T) / sizeof(uint32_t);
+  while (usage.save_word < words && rom.is_ready())
+  {
+    if (usage.save_byte == 0)
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        usage.save_value = ((const uint32_t *)&usage.counters)[usage.save_word];
+      }
+    }
+    uint16_t address = USAGE_OFFSET + usage.save_word * sizeof(uint32_t) + usage.save_byte;
+    uint8_t value = usage.save_value >> (8 * usage.save_byte);
+    if (++usage.save_byte == sizeof(uint32_t))
+    {
+      usage.save_byte = 0;
+      usage.save_word++;
+    }
+    if (rom.read(address) != value)
+    {
+      rom.update(address, value); // starts write and returns without waiting for it
+      return;
+    }
+  }
+  if (usage.save_word == words)
+  {
+    usage.is_saving = 0;
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'U');
+  }
+}
+
+int usage_rom(USAGE_T *u, char action)
+{
+  // 'S' starts save in background (usage_save_step() from loop()), 'L' loads counters
+  if (action == 'S')
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      u->unsaved_cycles = 0;
+      u->is_dirty = 0;
+    }
+    u->saved_ms = millis();
+    u->save_word = 0;
+    u->save_byte = 0;
+    u->is_saving = 1;
+    return 1;
+  }
+  else if (action == 'L')
+  {
+    rom.get(USAGE_OFFSET, u->counters);
+    uint32_t *words = (uint32_t *)&u->counters;
+    for (uint8_t i = 0; i < sizeof(USAGE_COUNTERS_T) / sizeof(uint32_t); i++)
+    {
+      if (words[i] == 0xFFFFFFFFUL)
+        words[i] = 0; // never written memory
+    }
+    return 1;
+  }
+  return 0;
+}
+
+void usage_print(void)
+{
+  // Days left are estimated from switching rate over counted time, so they appear after first counted day
+  uint32_t seconds;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    seconds = usage.counters.seconds;
+  }
+  uint32_t days = seconds / 86400UL;
+  char counters_print[USAGE_RELAY_FORMAT_LEN];
+  sprintf(counters_print, USAGE_FORMAT, (unsigned long)(seconds / 3600UL));
+  Serial.println(counters_print);
+
+  for (uint8_t i = 0; i < count.relays; i++)
+  {
+    USAGE_RELAY_T counters;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      counters = usage.counters.relays[i];
+    }
+    uint32_t life = counters.life_cycles ? counters.life_cycles : USAGE_LIFE_CYCLES;
+    sprintf(counters_print, USAGE_RELAY_FORMAT, i, (unsigned long)counters.cycles, (unsigned long)life,
+            (unsigned long)(counters.on_s / 3600UL));
+    Serial.print(counters_print);
+    if (counters.cycles > 0 && days > 0)
+    {
+      // days left = left cycles / cycles per day. Both cycle counts are scaled down together to fit 32 bit product
+      uint32_t left = counters.cycles < life ? life - counters.cycles : 0;
+      uint32_t cycles = counters.cycles;
+      while (left > 0xFFFFFFFFUL / days)
+      {
+        left >>= 1;
+        cycles >>= 1;
+      }
+      Serial.print(F(USAGE_DAYS_LEFT));
+      Serial.print(cycles ? left * days / cycles : 0);
+    }
+    Serial.println();
+  }
+
+  for (uint8_t i = 0; i < USAGE_MODES; i++)
+  {
+    USAGE_MODE_T counters = usage.counters.modes[i]; // changed only by loop()
+    if (counters.activations == 0)
+      continue;
+    sprintf(counters_print, USAGE_MODE_FORMAT, i, (unsigned long)counters.activations, (unsigned long)(counters.on_s / 3600UL));
+    Serial.println(counters_print);
+  }
+}
+
+void sequence_fit(void)
+{
+  // Called when relay count changes. Relays which aren't present are left out of step modes
+  for (uint8_t i = 0; i < sequence.steps; i++)
+  {
+    uint8_t mode = sequence.masks[i] & light.max_light_mode;
+    sequence.modes[i] = mode != 0 ? mode : light.max_light_mode;
+  }
+  sequence.step = sequence_find(light.light_mode);
+}
+
+uint8_t sequence_find(uint8_t mode)
+{
+  // Step lighting mode, so double-click continues from it. First one when mode is in list twice
+  for (uint8_t i = 0; i < sequence.steps; i++)
+  {
+    if (sequence.modes[i] == mode)
+      return i;
+  }
+  return SEQUENCE_NONE;
+}
+
+uint8_t sequence_find_name(const char *name)
+{
+  char step_name[SEQUENCE_NAME_LEN];
+  for (uint8_t i = 0; i < sequence.steps; i++)
+  {
+    sequence_name_rom(i, step_name, 'L');
+    if (step_name[0] != 0 && strcmp(step_name, name) == 0)
+      return i;
+  }
+  return SEQUENCE_NONE;
+}
+
+int sequence_rom(SEQUENCE_T *s, char action)
+{
+  uint16_t address = SEQUENCE_OFFSET;
+
+  if (action == 'S')
+  {
+    if (EVLOG)
+      evlog_append(EV_ROM_WRITE, 'Q');
+    rom.put(address, s->steps);
+    rom.put(address + 1, s->masks);
+    return 1;
+  }
+  else if (action == 'L')
+  {
+    rom.get(address, s->steps);
+    rom.get(address + 1, s->masks);
+    if (s->steps > SEQUENCE_STEPS)
+      s->steps = 0; // erased or never saved
+    return 1;
+  }
+  return 0;
+}
+
+int sequence_name_rom(uint8_t step, char *name, char action)
+{
+  // name has SEQUENCE_NAME_LEN bytes
+  uint16_t address = SEQUENCE_NAME_OFFSET(step);
+
+  if (action == 'L' && job.type == JOB_SEQUENCE)
+  {
+    memcpy(name, job.image + address - (SEQUENCE_OFFSET), SEQUENCE_NAME_LEN); // ROM isn't written yet
+    return 1;
+  }
+  if (action == 'S')
+  {
+    for (uint8_t i = 0; i < SEQUENCE_NAME_LEN; i++)
+      rom.update(address + i, name[i]);
+    return 1;
+  }
+  else if (action == 'L')
+  {
+    for (uint8_t i = 0; i < SEQUENCE_NAME_LEN; i++)
+      name[i] = rom.read(address + i);
+    if ((uint8_t)name[0] == 0xFF)
+      name[0] = 0; // erased
+    name[SEQUENCE_NAME_LEN - 1] = 0;
+    return 1;
+  }
+  return 0;
+}
+
+void sequence_print(void)
+{
+  if (sequence.steps == 0)
+  {
+    Serial.println(F(SEQUENCE_ALL));
+    return;
+  }
+  for (uint8_t i = 0; i < sequence.steps; i++)
+  {
+    char step_print[SEQUENCE_FORMAT_LEN];
+    char name[SEQUENCE_NAME_LEN];
+    sprintf(step_print, SEQUENCE_FORMAT, i, sequence.modes[i]);
+    Serial.print(step_print);
+    sequence_name_rom(i, name, 'L');
+    if (name[0] != 0)
+    {
+      Serial.print(' ');
+      Serial.print(name);
+    }
+    if (i == sequence.step)
+      Serial.print(F(SEQUENCE_LIT));
+    Serial.println();
+  }
+}
+
+void regmap_init(void)
+{
+  // TWI answers to REGMAP_ADDRESS, every bus event is handled by TWI interrupt. Master provides pull-ups
+  regmap.status = REGMAP_STATUS_IDLE;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    TWAR = REGMAP_ADDRESS << 1;
+    TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT);
+  }
+}
+
+#if REGMAP // Wire library of STORAGE_I2C has own TWI interrupt
+ISR(TWI_vect)
+{
+  switch (TW_STATUS)
+  {
+  case TW_SR_SLA_ACK: // master starts writing, first byte is register pointer
+    regmap.is_pointer_set = 0;
+    break;
+  case TW_SR_DATA_ACK:
+    if (regmap.is_pointer_set)
+    {
+      regmap_write(regmap.pointer, TWDR);
+      regmap.pointer++;
+    }
+    else
+    {
+      regmap.pointer = TWDR;
+      regmap.is_pointer_set = 1;
+    }
+    break;
+  case TW_ST_SLA_ACK: // master reads from pointer set by previous write
+  case TW_ST_DATA_ACK:
+    TWDR = regmap_read(regmap.pointer);
+    regmap.pointer++;
+    break;
+  case TW_BUS_ERROR:
+    TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTO);
+    return;
+  default: // stop, repeated start, last byte taken by master
+    break;
+  }
+  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT);
+}
+#endif
+
+uint8_t regmap_read(uint8_t reg)
+{
+  // Called from TWI interrupt: only reads of state, no parsing
+  if (reg >= REG_BUTTONS && reg < REG_BUTTONS + 3 * MAX_BUTTONS)
+  {
+    uint8_t i = (reg - REG_BUTTONS) / 3;
+    if (i >= count.buttons)
+      return 0;
+    uint8_t field = (reg - REG_BUTTONS) % 3;
+    return field == 0 ? buttons[i].pin : field == 1 ? buttons[i].type : buttons[i].front;
+  }
+  if (reg >= REG_RELAYS && reg < REG_RELAYS + 2 * MAX_RELAYS)
+  {
+    uint8_t i = (reg - REG_RELAYS) / 2;
+    if (i >= count.relays)
+      return 0;
+    return (reg - REG_RELAYS) % 2 == 0 ? relays[i].pin : relays[i].type;
+  }
+  switch (reg)
+  {
+  case REG_VERSION:
+    return REGMAP_VERSION;
+  case REG_LIGHT_STATE:
+    return light.light_state;
+  case REG_LIGHT_MODE:
+    return light.light_mode;
+  case REG_MAX_MODE:
+    return light.max_light_mode;
+  case REG_TIMEOUT:
+    return light.timeout;
+  case REG_AVG_DURATION:
+    return light.avg_on_duration;
+  case REG_COUNTS:
+    return count.buttons << 4 | count.relays;
+  case REG_CHANGES_LOW:
+    regmap.changes_high = notify.changes >> 8;
+    return notify.changes;
+  case REG_CHANGES_HIGH:
+    return regmap.changes_high;
+  case REG_REJECTED:
+    return regmap.rejected;
+  case REG_COMMAND:
+    return regmap.command;
+  case REG_ARG_PIN:
+    return regmap.arg_pin;
+  case REG_ARG_TYPE:
+    return regmap.arg_type;
+  case REG_STATUS:
+    return regmap.status;
+  }
+  return 0;
+}
+
+void regmap_write(uint8_t reg, uint8_t value)
+{
+  // Called from TWI interrupt: value is kept for loop()
+  switch (reg)
+  {
+  case REG_LIGHT_STATE:
+    regmap.light_state = value;
+    regmap.pending |= REGMAP_PENDING_STATE;
+    break;
+  case REG_LIGHT_MODE:
+    regmap.light_mode = value;
+    regmap.pending |= REGMAP_PENDING_MODE;
+    break;
+  case REG_AVG_DURATION:
+    regmap.avg_duration = value;
+    regmap.pending |= REGMAP_PENDING_DURATION;
+    break;
+  case REG_ARG_PIN:
+    regmap.arg_pin = value;
+    break;
+  case REG_ARG_TYPE:
+    regmap.arg_type = value;
+    break;
+  case REG_COMMAND:
+    if (regmap.status == REGMAP_STATUS_PENDING)
+    {
+      regmap.rejected++; // previous command is not finished
+      break;
+    }
+    regmap.command = value;
+    regmap.status = REGMAP_STATUS_PENDING;
+    regmap.pending |= REGMAP_PENDING_COMMAND;
+    break;
+  default:
+    regmap.rejected++; // read-only register
+  }
 }
 
-int dev_count_rom(DEV_CNT_T *cnt, char action)
+void regmap_poll(void)
 {
-  uint16_t address = DEV_CNT_OFFSET;
+  // Executes register writes received since previous loop()
+  uint8_t pending, state, mode, duration, command, pin;
+  char type;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    pending = regmap.pending;
+    state = regmap.light_state;
+    mode = regmap.light_mode;
+    duration = regmap.avg_duration;
+    command = regmap.command;
+    pin = regmap.arg_pin;
+    type = regmap.arg_type;
+    regmap.pending = 0;
+    if (job.type != JOB_NONE)
+    {
+      // device commands write ROM, so they wait for running job. Status stays pending meanwhile
+      regmap.pending = pending & REGMAP_PENDING_COMMAND;
+      pending &= ~REGMAP_PENDING_COMMAND;
+    }
+  }
+  if (pending == 0)
+    return;
 
-  if (action == 'S')
+  if (pending & REGMAP_PENDING_STATE)
   {
-    EEPROM.put(address, *cnt);
-    return 1;
+    if (state <= 1)
+      toggle_light(&light, state, 'I');
+    else
+      regmap.rejected++;
   }
-  else if (action == 'L')
+  if ((pending & REGMAP_PENDING_MODE) && !change_light_mode(&light, mode))
+    regmap.rejected++;
+  if (pending & REGMAP_PENDING_DURATION)
   {
-    EEPROM.get(address, *cnt);
-    return 1;
+    if (duration <= MAX_AVG_DURATION)
+    {
+      light.avg_on_duration = duration;
+      if (EVLOG)
+        evlog_append(EV_AVG_DURATION, duration);
+    }
+    else
+    {
+      regmap.rejected++;
+    }
+  }
+  if (pending & REGMAP_PENDING_COMMAND)
+  {
+    // job started by register command isn't acknowledged on serial, master polls status register instead
+    cmdq.exec_flags = FRAME_BUS_SILENT;
+    regmap.status = regmap_command(command, pin, type) ? REGMAP_STATUS_DONE : REGMAP_STATUS_FAILED;
+  }
+}
+
+uint8_t regmap_command(uint8_t command, uint8_t pin, char type)
+{
+  // Device commands go through the same functions as serial ones. Returns 1 when device table is changed
+  char device[REGMAP_DEVICE_LEN];
+  DEV_CNT_T before = count;
+
+  if (STATIC_CONFIG)
+    return 0;
+  json_arena.reset(); // add_device parses description like command from serial
+  switch (command)
+  {
+  case REGMAP_CMD_ADD_BUTTON:
+    sprintf(device, "{\"pin\":%u,\"device\":\"B\"}", pin);
+    return add_device(device);
+  case REGMAP_CMD_ADD_RELAY:
+    sprintf(device, "{\"pin\":%u,\"device\":\"R\",\"type\":\"%c\"}", pin, type);
+    return add_device(device);
+  case REGMAP_CMD_REMOVE_BUTTON:
+    remove_device(pin, "B");
+    return count.buttons != before.buttons;
+  case REGMAP_CMD_REMOVE_RELAY:
+    remove_device(pin, "R");
+    return count.relays != before.relays;
   }
   return 0;
 }
 
-int config_rom(CONFIG *cfg, char action)
+#define EVLOG_DELTA_LEN(header) ((header & 3) == 3 ? 4 : (header & 3))
+#define EVLOG_ENTRY_LEN(header) (1 + EVLOG_DELTA_LEN(header) + ((header >> 2) & 1))
+
+void evlog_append(uint8_t type, int16_t arg)
 {
-  uint16_t address = CONFIG_OFFSET;
+  // Appends event to SRAM ring. arg < 0 - event without argument. Oldest entries are dropped when ring is full
+  uint32_t now = millis();
+  uint32_t delta = now - evlog.last_time;
+  uint8_t code = delta == 0 ? 0 : (delta <= 0xFF ? 1 : (delta <= 0xFFFF ? 2 : 3));
+  uint8_t header = (type << 4) | ((arg >= 0) << 2) | code;
+  uint8_t len = EVLOG_ENTRY_LEN(header);
+
+  while ((uint8_t)(EVLOG_SIZE - (uint8_t)(evlog.head - evlog.tail)) < len)
+    evlog_drop();
+
+  evlog.buf[evlog.head++ & (EVLOG_SIZE - 1)] = header;
+  for (uint8_t i = 0; i < EVLOG_DELTA_LEN(header); i++)
+  {
+    evlog.buf[evlog.head++ & (EVLOG_SIZE - 1)] = (uint8_t)delta;
+    delta >>= 8;
+  }
+  if (arg >= 0)
+    evlog.buf[evlog.head++ & (EVLOG_SIZE - 1)] = (uint8_t)arg;
 
-  if (action == 'S')
+  evlog.last_time = now;
+}
+
+uint32_t evlog_read_delta(const uint8_t *buf, uint8_t mask, uint8_t pos, uint8_t header)
+{
+  // Decodes little endian time delta following header at pos
+  uint32_t delta = 0;
+  for (uint8_t i = 0; i < EVLOG_DELTA_LEN(header); i++)
+    delta |= (uint32_t)buf[(uint8_t)(pos + 1 + i) & mask] << (8 * i);
+  return delta;
+}
+
+void evlog_drop(void)
+{
+  // Removes oldest entry. Its time delta is moved to base_time so absolute time of next entries is kept
+  uint8_t header = evlog.buf[evlog.tail & (EVLOG_SIZE - 1)];
+  uint8_t is_unflushed = evlog.flush_pos == evlog.tail;
+
+  evlog.base_time += evlog_read_delta(evlog.buf, EVLOG_SIZE - 1, evlog.tail, header);
+  evlog.tail += EVLOG_ENTRY_LEN(header);
+  if (is_unflushed)
   {
-    EEPROM.put(address, *cfg);
-    return 1;
+    // entry is lost for EEPROM too
+    evlog.flush_pos = evlog.tail;
+    evlog.flush_time = evlog.base_time;
   }
-  else if (action == 'L')
+}
+
+void evlog_print_entries(const uint8_t *buf, uint8_t mask, uint8_t from, uint8_t to, uint32_t time)
+{
+  // Streams decoded entries line by line: "<time ms> <event> [<argument>]"
+  const char names[] = LOG_NAMES;
+  while (from != to)
   {
-    EEPROM.get(address, *cfg);
-    return 1;
+    uint8_t header = buf[from & mask];
+    uint8_t type = header >> 4;
+    time += evlog_read_delta(buf, mask, from, header);
+    Serial.print(time);
+    Serial.print(' ');
+    Serial.print(type < sizeof(names) - 1 ? names[type] : '?');
+    if ((header >> 2) & 1)
+    {
+      uint8_t arg = buf[(uint8_t)(from + EVLOG_ENTRY_LEN(header) - 1) & mask];
+      Serial.print(' ');
+      if (type == EV_LIGHT)
+      {
+        Serial.print(arg >> 7);
+        Serial.print(' ');
+        Serial.print((char)(arg & 0x7F));
+      }
+      else if (type == EV_ROM_WRITE)
+        Serial.print((char)arg);
+      else if (type == EV_TIMEOUT_ADJ)
+        Serial.print((int8_t)arg);
+      else
+        Serial.print(arg);
+    }
+    Serial.println();
+    from += EVLOG_ENTRY_LEN(header);
   }
+}
 
-  return 0;
-}
\ No newline at end of file
+void evlog_dump(uint8_t from_rom)
+{
+  if (!from_rom)
+  {
+    evlog_print_entries(evlog.buf, EVLOG_SIZE - 1, evlog.tail, evlog.head, evlog.base_time);
+    return;
+  }
+
+  // slots are printed from oldest to newest, every slot is read to small buffer before printing
+  uint8_t slot_buf[EVLOG_ROM_SLOT_SIZE - 6];
+  for (uint8_t n = 0; n < EVLOG_ROM_SLOTS; n++)
+  {
+    uint16_t address = EVLOG_ROM_OFFSET + ((evlog.rom_slot + n) % EVLOG_ROM_SLOTS) * EVLOG_ROM_SLOT_SIZE;
+    uint8_t len = rom.read(address + 1);
+    uint32_t time;
+    if (len == 0 || len > sizeof(slot_buf))
+      continue;
+    rom.get(address + 2, time);
+    for (uint8_t i = 0; i < len; i++)
+      slot_buf[i] = rom.read(address + 6 + i);
+    Serial.print(F("# slot "));
+    Serial.println(rom.read(address));
+    // slot buffer is not a ring so mask covers whole index range
+    evlog_print_entries(slot_buf, 0xFF, 0, len, time);
+  }
+}
+
+void evlog_flush(uint8_t force)
+{
+  // Starts writing unflushed entries to next EEPROM slot when enough bytes collected or flush period expired
+  uint8_t unflushed = evlog.head - evlog.flush_pos;
+
+  if (unflushed == 0)
+    return;
+  if (!force && unflushed < EVLOG_FLUSH_BATCH && millis() - evlog.flushed_at < EVLOG_FLUSH_PERIOD_MS)
+    return;
+
+  job_start(JOB_EVLOG); // slot is written in background like device table
+}
+
+void evlog_rom_scan(void)
+{
+  // Looks for slot written last to continue writing after it. Newest slot is the one next slot of which does not continue sequence
+  uint8_t newest = EVLOG_ROM_SLOTS;
+  uint8_t payload = EVLOG_ROM_SLOT_SIZE - 6;
+
+  for (uint8_t i = 0; i < EVLOG_ROM_SLOTS; i++)
+  {
+    uint16_t address = EVLOG_ROM_OFFSET + i * EVLOG_ROM_SLOT_SIZE;
+    uint8_t len = rom.read(address + 1);
+    if (len == 0 || len > payload)
+      continue;
+    uint8_t seq = rom.read(address);
+    uint16_t next_address = EVLOG_ROM_OFFSET + ((i + 1) % EVLOG_ROM_SLOTS) * EVLOG_ROM_SLOT_SIZE;
+    uint8_t next_len = rom.read(next_address + 1);
+    if (next_len == 0 || next_len > payload || rom.read(next_address) != (uint8_t)(seq + 1))
+    {
+      newest = i;
+      evlog.rom_seq = seq + 1;
+      break;
+    }
+  }
+  evlog.rom_slot = newest == EVLOG_ROM_SLOTS ? 0 : (newest + 1) % EVLOG_ROM_SLOTS;
+  if (newest == EVLOG_ROM_SLOTS)
+    evlog.rom_seq = 0;
+}
+
+void trace_watch_pin(uint8_t pin)
+{
+  // Enables pin change interrupt for button pin to stamp its edges
+  uint8_t group = board_pcint_group(pin);
+  if (group == BOARD_NO_PCINT)
+    return;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    *board_pcmsk_reg(group) |= board_mask(pin);
+    PCICR |= _BV(group);
+  }
+}
+
+void trace_on_pin_change(void)
+{
+  // Called from interrupt. Stamps first edge of every button which pin differs from handled state
+  uint32_t now = micros() | 1; // 0 means no edge
+  for (int i = 0; i < count.buttons; i++)
+  {
+    if (buttons[i].trace_us == 0 && fast_read(&buttons[i].io) != buttons[i].last_pin_state)
+      buttons[i].trace_us = now;
+  }
+}
+
+#if TRACE && TRACE_PCINT
+ISR(PCINT0_vect)
+{
+  trace_on_pin_change();
+}
+
+ISR(PCINT2_vect)
+{
+  trace_on_pin_change();
+}
+#endif
+
+void trace_begin(uint8_t path, uint32_t start_us)
+{
+  // Starts traced action. It is finished by trace_end() when relays are written
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    trace.path = path;
+    trace.start_us = start_us;
+    trace.pending = 1;
+  }
+}
+
+void trace_end(void)
+{
+  // Puts latency of pending action to histogram of its path. Could be called from interrupt
+  if (!trace.pending)
+    return;
+
+  uint32_t latency = micros() - trace.start_us;
+  uint8_t bucket = 0;
+  for (uint32_t l = latency >> 10; l != 0 && bucket < TRACE_BUCKETS - 1; l >>= 1)
+    bucket++;
+
+  if (trace.hist[trace.path][bucket] != 0xFFFF)
+    trace.hist[trace.path][bucket]++;
+  if (latency > trace.max_us[trace.path])
+    trace.max_us[trace.path] = latency;
+  trace.pending = 0;
+}
+
+void trace_dump(uint8_t reset)
+{
+  // Prints histograms for every path: "<upper bound us>:<count>" for nonempty buckets
+  const char *names[TRACE_PATHS] = {"click", "double", "locked", "serial"};
+  for (uint8_t p = 0; p < TRACE_PATHS; p++)
+  {
+    uint16_t hist[TRACE_BUCKETS];
+    uint16_t total = 0;
+    uint32_t max_us;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      memcpy(hist, trace.hist[p], sizeof(hist));
+      max_us = trace.max_us[p];
+      if (reset)
+      {
+        memset(trace.hist[p], 0, sizeof(trace.hist[p]));
+        trace.max_us[p] = 0;
+      }
+    }
+    for (uint8_t b = 0; b < TRACE_BUCKETS; b++)
+      total += hist[b];
+
+    char latency_print[LATENCY_FORMAT_LEN];
+    sprintf(latency_print, LATENCY_FORMAT, names[p], total, (unsigned long)max_us);
+    Serial.println(latency_print);
+    for (uint8_t b = 0; b < TRACE_BUCKETS; b++)
+    {
+      if (hist[b] == 0)
+        continue;
+      if (b == TRACE_BUCKETS - 1)
+        Serial.print('>');
+      else
+        Serial.print('<');
+      Serial.print(1UL << (b == TRACE_BUCKETS - 1 ? 9 + b : 10 + b));
+      Serial.print(':');
+      Serial.println(hist[b]);
+    }
+  }
+}
+
+void job_start(uint8_t type)
+{
+  // Prepares background job. Device table image is taken at start, so later RAM changes don't affect it
+  job.type = type;
+  job.seq = cmdq.exec_seq;
+  job.bus_flags = cmdq.exec_flags;
+  job.progress = 0;
+  job.dropped = 0;
+  job.len = 0;
+  job.segs = 0;
+  if (type == JOB_CLEAR_ROM)
+  {
+    job_segment(0, CAPTURE ? CAPTURE_ROM_OFFSET : rom.length()); // capture of this boot is kept
+  }
+  else if (type == JOB_DEV_TABLE)
+  {
+    // same layout as config_rom(), m_state_rom(), button_rom(), relay_rom(), latch_rom() and debounce_rom() use.
+    // Unused slots are erased with 0. Count is written last, so it never covers slots which are not written yet
+    memset(job.image, 0, sizeof(job.image));
+    uint8_t *image = job_segment(CONFIG_OFFSET, DEV_CNT_OFFSET - (CONFIG_OFFSET));
+    memcpy(image, &config, sizeof(CONFIG));
+    image[M_STATE_OFFSET - (CONFIG_OFFSET)] = light.avg_on_duration;
+    image[M_STATE_OFFSET - (CONFIG_OFFSET) + sizeof(light.avg_on_duration)] = light.light_mode;
+    if (config.init_light_state == 3)
+      *job_segment(LIGHT_STATE_OFFSET, sizeof(uint8_t)) = light.light_state;
+    image = job_segment(BUTTON_OFFSET, EXT_OFFSET - (BUTTON_OFFSET));
+    for (uint8_t i = 0; i < MAX_BUTTONS; i++, image += 3)
+    {
+      if (i >= count.buttons)
+        continue;
+      image[0] = buttons[i].pin;
+      image[1] = buttons[i].type;
+      image[2] = buttons[i].front;
+    }
+    for (uint8_t i = 0; i < MAX_RELAYS; i++, image += 2)
+    {
+      if (i >= count.relays)
+        continue;
+      image[0] = relays[i].pin;
+      image[1] = relays[i].type;
+    }
+    if (LATCHING)
+    {
+      image = job_segment(LATCH_OFFSET, 2 * MAX_RELAYS);
+      for (uint8_t i = 0; i < count.relays; i++)
+      {
+        if (relays[i].type != 'P')
+          continue;
+        image[2 * i] = relays[i].reset_pin;
+        image[2 * i + 1] = relays[i].pulse_ms;
+      }
+    }
+    image = job_segment(DEBOUNCE_OFFSET, MAX_BUTTONS);
+    for (uint8_t i = 0; i < count.buttons; i++)
+      image[i] = buttons[i].debounce_us / DEBOUNCE_UNIT_US;
+    memcpy(job_segment(DEV_CNT_OFFSET, sizeof(DEV_CNT_T)), &count, sizeof(DEV_CNT_T));
+  }
+  else if (type == JOB_SEQUENCE)
+  {
+    // same layout as sequence_rom() and sequence_name_rom() use. Names are copied by caller, unused ones are erased with 0
+    memset(job.image, 0, sizeof(job.image));
+    job.image[0] = sequence.steps;
+    memcpy(job.image + 1, sequence.masks, SEQUENCE_STEPS);
+    job_segment(SEQUENCE_OFFSET, JOB_SEQUENCE_SIZE);
+  }
+  else if (type == JOB_EVLOG)
+  {
+    // slot header and whole entries fitting slot, entries are marked flushed at once so dropping them later is safe
+    job.bus_flags = FRAME_BUS_SILENT; // log isn't command of host
+    uint8_t payload = EVLOG_ROM_SLOT_SIZE - 6;
+    uint8_t len = 0;
+    uint32_t time = evlog.flush_time;
+    uint8_t pos = evlog.flush_pos;
+    while (pos != evlog.head)
+    {
+      uint8_t header = evlog.buf[pos & (EVLOG_SIZE - 1)];
+      uint8_t entry_len = EVLOG_ENTRY_LEN(header);
+      if (len + entry_len > payload)
+        break;
+      time += evlog_read_delta(evlog.buf, EVLOG_SIZE - 1, pos, header);
+      job.image[6 + len] = header;
+      for (uint8_t i = 1; i < entry_len; i++)
+        job.image[6 + len + i] = evlog.buf[(uint8_t)(pos + i) & (EVLOG_SIZE - 1)];
+      len += entry_len;
+      pos += entry_len;
+    }
+    job.image[0] = evlog.rom_seq;
+    job.image[1] = len;
+    memcpy(job.image + 2, &evlog.flush_time, sizeof(uint32_t)); // same byte order as rom.put()
+    job_segment(EVLOG_ROM_OFFSET + evlog.rom_slot * EVLOG_ROM_SLOT_SIZE, 6 + len);
+
+    evlog.flush_pos = pos;
+    evlog.flush_time = time;
+    evlog.flushed_at = millis();
+    evlog.rom_slot = (evlog.rom_slot + 1) % EVLOG_ROM_SLOTS;
+    evlog.rom_seq++;
+  }
+  job.pos = 0;
+  job.seg = 0;
+  job.address = job.seg_start[0];
+  job.end = job.address + job.seg_len[0];
+}
+
+uint8_t *job_segment(uint16_t address, uint16_t len)
+{
+  // Appends ROM range to job and returns place of its bytes in image
+  uint8_t *image = job.image + job.len;
+  if (len && job.segs < JOB_SEGMENTS)
+  {
+    job.seg_start[job.segs] = address;
+    job.seg_len[job.segs] = len;
+    job.segs++;
+    job.len += len;
+  }
+  return image;
+}
+
+uint8_t job_step(uint32_t budget_us)
+{
+  // Writes bytes while EEPROM is ready and budget is not spent. Returns 1 when job is finished
+  uint32_t start = micros();
+  while (job.type != JOB_NONE && rom.is_ready() && micros() - start < budget_us)
+  {
+    uint8_t value = job.type == JOB_CLEAR_ROM ? 0 : job.image[job.pos];
+    rom.update(job.address, value); // starts write and returns without waiting for it
+    job.address++;
+    job.pos++;
+    if (job.address >= job.end && job.seg + 1 < job.segs)
+    {
+      job.seg++;
+      job.address = job.seg_start[job.seg];
+      job.end = job.address + job.seg_len[job.seg];
+    }
+
+    uint8_t progress = (uint32_t)job.pos * 100 / job.len;
+    if (progress / 10 != job.progress / 10 && job.pos != job.len && !(job.bus_flags & FRAME_BUS_SILENT))
+    {
+      bus_driver(job.bus_flags & FRAME_BUS_REPLY);
+      Serial.print('@');
+      Serial.print(job.seq);
+      Serial.print(F(" " ACK_PROGRESS " "));
+      Serial.println(progress);
+      bus_driver(0);
+    }
+    job.progress = progress;
+
+    if (job.pos >= job.len)
+    {
+      if (EVLOG && job.type != JOB_EVLOG)
+        evlog_append(EV_ROM_WRITE, job.type == JOB_CLEAR_ROM ? 'X' : job.type == JOB_DEV_TABLE ? 'D' : 'Q');
+      if (job.type == JOB_CLEAR_ROM && EVLOG && EVLOG_PERSIST)
+        evlog_rom_scan();
+      job.type = JOB_NONE;
+      if (CMD_ACK)
+        bus_ack(job.seq, F(ACK_DONE), job.bus_flags);
+      for (uint8_t i = 1; i <= job.dropped; i++)
+        bus_ack(job.seq + i, F(ACK_DROPPED), job.bus_flags);
+      return 1;
+    }
+  }
+  return job.type == JOB_NONE;
+}
+
+void capture_start(void)
+{
+  // Boot image: settings and device table, zero cross offset, light state kept over reboot, latching relays, double-click
+  // sequence and debounce intervals
+  capture.len = 0;
+  capture.base = 0;
+  capture.saved = 0;
+  capture.last_time = 0; // time of entries is counted from reset like millis()
+  capture_rom(CONFIG_OFFSET, ZC_CFG_OFFSET + sizeof(uint16_t));
+  capture_rom(LIGHT_STATE_OFFSET, 1);
+  if (LATCHING)
+    capture_rom(LATCH_OFFSET, 2 * MAX_RELAYS);
+  if (SEQUENCE)
+    capture_rom(SEQUENCE_OFFSET, 1 + SEQUENCE_STEPS);
+  capture_rom(DEBOUNCE_OFFSET, MAX_BUTTONS);
+}
+
+uint8_t capture_begin(uint8_t type, uint8_t payload)
+{
+  // Writes header and time delta of new entry. Returns 0 if entry with payload bytes doesn't fit, capture stops then
+  uint32_t now = millis();
+  uint32_t delta = now - capture.last_time;
+  uint8_t code = delta == 0 ? 0 : (delta <= 0xFF ? 1 : (delta <= 0xFFFF ? 2 : 3));
+  uint8_t header = (type << 4) | code;
+  uint16_t size = 1 + EVLOG_DELTA_LEN(header) + payload;
+
+  if (capture.len + size > CAPTURE_SIZE && capture.saved != 0)
+  {
+    // bytes already in ROM leave buf
+    memmove(capture.buf, capture.buf + capture.saved, capture.len - capture.saved);
+    capture.len -= capture.saved;
+    capture.base += capture.saved;
+    capture.saved = 0;
+  }
+  if (capture.is_full || capture.len + size > CAPTURE_SIZE ||
+      CAPTURE_ROM_OFFSET + capture.base + capture.len + size > rom.length())
+  {
+    capture.is_full = 1;
+    return 0;
+  }
+  capture.buf[capture.len++] = header;
+  for (uint8_t i = 0; i < EVLOG_DELTA_LEN(header); i++)
+  {
+    capture.buf[capture.len++] = (uint8_t)delta;
+    delta >>= 8;
+  }
+  capture.last_time = now;
+  return 1;
+}
+
+void capture_rom(uint16_t address, uint8_t len)
+{
+  if (!capture_begin(CAP_ROM, 3 + len))
+    return;
+  capture.buf[capture.len++] = (uint8_t)address;
+  capture.buf[capture.len++] = address >> 8;
+  capture.buf[capture.len++] = len;
+  for (uint8_t i = 0; i < len; i++)
+    capture.buf[capture.len++] = rom.read(address + i);
+}
+
+void capture_pins(void)
+{
+  // Raw levels of button pins once per loop(), bounces shorter than loop() are not seen like by firmware itself
+  for (uint8_t i = 0; i < count.buttons; i++)
+  {
+    uint8_t bit = 1 << i;
+    uint8_t level = fast_read(&buttons[i].io);
+    if ((capture.pins_known & bit) && ((capture.pins & bit) != 0) == level)
+      continue;
+    if (!capture_begin(CAP_PIN, 1))
+      return;
+    capture.buf[capture.len++] = (buttons[i].pin << 1) | level;
+    capture.pins = level ? (capture.pins | bit) : (capture.pins & ~bit);
+    capture.pins_known |= bit;
+  }
+}
+
+void capture_command(JsonDocument &json)
+{
+  // Command is recorded when it is executed, not its received bytes: "C" class command with only action, options and
+  // seq is catalog index and options text, other commands are whole text
+  int8_t index = -1; // names of catalog are linked with capture, help text only with HELP_CATALOG
+  if (strcmp(json["class"] | "", "C") == 0 &&
+      json.size() == 2U + json["options"].is<JsonVariant>() + json["seq"].is<JsonVariant>())
+    index = help_find(json["action"] | "");
+  JsonVariant text = index >= 0 ? json["options"] : json.as<JsonVariant>();
+  uint16_t len = text.isNull() ? 0 : measureJson(text);
+  if (len > 0xFF || !capture_begin(CAP_COMMAND, 2 + len + 1)) // serializeJson() needs place for terminating 0
+    return;
+  capture.buf[capture.len++] = index >= 0 ? index : CAPTURE_ANY_COMMAND;
+  capture.buf[capture.len++] = len;
+  if (len)
+    serializeJson(text, (char *)capture.buf + capture.len, len + 1);
+  capture.len += len;
+}
+
+void capture_save(void)
+{
+  // Copies one byte to ROM when it is ready, so loop() never waits for write. Jobs have priority
+  if (capture.saved < capture.len && job.type == JOB_NONE && rom.is_ready())
+  {
+    rom.update(CAPTURE_ROM_OFFSET + capture.base + capture.saved, capture.buf[capture.saved]);
+    capture.saved++;
+  }
+}
+
+uint8_t capture_byte(uint16_t pos)
+{
+  return pos < capture.base ? rom.read(CAPTURE_ROM_OFFSET + pos) : capture.buf[pos - capture.base];
+}
+
+void capture_relays(uint8_t mask)
+{
+  if (!capture_begin(CAP_RELAY, 1))
+    return;
+  capture.buf[capture.len++] = mask & ((1 << count.relays) - 1);
+}
+
+void capture_dump(void)
+{
+  // Streams entries with absolute time in ms. Dump command itself is recorded before, entries of its relays after it
+  const char names[] = "RPCO";
+  const char hex[] = "0123456789abcdef";
+  char capture_print[CAPTURE_FORMAT_LEN];
+  uint16_t len = capture.base + capture.len;
+  uint32_t time = 0;
+
+  sprintf(capture_print, CAPTURE_FORMAT, len, (unsigned)(rom.length() - CAPTURE_ROM_OFFSET), capture.is_full ? ", full" : "");
+  Serial.println(capture_print);
+  for (uint16_t pos = 0; pos < len;)
+  {
+    uint8_t header = capture_byte(pos++);
+    uint8_t type = header >> 4;
+    for (uint8_t i = 0; i < EVLOG_DELTA_LEN(header); i++)
+      time += (uint32_t)capture_byte(pos++) << (8 * i);
+    Serial.print(time);
+    Serial.print(' ');
+    Serial.print(names[type]);
+    Serial.print(' ');
+    if (type == CAP_PIN)
+    {
+      uint8_t level = capture_byte(pos++);
+      Serial.print(level >> 1);
+      Serial.print(' ');
+      Serial.println(level & 1);
+      continue;
+    }
+    if (type == CAP_RELAY)
+    {
+      Serial.println(capture_byte(pos++));
+      continue;
+    }
+    if (type == CAP_COMMAND)
+    {
+      uint8_t action = capture_byte(pos++);
+      const char *name = help_names;
+      for (uint8_t i = 0; i < action && action != CAPTURE_ANY_COMMAND; i++)
+        name += strlen_P(name) + 1;
+      if (action == CAPTURE_ANY_COMMAND)
+        Serial.print('-');
+      else
+        Serial.print((const __FlashStringHelper *)name);
+      Serial.print(' ');
+      uint8_t n = capture_byte(pos++);
+      for (uint8_t i = 0; i < n; i++)
+        Serial.print((char)capture_byte(pos++));
+      Serial.println();
+      continue;
+    }
+    Serial.print(capture_byte(pos) | (capture_byte(pos + 1) << 8));
+    Serial.print(' ');
+    pos += 2;
+    uint8_t n = capture_byte(pos++);
+    for (uint8_t i = 0; i < n; i++)
+    {
+      uint8_t byte = capture_byte(pos++);
+      Serial.print(hex[byte >> 4]);
+      Serial.print(hex[byte & 0x0F]);
+    }
+    Serial.println();
+  }
+}
+
+// Finds command in help catalog, returns its index or -1
+int8_t help_find(const char *name)
+{
+  const char *help_name = help_names;
+  for (uint8_t i = 0; i < HELP_COMMANDS; i++)
+  {
+    if (strcmp_P(name, help_name) == 0)
+      return i;
+    help_name += strlen_P(help_name) + 1;
+  }
+  return -1;
+}
+
+/* Expands one string of help_text from pos straight to Serial by HELP_CHUNK bytes, returns position of next string.
+   Rule is replaced by its left half while right one waits on stack, so only stack and chunk take RAM */
+uint16_t help_print(uint16_t pos)
+{
+  uint8_t stack[HELP_STACK_DEPTH];
+  uint8_t depth = 0;
+  uint8_t chunk[HELP_CHUNK];
+  uint8_t len = 0;
+  while (1)
+  {
+    uint8_t token;
+    if (depth > 0)
+    {
+      token = stack[--depth];
+    }
+    else
+    {
+      token = pgm_read_byte(&help_text[pos++]);
+      if (token == 0)
+        break;
+    }
+    while (token & 0x80)
+    {
+      stack[depth++] = pgm_read_byte(&help_rules[token & 0x7F][1]);
+      token = pgm_read_byte(&help_rules[token & 0x7F][0]);
+    }
+    chunk[len++] = token;
+    if (len == HELP_CHUNK)
+    {
+      Serial.write(chunk, len);
+      len = 0;
+    }
+  }
+  Serial.write(chunk, len);
+  return pos;
+}
+
+// Prints "name: description" of every command
+void help_list(void)
+{
+  const char *help_name = help_names;
+  for (uint8_t i = 0; i < HELP_COMMANDS; i++)
+  {
+    Serial.print(reinterpret_cast<const __FlashStringHelper *>(help_name));
+    Serial.print(F(": "));
+    help_print(pgm_read_word(&help_offsets[i]));
+    Serial.println();
+    help_name += strlen_P(help_name) + 1;
+  }
+}
+
+// Prints description, JSON example and errors of command
+void help_command(uint8_t index)
+{
+  uint16_t pos = help_print(pgm_read_word(&help_offsets[index]));
+  Serial.println();
+  Serial.print(F(HELP_EXAMPLE));
+  pos = help_print(pos);
+  Serial.println();
+  if (pgm_read_byte(&help_text[pos]) != 0)
+  {
+    Serial.println(F(HELP_ERRORS));
+    help_print(pos);
+    Serial.println();
+  }
+}
+
+#ifndef __AVR__
+#define FW_STATE_SIZE(var) +sizeof(var)
+#define FW_STATE_SAVE(var)                      \
+  memcpy(image, (const void *)&var, sizeof(var)); \
+  image += sizeof(var);
+#define FW_STATE_LOAD(var)                \
+  memcpy((void *)&var, image, sizeof(var)); \
+  image += sizeof(var);
+
+size_t fw_state_size(void)
+{
+  return 0 FW_STATE_LIST(FW_STATE_SIZE);
+}
+
+void fw_state_save(uint8_t *image)
+{
+  // Copies state of board running on this thread to image of fw_state_size() bytes
+  FW_STATE_LIST(FW_STATE_SAVE)
+}
+
+void fw_state_load(const uint8_t *image)
+{
+  FW_STATE_LIST(FW_STATE_LOAD)
+}
+#endif
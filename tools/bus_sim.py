@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Simulated RS-485 bus connecting several host builds of firmware (env:native_bus).
+
+Every node is a separate process. Bytes a node sends while its driver is enabled (stdout) are delivered to every
+other node and shown on console, like on real shared pair of wires. Bytes sent with driver disabled (stderr) only
+reach USB side of node and are shown with "usb" tag. Host lines are read from stdin or --script and sent to all nodes.
+
+Nodes without EEPROM file in --workdir are provisioned over their USB side with "bus" command before joining.
+Unicast lines (">5:{...}") wait for acknowledgement of addressed node, so host never talks over answer.
+
+Example:
+  pio run -e native_bus
+  tools/bus_sim.py .pio/build/native_bus/program --nodes 3 --groups 1:1,2:1,3:4
+  >*:{"class":"C","action":"light_state","options":[0]}
+  >g1:{"class":"C","action":"light_mode","options":[1]}
+  >3:{"class":"C","action":"status"}
+"""
+
+import argparse
+import os
+import re
+import selectors
+import subprocess
+import sys
+import time
+
+DE_PIN = 2              # BUS_DE_PIN of firmware
+ACK = re.compile(rb"^@\d+ (?!progress)")
+ACK_TIMEOUT_S = 5.0
+SILENT_GAP_S = 0.05     # pause after broadcast and group lines, nobody acknowledges them
+
+
+class Node:
+    def __init__(self, firmware, address, groups, workdir):
+        self.address = address
+        self.groups = groups
+        self.eeprom = os.path.join(workdir, "node%d.bin" % address)
+        self.is_new = not os.path.exists(self.eeprom)
+        env = dict(os.environ, HOST_EEPROM=self.eeprom, HOST_BUS_DE_PIN=str(DE_PIN))
+        self.proc = subprocess.Popen([firmware], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     stderr=subprocess.PIPE, env=env, bufsize=0)
+        self.bus_line = b""
+        self.usb_line = b""
+        self.joined = not self.is_new
+
+    def send(self, data):
+        self.proc.stdin.write(data)
+
+
+class Bus:
+    def __init__(self, nodes):
+        self.nodes = nodes
+        self.sel = selectors.DefaultSelector()
+        for node in nodes:
+            self.sel.register(node.proc.stdout, selectors.EVENT_READ, (node, True))
+            self.sel.register(node.proc.stderr, selectors.EVENT_READ, (node, False))
+        self.talker = None      # node which answer line is not finished
+        self.collisions = 0
+        self.acked = set()      # addresses which acknowledged since last unicast
+
+    def poll(self, timeout):
+        for key, _ in self.sel.select(timeout):
+            node, to_bus = key.data
+            data = os.read(key.fileobj.fileno(), 4096)
+            if not data:
+                self.sel.unregister(key.fileobj)
+                continue
+            if to_bus:
+                self.on_bus(node, data)
+            else:
+                self.on_usb(node, data)
+
+    def on_bus(self, node, data):
+        if self.talker is not None and self.talker is not node:
+            self.collisions += 1
+            print("!! collision: node %d talks over node %d" % (node.address, self.talker.address))
+        for other in self.nodes:
+            if other is not node and other.joined:
+                other.send(data)
+        node.bus_line += data
+        while b"\n" in node.bus_line:
+            line, node.bus_line = node.bus_line.split(b"\n", 1)
+            line = line.rstrip(b"\r")
+            print("[node %d] %s" % (node.address, line.decode(errors="replace")))
+            if ACK.match(line):
+                self.acked.add(node.address)
+        self.talker = node if node.bus_line else None
+
+    def on_usb(self, node, data):
+        node.usb_line += data
+        while b"\n" in node.usb_line:
+            line, node.usb_line = node.usb_line.split(b"\n", 1)
+            line = line.rstrip(b"\r")
+            if not node.joined and ACK.match(line):
+                node.joined = True
+                print("node %d provisioned: groups %d" % (node.address, node.groups))
+            elif node.joined and line:
+                print("[node %d usb] %s" % (node.address, line.decode(errors="replace")))
+
+    def host_line(self, line):
+        print("[host] %s" % line)
+        for node in self.nodes:
+            node.send(line.encode() + b"\n")
+        target = re.match(r"^>(\d+):", line)
+        if not target:
+            self.wait(SILENT_GAP_S)
+            return
+        address = int(target.group(1))
+        self.acked.discard(address)
+        deadline = time.time() + ACK_TIMEOUT_S
+        while address not in self.acked and time.time() < deadline:
+            self.poll(0.05)
+        if address not in self.acked:
+            print("!! node %d did not acknowledge" % address)
+
+    def wait(self, seconds):
+        deadline = time.time() + seconds
+        while time.time() < deadline:
+            self.poll(max(0.0, deadline - time.time()))
+
+
+def parse_groups(text):
+    groups = {}
+    for item in filter(None, (text or "").split(",")):
+        address, mask = item.split(":")
+        groups[int(address)] = int(mask)
+    return groups
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("firmware", help="host build of firmware with BUS_MODE=1")
+    parser.add_argument("--nodes", type=int, default=3, help="number of nodes, addresses 1..n")
+    parser.add_argument("--groups", help="group masks of nodes: address:mask,... (bit n - group n + 1)")
+    parser.add_argument("--workdir", default="bus_sim", help="directory for EEPROM files of nodes")
+    parser.add_argument("--script", help="file with host lines instead of stdin")
+    args = parser.parse_args()
+
+    os.makedirs(args.workdir, exist_ok=True)
+    groups = parse_groups(args.groups)
+    nodes = [Node(args.firmware, n, groups.get(n, 0), args.workdir) for n in range(1, args.nodes + 1)]
+    bus = Bus(nodes)
+    for node in nodes:
+        if node.is_new:
+            node.send(b'{"class":"C","action":"bus","options":[%d,%d]}\n' % (node.address, node.groups))
+    deadline = time.time() + ACK_TIMEOUT_S
+    while not all(node.joined for node in nodes) and time.time() < deadline:
+        bus.poll(0.05)
+
+    source = open(args.script) if args.script else sys.stdin
+    for line in source:
+        line = line.strip()
+        if line and not line.startswith("#"):
+            bus.host_line(line)
+    bus.wait(SILENT_GAP_S)
+
+    for node in nodes:
+        node.proc.stdin.close()
+    for node in nodes:
+        node.proc.wait()
+    bus.wait(0)
+    if bus.collisions:
+        print("!! %d collisions" % bus.collisions)
+    return 1 if bus.collisions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
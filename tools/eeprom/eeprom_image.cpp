@@ -0,0 +1,350 @@
+/* Settings compiler (env:eeprom_image): turns declarative settings of one mirror into EEPROM image, so units are
+   provisioned by programmer together with firmware instead of serial commands and learning presses of buttons.
+   Image is made by host build of firmware itself: settings are applied with its commands on fresh board with
+   cleared EEPROM, so layout and validation are always the firmware ones. Then image is booted on second board and
+   settings read back with "buttons", "relays", "status" and "ambient" are compared with declared ones.
+
+   eeprom_image [options] <settings file>
+   Settings file is JSON object, every section is optional:
+     {
+       "buttons":[[3,"M",0],[4,"L",1]], // [pin, type, front] like batch command
+       "relays":[["A0","L"],["A1","H"]], // [pin, polarity]
+       "config":[0,3,1],                 // like set_config options
+       "timeout":30,                     // average on duration, minutes
+       "light_mode":2,
+       "ambient":["A6",[[40,1],[255,3]]] // like ambient options
+     }
+   Options:
+     -o <file>   output image, Intel HEX or raw binary if name ends with .bin (default eeprom.hex)
+     -v          print firmware output
+   Exit code: 0 - image written and checked, 1 - settings rejected or check failed, 2 - bad arguments.
+   Image covers whole EEPROM of ATmega328P. Write it with ISP programmer, Nano bootloader can't write EEPROM:
+     avrdude -c usbasp -p m328p -U flash:w:firmware.hex:i -U eeprom:w:eeprom.hex:i
+   Image is for internal EEPROM build (STORAGE_EEPROM) with the same build flags as firmware flashed with it */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "host.h"
+
+void setup();
+void loop();
+uint8_t json_to_pin(JsonVariant value);
+
+#define IMAGE_CMD_TIMEOUT_US 10000000ULL
+#define IMAGE_SETTLE_US 1000000ULL // boot of image runs this long before settings are read back
+#define IMAGE_HEX_LINE 16
+
+struct IMAGE_BOARD
+{
+  HOST_BOARD board;
+  std::string line;
+  std::vector<std::string> lines; // output of firmware
+};
+
+static bool is_verbose = false;
+
+static void image_tx(HOST_BOARD *board, uint8_t byte, uint8_t to_bus)
+{
+  (void)to_bus;
+  IMAGE_BOARD *image = (IMAGE_BOARD *)board->user;
+  if (byte == '\r')
+    return;
+  if (byte != '\n')
+  {
+    image->line += (char)byte;
+    return;
+  }
+  if (is_verbose)
+    printf("  | %s\n", image->line.c_str());
+  image->lines.push_back(image->line);
+  image->line.clear();
+}
+
+// Starts firmware from pristine globals on board with given EEPROM
+static void image_boot(IMAGE_BOARD *image, const uint8_t *eeprom, const std::vector<uint8_t> &pristine)
+{
+  HOST_BOARD *board = &image->board;
+  host_board_init(board, 1);
+  board->tx = image_tx;
+  board->user = image;
+  memcpy(board->eeprom, eeprom, HOST_EEPROM_SIZE);
+  image->line.clear();
+  image->lines.clear();
+
+  host_board = board;
+  fw_state_load(pristine.data());
+  setup();
+}
+
+// Executes one command line, returns output printed before its acknowledgement
+static bool image_command(IMAGE_BOARD *image, const std::string &command, std::vector<std::string> *output)
+{
+  HOST_BOARD *board = &image->board;
+  std::string rx = command + "\n";
+  uint64_t deadline = host_now_us(board) + IMAGE_CMD_TIMEOUT_US;
+
+  if (is_verbose)
+    printf("  > %s\n", command.c_str());
+  image->lines.clear();
+  while (host_now_us(board) < deadline)
+  {
+    if (!rx.empty())
+      rx.erase(0, host_serial_feed(board, (const uint8_t *)rx.data(), rx.size()));
+    loop();
+    if (!image->lines.empty() && image->lines.back()[0] == '@')
+    {
+      bool is_done = image->lines.back().find(" done") != std::string::npos;
+      image->lines.pop_back();
+      *output = image->lines;
+      return is_done;
+    }
+  }
+  return false;
+}
+
+static std::string section(const char *name, JsonVariant value)
+{
+  char text[256];
+  serializeJson(value, text);
+  return std::string(",\"") + name + "\":" + text;
+}
+
+static bool starts_with(const std::vector<std::string> &output, const char *prefix)
+{
+  return !output.empty() && output[0].compare(0, strlen(prefix), prefix) == 0;
+}
+
+static bool fail(const char *what, const std::vector<std::string> &output)
+{
+  fprintf(stderr, "%s\n", what);
+  for (const std::string &line : output)
+    fprintf(stderr, "  %s\n", line.c_str());
+  return false;
+}
+
+// Applies settings with firmware commands on board with cleared EEPROM
+static bool image_compile(IMAGE_BOARD *image, JsonVariant settings, const std::vector<uint8_t> &pristine)
+{
+  std::vector<uint8_t> cleared(HOST_EEPROM_SIZE, 0);
+  std::vector<std::string> output;
+  image_boot(image, cleared.data(), pristine);
+
+  std::string batch = "{\"class\":\"C\",\"action\":\"batch\"";
+  const char *batch_sections[] = {"buttons", "relays", "config", "timeout"};
+  for (const char *name : batch_sections)
+    if (settings[name].is<JsonVariant>())
+      batch += section(name, settings[name]);
+  if (!image_command(image, batch + "}", &output) || !starts_with(output, "Batch applied"))
+    return fail("settings rejected by batch:", output);
+
+  if (settings["light_mode"].is<JsonVariant>())
+  {
+    std::string mode = std::to_string(settings["light_mode"].as<int>());
+    if (!image_command(image, "{\"class\":\"C\",\"action\":\"light_mode\",\"options\":[" + mode + "]}", &output) ||
+        !output.empty())
+      return fail("light_mode rejected:", output);
+  }
+
+  if (settings["ambient"].is<JsonVariant>())
+  {
+    if (!image_command(image, "{\"class\":\"C\",\"action\":\"ambient\"" + section("options", settings["ambient"]) + "}",
+                       &output) || !starts_with(output, "Ambient pin:"))
+      return fail("ambient rejected:", output);
+  }
+  return true;
+}
+
+// Value printed by firmware as "<name>: <value>" in n-th block of output (blocks of buttons and relays)
+static std::string field(const std::vector<std::string> &output, const char *name, int block)
+{
+  std::string prefix = std::string(name) + ": ";
+  for (const std::string &line : output)
+  {
+    if (line.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    if (block-- == 0)
+      return line.substr(prefix.size());
+  }
+  return "";
+}
+
+static bool expect(const char *what, int index, const std::string &read, const std::string &declared)
+{
+  if (read == declared)
+    return true;
+  fprintf(stderr, "check failed: %s %d read back as \"%s\", declared \"%s\"\n", what, index, read.c_str(), declared.c_str());
+  return false;
+}
+
+// Boots image and compares settings read back by firmware loaders with declared ones
+static bool image_check(IMAGE_BOARD *image, JsonVariant settings, const std::vector<uint8_t> &eeprom,
+                        const std::vector<uint8_t> &pristine)
+{
+  HOST_BOARD *board = &image->board;
+  std::vector<std::string> output;
+  bool is_ok = true;
+
+  image_boot(image, eeprom.data(), pristine);
+  while (host_now_us(board) < IMAGE_SETTLE_US)
+    loop();
+  if (board->eeprom_writes != 0)
+  {
+    fprintf(stderr, "check failed: firmware rewrote %u bytes of image during boot\n", board->eeprom_writes);
+    is_ok = false;
+  }
+
+  JsonVariant buttons = settings["buttons"];
+  image_command(image, "{\"class\":\"C\",\"action\":\"buttons\"}", &output);
+  for (size_t i = 0; i < buttons.size(); i++)
+  {
+    is_ok &= expect("button pin", i, field(output, "Pin", i), std::to_string(json_to_pin(buttons[i][0])));
+    is_ok &= expect("button type", i, field(output, "Type", i), buttons[i][1].as<const char *>());
+    is_ok &= expect("button front", i, field(output, "Front", i), std::to_string(buttons[i][2].as<int>()));
+  }
+
+  JsonVariant relays = settings["relays"];
+  image_command(image, "{\"class\":\"C\",\"action\":\"relays\"}", &output);
+  for (size_t i = 0; i < relays.size(); i++)
+  {
+    is_ok &= expect("relay pin", i, field(output, "Pin", i), std::to_string(json_to_pin(relays[i][0])));
+    is_ok &= expect("relay type", i, field(output, "Type", i), relays[i][1].as<const char *>());
+  }
+
+  image_command(image, "{\"class\":\"C\",\"action\":\"status\"}", &output);
+  if (buttons.is<JsonArray>())
+    is_ok &= expect("buttons count", 0, field(output, "Buttons count", 0), std::to_string(buttons.size()));
+  if (relays.is<JsonArray>())
+    is_ok &= expect("relays count", 0, field(output, "Relays count", 0), std::to_string(relays.size()));
+  if (settings["timeout"].is<JsonVariant>())
+    is_ok &= expect("timeout", 0, field(output, "Average duration", 0), std::to_string(settings["timeout"].as<int>()));
+  if (settings["light_mode"].is<JsonVariant>())
+    is_ok &= expect("light mode", 0, field(output, "Light mode", 0), std::to_string(settings["light_mode"].as<int>()));
+
+  JsonVariant ambient = settings["ambient"];
+  if (ambient.is<JsonVariant>())
+  {
+    image_command(image, "{\"class\":\"C\",\"action\":\"ambient\"}", &output);
+    std::string pin = "Ambient pin: " + std::to_string(json_to_pin(ambient[0]));
+    is_ok &= expect("ambient pin", 0, output.empty() ? "" : output[0].substr(0, output[0].find(',')), pin);
+    for (size_t i = 0; i < ambient[1].size(); i++)
+    {
+      std::string step = "Up to " + std::to_string(ambient[1][i][0].as<int>()) + ": mode " +
+                         std::to_string(ambient[1][i][1].as<int>());
+      is_ok &= expect("ambient step", i, i + 1 < output.size() ? output[i + 1] : "", step);
+    }
+  }
+  return is_ok;
+}
+
+static bool write_hex(const char *path, const std::vector<uint8_t> &image)
+{
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return false;
+  for (size_t address = 0; address < image.size(); address += IMAGE_HEX_LINE)
+  {
+    size_t len = image.size() - address < IMAGE_HEX_LINE ? image.size() - address : IMAGE_HEX_LINE;
+    uint8_t sum = len + (address >> 8) + address;
+    fprintf(file, ":%02X%04X00", (unsigned)len, (unsigned)address);
+    for (size_t i = 0; i < len; i++)
+    {
+      fprintf(file, "%02X", image[address + i]);
+      sum += image[address + i];
+    }
+    fprintf(file, "%02X\n", (uint8_t)-sum);
+  }
+  fprintf(file, ":00000001FF\n");
+  return fclose(file) == 0;
+}
+
+static bool write_bin(const char *path, const std::vector<uint8_t> &image)
+{
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+  size_t written = fwrite(image.data(), 1, image.size(), file);
+  return fclose(file) == 0 && written == image.size();
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: eeprom_image [-o image.hex|image.bin] [-v] <settings file>\n");
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  const char *out_path = "eeprom.hex";
+  int opt;
+
+  while ((opt = getopt(argc, argv, "o:v")) != -1)
+  {
+    switch (opt)
+    {
+    case 'o':
+      out_path = optarg;
+      break;
+    case 'v':
+      is_verbose = true;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind != argc - 1)
+    usage();
+
+  std::ifstream file(argv[optind]);
+  std::stringstream text;
+  text << file.rdbuf();
+  JsonDocument settings;
+  if (!file || deserializeJson(settings, text.str().c_str()) || !settings.is<JsonObject>())
+  {
+    fprintf(stderr, "%s: no JSON object of settings\n", argv[optind]);
+    return 2;
+  }
+  const char *known[] = {"buttons", "relays", "config", "timeout", "light_mode", "ambient"};
+  size_t known_count = 0;
+  for (const char *name : known)
+    known_count += settings[name].is<JsonVariant>();
+  if (known_count != settings.size())
+  {
+    fprintf(stderr, "%s: unknown section, expected only buttons, relays, config, timeout, light_mode, ambient\n",
+            argv[optind]);
+    return 2;
+  }
+
+  // globals of this thread never ran setup(), both boards start from copy of them
+  std::vector<uint8_t> pristine(fw_state_size());
+  fw_state_save(pristine.data());
+
+  static IMAGE_BOARD image;
+  if (!image_compile(&image, settings, pristine))
+    return 1;
+  std::vector<uint8_t> eeprom(image.board.eeprom, image.board.eeprom + HOST_EEPROM_SIZE);
+
+  static IMAGE_BOARD check;
+  if (!image_check(&check, settings, eeprom, pristine))
+    return 1;
+
+  size_t len = strlen(out_path);
+  bool is_bin = len > 4 && strcmp(out_path + len - 4, ".bin") == 0;
+  if (!(is_bin ? write_bin(out_path, eeprom) : write_hex(out_path, eeprom)))
+  {
+    fprintf(stderr, "%s: %s\n", out_path, strerror(errno));
+    return 1;
+  }
+  printf("%s: %u bytes, %u bytes of settings written by firmware, read back and matched\n", out_path,
+         (unsigned)eeprom.size(), image.board.eeprom_writes);
+  return 0;
+}
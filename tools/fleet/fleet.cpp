@@ -0,0 +1,434 @@
+#include "fleet.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FLEET_EPOLL_EVENTS 64
+
+uint64_t fleet_now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static speed_t baud_to_speed(unsigned baud)
+{
+  switch (baud)
+  {
+  case 19200:
+    return B19200;
+  case 38400:
+    return B38400;
+  case 57600:
+    return B57600;
+  case 115200:
+    return B115200;
+  default:
+    return B9600;
+  }
+}
+
+static bool starts_with(const std::string &text, const char *prefix)
+{
+  return text.compare(0, strlen(prefix), prefix) == 0;
+}
+
+Fleet::Fleet()
+{
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+Fleet::~Fleet()
+{
+  for (size_t i = 0; i < ports.size(); i++)
+    if (ports[i])
+      close(i);
+  for (FAN_OUT *job : fan_outs)
+    delete job;
+  ::close(epoll_fd);
+}
+
+int Fleet::open(const std::string &path, unsigned baud, unsigned settle_ms)
+{
+  int fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0)
+  {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud_to_speed(baud));
+    cfsetospeed(&tio, baud_to_speed(baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1; // with 0 read() returns 0 instead of EAGAIN and looks like hang up
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+    tcflush(fd, TCIOFLUSH);
+  }
+
+  PORT *port = new PORT();
+  port->fd = fd;
+  port->ready_ms = fleet_now_ms() + settle_ms;
+  port->in_flight = 0;
+  port->bytes_in_flight = 0;
+  port->next_seq = -1;
+  port->want_write = false;
+  ports.push_back(port);
+  paths.push_back(path);
+  int id = ports.size() - 1;
+
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.u32 = id;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  return id;
+}
+
+void Fleet::close(int id)
+{
+  PORT *port = ports[id];
+  if (!port)
+    return;
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, port->fd, 0);
+  ::close(port->fd);
+  ports[id] = 0;
+  // callbacks could send more commands to this port, they are failed at once
+  while (!port->queue.empty())
+  {
+    PENDING pending = port->queue.front();
+    port->queue.pop_front();
+    FLEET_REPLY reply = {id, pending.command, -1, "closed", pending.lines};
+    if (pending.callback)
+      pending.callback(reply);
+  }
+  delete port;
+}
+
+const std::string &Fleet::path(int id) const
+{
+  return paths[id];
+}
+
+void Fleet::send(int id, const std::string &command, FLEET_CALLBACK callback)
+{
+  if (id < 0 || (size_t)id >= ports.size() || !ports[id])
+  {
+    FLEET_REPLY reply = {id, command, -1, "closed", {}};
+    if (callback)
+      callback(reply);
+    return;
+  }
+  PENDING pending = {command, callback, -1, 0, false, {}};
+  ports[id]->queue.push_back(pending);
+  pump(id);
+}
+
+void Fleet::fan_out(const std::string &command, size_t concurrency, FLEET_CALLBACK callback)
+{
+  FAN_OUT *job = new FAN_OUT{command, concurrency ? concurrency : 1, 0, 0, callback};
+  fan_outs.push_back(job);
+  fan_out_next(job);
+}
+
+void Fleet::fan_out_next(FAN_OUT *job)
+{
+  while (job->busy < job->concurrency && job->next < ports.size())
+  {
+    int id = job->next++;
+    if (!ports[id])
+      continue;
+    job->busy++;
+    send(id, job->command, [this, job](const FLEET_REPLY &reply) {
+      job->busy--;
+      if (job->callback)
+        job->callback(reply);
+      fan_out_next(job);
+    });
+  }
+}
+
+void Fleet::pump(int id)
+{
+  // Moves waiting commands to transmit buffer while window allows
+  PORT *port = ports[id];
+  uint64_t now = fleet_now_ms();
+  if (!port || now < port->ready_ms)
+    return;
+  for (PENDING &pending : port->queue)
+  {
+    if (pending.sent)
+      continue;
+    size_t len = pending.command.size() + 1;
+    if (port->in_flight >= FLEET_WINDOW || (port->in_flight && port->bytes_in_flight + len > FLEET_WINDOW_BYTES))
+      break;
+    port->tx += pending.command;
+    port->tx += '\n';
+    pending.sent = true;
+    pending.deadline_ms = now + FLEET_TIMEOUT_MS;
+    if (port->next_seq >= 0)
+    {
+      pending.seq = port->next_seq;
+      port->next_seq = (port->next_seq + 1) % 256;
+    }
+    port->in_flight++;
+    port->bytes_in_flight += len;
+  }
+  on_writable(id);
+}
+
+void Fleet::on_writable(int id)
+{
+  PORT *port = ports[id];
+  while (!port->tx.empty())
+  {
+    ssize_t n = write(port->fd, port->tx.data(), port->tx.size());
+    if (n <= 0)
+      break;
+    port->tx.erase(0, n);
+  }
+  update_events(id);
+}
+
+void Fleet::update_events(int id)
+{
+  PORT *port = ports[id];
+  bool want_write = !port->tx.empty();
+  if (want_write == port->want_write)
+    return;
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN | (want_write ? (uint32_t)EPOLLOUT : 0);
+  ev.data.u32 = id;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, port->fd, &ev);
+  port->want_write = want_write;
+}
+
+void Fleet::on_readable(int id)
+{
+  char buf[512];
+  for (;;)
+  {
+    PORT *port = ports[id];
+    if (!port)
+      return;
+    ssize_t n = read(port->fd, buf, sizeof(buf));
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      return;
+    if (n <= 0)
+    {
+      close(id); // device unplugged or simulator stopped
+      return;
+    }
+    for (ssize_t i = 0; i < n && ports[id]; i++)
+    {
+      char byte = buf[i];
+      if (byte == '\r')
+        continue;
+      if (byte != '\n')
+      {
+        if (ports[id]->rx_line.size() < FLEET_MAX_LINE)
+          ports[id]->rx_line += byte;
+        continue;
+      }
+      std::string line;
+      line.swap(ports[id]->rx_line);
+      on_line(id, line);
+    }
+  }
+}
+
+void Fleet::on_line(int id, const std::string &line)
+{
+  PORT *port = ports[id];
+  int seq;
+  int offset = 0;
+  if (line[0] == '@' && sscanf(line.c_str(), "@%d %n", &seq, &offset) == 1 && offset > 0)
+  {
+    std::string result = line.substr(offset);
+    // acknowledgement belongs to sent command with its seq, or to oldest sent command when seq is not learned yet
+    size_t index = port->queue.size();
+    for (size_t i = 0; i < port->queue.size() && port->queue[i].sent; i++)
+    {
+      if (port->queue[i].seq == seq)
+      {
+        index = i;
+        break;
+      }
+      if (port->queue[i].seq < 0 && index == port->queue.size())
+        index = i;
+    }
+    if (index == port->queue.size())
+    {
+      if (on_unsolicited)
+        on_unsolicited(id, line);
+      return;
+    }
+    if (port->queue[index].seq < 0)
+    {
+      // learned seq numbers following commands
+      int next = seq;
+      for (size_t i = index; i < port->queue.size() && port->queue[i].sent; i++)
+        port->queue[i].seq = next++ % 256;
+      port->next_seq = next % 256;
+    }
+    if (starts_with(result, "progress"))
+    {
+      port->queue[index].deadline_ms = fleet_now_ms() + FLEET_TIMEOUT_MS;
+      port->queue[index].lines.push_back(line);
+      return;
+    }
+    finish(id, index, seq, result);
+    return;
+  }
+
+  // output is printed by command being executed, that is oldest sent one
+  if (!port->queue.empty() && port->queue.front().sent)
+    port->queue.front().lines.push_back(line);
+  else if (on_unsolicited)
+    on_unsolicited(id, line);
+}
+
+void Fleet::finish(int id, size_t index, int seq, const std::string &result)
+{
+  PORT *port = ports[id];
+  PENDING pending = port->queue[index];
+  port->queue.erase(port->queue.begin() + index);
+  port->in_flight--;
+  port->bytes_in_flight -= pending.command.size() + 1;
+  FLEET_REPLY reply = {id, pending.command, seq, result, pending.lines};
+  if (pending.callback)
+    pending.callback(reply);
+  if (ports[id])
+    pump(id);
+}
+
+void Fleet::check_timeouts()
+{
+  uint64_t now = fleet_now_ms();
+  for (size_t id = 0; id < ports.size(); id++)
+  {
+    PORT *port = ports[id];
+    if (!port || port->queue.empty() || !port->queue.front().sent || now < port->queue.front().deadline_ms)
+      continue;
+    // lines could be lost, seq numbers have to be learned again
+    port->next_seq = -1;
+    for (PENDING &pending : port->queue)
+      pending.seq = -1;
+    finish(id, 0, -1, "timeout");
+  }
+}
+
+size_t Fleet::queued() const
+{
+  size_t n = 0;
+  for (PORT *port : ports)
+    if (port)
+      n += port->queue.size();
+  return n;
+}
+
+size_t Fleet::poll(int timeout_ms)
+{
+  uint64_t now = fleet_now_ms();
+  uint64_t wake = now + (timeout_ms < 0 ? FLEET_TIMEOUT_MS : timeout_ms);
+  for (PORT *port : ports)
+  {
+    if (!port || port->queue.empty())
+      continue;
+    if (port->queue.front().sent && port->queue.front().deadline_ms < wake)
+      wake = port->queue.front().deadline_ms;
+    if (!port->queue.front().sent && port->ready_ms > now && port->ready_ms < wake)
+      wake = port->ready_ms;
+  }
+
+  struct epoll_event events[FLEET_EPOLL_EVENTS];
+  int n = epoll_wait(epoll_fd, events, FLEET_EPOLL_EVENTS, wake > now ? wake - now : 0);
+  for (int i = 0; i < n; i++)
+  {
+    int id = events[i].data.u32;
+    if (!ports[id])
+      continue;
+    if (events[i].events & EPOLLOUT)
+      on_writable(id);
+    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+      on_readable(id);
+  }
+
+  check_timeouts();
+  for (size_t id = 0; id < ports.size(); id++)
+    if (ports[id])
+      pump(id);
+  return queued();
+}
+
+void Fleet::run()
+{
+  while (queued())
+    poll(-1);
+}
+
+static std::map<std::string, std::string> parse_fields(const std::string &line, std::map<std::string, std::string> &fields)
+{
+  size_t colon = line.find(": ");
+  if (colon != std::string::npos)
+    fields[line.substr(0, colon)] = line.substr(colon + 2);
+  return fields;
+}
+
+static int field_int(const std::map<std::string, std::string> &fields, const char *key, int missing)
+{
+  auto it = fields.find(key);
+  return it == fields.end() ? missing : atoi(it->second.c_str());
+}
+
+FLEET_STATUS fleet_parse_status(const FLEET_REPLY &reply)
+{
+  FLEET_STATUS status = {};
+  for (const std::string &line : reply.lines)
+    parse_fields(line, status.fields);
+  status.valid = reply.ok() && status.fields.count("Buttons count") && status.fields.count("Light state");
+  status.buttons = field_int(status.fields, "Buttons count", -1);
+  status.relays = field_int(status.fields, "Relays count", -1);
+  status.light_state = field_int(status.fields, "Light state", -1);
+  status.light_mode = field_int(status.fields, "Light mode", -1);
+  status.avg_duration = field_int(status.fields, "Average duration", -1);
+  status.timeout = field_int(status.fields, "Timeout", -1);
+  auto boot = status.fields.find("Boot to output us");
+  status.boot_us = boot == status.fields.end() ? 0 : strtoul(boot->second.c_str(), 0, 10);
+  return status;
+}
+
+std::vector<FLEET_DEVICE> fleet_parse_devices(const FLEET_REPLY &reply)
+{
+  // Every device starts with "Button <n> ====" or "Relay <n> ====" line followed by "Key: value" lines
+  std::vector<FLEET_DEVICE> devices;
+  for (const std::string &line : reply.lines)
+  {
+    int index;
+    if (sscanf(line.c_str(), "Button %d =", &index) == 1 || sscanf(line.c_str(), "Relay %d =", &index) == 1)
+    {
+      FLEET_DEVICE device = {index, -1, 0, -1, {}};
+      devices.push_back(device);
+    }
+    else if (!devices.empty())
+    {
+      parse_fields(line, devices.back().fields);
+    }
+  }
+  for (FLEET_DEVICE &device : devices)
+  {
+    device.pin = field_int(device.fields, "Pin", -1);
+    device.front = field_int(device.fields, "Front", -1);
+    auto type = device.fields.find("Type");
+    device.type = type == device.fields.end() || type->second.empty() ? 0 : type->second[0];
+  }
+  return devices;
+}
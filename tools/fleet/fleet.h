@@ -0,0 +1,139 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+/* Host side client of controller serial protocol for many ports at once.
+   All ports are served by one epoll loop with non-blocking file descriptors. Every command is one JSON line,
+   controller answers with output lines followed by "@<seq> <result>" acknowledgement (CMD_ACK in firmware),
+   so several commands per port are pipelined and matched to acknowledgements by seq.
+   Fleet-wide operations are fanned out to ports with bounded number of ports busy at once */
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#define FLEET_WINDOW 4           // commands in flight per port
+#define FLEET_WINDOW_BYTES 192   // bytes in flight per port, less than CMD_RING_SIZE of firmware so lines are never dropped
+#define FLEET_TIMEOUT_MS 3000    // time for acknowledgement. Progress lines of long commands restart it
+#define FLEET_MAX_LINE 512       // longer lines from controller are cut
+
+struct FLEET_REPLY
+{
+  int port;                       // port id returned by Fleet::open()
+  std::string command;
+  int seq;                        // seq from acknowledgement, -1 - no acknowledgement
+  std::string result;             // "done", "invalid", "overflow", "dropped", "not json", or "timeout", "closed" from host side
+  std::vector<std::string> lines; // output of command
+  bool ok() const { return result == "done"; }
+};
+
+typedef std::function<void(const FLEET_REPLY &reply)> FLEET_CALLBACK;
+
+// Parsed output of "status" command. Fields not known to this version are kept in fields
+struct FLEET_STATUS
+{
+  bool valid;
+  int buttons;
+  int relays;
+  int light_state;
+  int light_mode;
+  int avg_duration;
+  int timeout;
+  unsigned long boot_us;
+  std::map<std::string, std::string> fields;
+};
+
+// One device from "buttons" or "relays" output
+struct FLEET_DEVICE
+{
+  int index;
+  int pin;
+  char type;
+  int front; // buttons only, -1 for relays
+  std::map<std::string, std::string> fields;
+};
+
+FLEET_STATUS fleet_parse_status(const FLEET_REPLY &reply);
+std::vector<FLEET_DEVICE> fleet_parse_devices(const FLEET_REPLY &reply);
+
+class Fleet
+{
+public:
+  Fleet();
+  ~Fleet();
+
+  // Opens serial port in raw non-blocking mode. settle_ms - time to wait before first command (Nano resets on open)
+  int open(const std::string &path, unsigned baud = 9600, unsigned settle_ms = 0);
+  void close(int port);
+  const std::string &path(int port) const; // kept after port is closed
+  size_t size() const { return ports.size(); }
+
+  // Queues command for port. Callback is called once with acknowledgement, timeout or closing of port
+  void send(int port, const std::string &command, FLEET_CALLBACK callback);
+
+  // Sends command to every open port, at most concurrency ports have it in flight at once
+  void fan_out(const std::string &command, size_t concurrency, FLEET_CALLBACK callback);
+
+  // Serves ports until every queued command is finished
+  void run();
+
+  // Serves ports once, waiting at most timeout_ms for events. Returns number of commands still queued
+  size_t poll(int timeout_ms);
+
+  // Lines received while no command was in flight (boot messages, notifications)
+  std::function<void(int port, const std::string &line)> on_unsolicited;
+
+private:
+  struct PENDING
+  {
+    std::string command;
+    FLEET_CALLBACK callback;
+    int seq;                  // expected seq, -1 - not known yet
+    uint64_t deadline_ms;     // valid when sent
+    bool sent;
+    std::vector<std::string> lines;
+  };
+
+  struct PORT
+  {
+    int fd;
+    uint64_t ready_ms;        // commands are not sent before this time
+    std::deque<PENDING> queue; // sent commands first, then waiting ones
+    size_t in_flight;
+    size_t bytes_in_flight;
+    int next_seq;              // seq firmware gives to next sent line, -1 - not known
+    std::string tx;
+    std::string rx_line;
+    bool want_write;
+  };
+
+  struct FAN_OUT
+  {
+    std::string command;
+    size_t concurrency;
+    size_t next;              // next port index
+    size_t busy;
+    FLEET_CALLBACK callback;
+  };
+
+  std::vector<PORT *> ports;   // index is port id, 0 - closed
+  std::vector<std::string> paths;
+  std::vector<FAN_OUT *> fan_outs;
+  int epoll_fd;
+
+  void pump(int port);
+  void fan_out_next(FAN_OUT *job);
+  void on_readable(int port);
+  void on_writable(int port);
+  void on_line(int port, const std::string &line);
+  void finish(int port, size_t index, int seq, const std::string &result);
+  void update_events(int port);
+  void check_timeouts();
+  size_t queued() const;
+};
+
+uint64_t fleet_now_ms();
+
+#endif
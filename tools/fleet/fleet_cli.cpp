@@ -0,0 +1,212 @@
+/* Command line client for many controllers at once (env:fleet).
+
+   fleet [options] <command> [args] [port ...]
+   Commands:
+     status                   status of every controller as table
+     buttons | relays         device tables
+     send <json>              any command, output is printed per port
+     light_state <0|1>        shortcuts for commands with one option
+     light_mode <n>
+     set_timeout <minutes>
+     sim <count> <firmware>   starts simulated controllers on pseudo-terminals, prints their paths and runs until stopped
+   Options:
+     -c <n>      ports with command in flight at once (default 32)
+     -b <baud>   port speed (default 9600)
+     -s <ms>     wait after opening port before first command (default 2000, Nano resets when port is opened)
+     -f <file>   file with port paths, one per line
+     -S <count>:<firmware>  run command on simulated controllers instead of ports (host build, env:native)
+     -d <dir>    directory for EEPROM files of simulated controllers (default fleet_sim)
+
+   Example: fleet -S 200:.pio/build/native/program light_state 1 */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "fleet.h"
+#include "sim_ports.h"
+
+static volatile sig_atomic_t is_stopped;
+
+static void on_signal(int)
+{
+  is_stopped = 1;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: fleet [-c concurrency] [-b baud] [-s settle_ms] [-f ports_file] [-S count:firmware] [-d dir] "
+                  "<status|buttons|relays|send json|light_state n|light_mode n|set_timeout n|sim count firmware> [port ...]\n");
+  exit(2);
+}
+
+static std::string command_json(const std::string &action, const char *option)
+{
+  std::string json = "{\"class\":\"C\",\"action\":\"" + action + "\"";
+  if (option)
+    json += std::string(",\"options\":[") + option + "]";
+  return json + "}";
+}
+
+static int run_sim(size_t count, const std::string &firmware, const std::string &dir)
+{
+  std::vector<SIM_PORT> sims = sim_ports_start(firmware, count, dir);
+  for (SIM_PORT &sim : sims)
+    printf("%s\n", sim.path.c_str());
+  fflush(stdout);
+  while (!is_stopped)
+    pause();
+  sim_ports_stop(sims);
+  return sims.size() == count ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+  size_t concurrency = 32;
+  unsigned baud = 9600;
+  unsigned settle_ms = 2000;
+  std::vector<std::string> paths;
+  size_t sim_count = 0;
+  std::string sim_firmware;
+  std::string sim_dir = "fleet_sim";
+  int opt;
+
+  while ((opt = getopt(argc, argv, "+c:b:s:f:S:d:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      concurrency = strtoul(optarg, 0, 10);
+      break;
+    case 'b':
+      baud = strtoul(optarg, 0, 10);
+      break;
+    case 's':
+      settle_ms = strtoul(optarg, 0, 10);
+      break;
+    case 'f':
+    {
+      std::ifstream file(optarg);
+      std::string line;
+      while (std::getline(file, line))
+        if (!line.empty())
+          paths.push_back(line);
+      break;
+    }
+    case 'S':
+    {
+      const char *colon = strchr(optarg, ':');
+      if (!colon)
+        usage();
+      sim_count = strtoul(optarg, 0, 10);
+      sim_firmware = colon + 1;
+      break;
+    }
+    case 'd':
+      sim_dir = optarg;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind >= argc)
+    usage();
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  std::string action = argv[optind++];
+  std::string json;
+  if (action == "sim")
+  {
+    if (optind + 2 > argc)
+      usage();
+    return run_sim(strtoul(argv[optind], 0, 10), argv[optind + 1], sim_dir);
+  }
+  else if (action == "status" || action == "buttons" || action == "relays")
+  {
+    json = command_json(action, 0);
+  }
+  else if (action == "send" || action == "light_state" || action == "light_mode" || action == "set_timeout")
+  {
+    if (optind >= argc)
+      usage();
+    json = action == "send" ? argv[optind] : command_json(action, argv[optind]);
+    optind++;
+  }
+  else
+  {
+    usage();
+  }
+  for (int i = optind; i < argc; i++)
+    paths.push_back(argv[i]);
+
+  std::vector<SIM_PORT> sims;
+  if (sim_count)
+  {
+    sims = sim_ports_start(sim_firmware, sim_count, sim_dir);
+    for (SIM_PORT &sim : sims)
+      paths.push_back(sim.path);
+    settle_ms = 100; // simulated controller only has to start its process
+  }
+
+  Fleet fleet;
+  for (const std::string &path : paths)
+  {
+    if (fleet.open(path, baud, settle_ms) < 0)
+      fprintf(stderr, "%s: can't open\n", path.c_str());
+  }
+  fleet.on_unsolicited = [&fleet](int port, const std::string &line) {
+    fprintf(stderr, "%s: %s\n", fleet.path(port).c_str(), line.c_str());
+  };
+
+  if (action == "status")
+    printf("%-24s %7s %6s %5s %4s %4s %7s %s\n", "port", "buttons", "relays", "state", "mode", "avg", "timeout", "result");
+
+  size_t ok = 0;
+  size_t failed = 0;
+  uint64_t start = fleet_now_ms();
+  fleet.fan_out(json, concurrency, [&](const FLEET_REPLY &reply) {
+    const char *path = fleet.path(reply.port).c_str();
+    reply.ok() ? ok++ : failed++;
+    if (action == "status")
+    {
+      FLEET_STATUS status = fleet_parse_status(reply);
+      if (status.valid)
+        printf("%-24s %7d %6d %5d %4d %4d %7d %s\n", path, status.buttons, status.relays, status.light_state,
+               status.light_mode, status.avg_duration, status.timeout, reply.result.c_str());
+      else
+        printf("%-24s %7s %6s %5s %4s %4s %7s %s\n", path, "-", "-", "-", "-", "-", "-", reply.result.c_str());
+    }
+    else if (action == "buttons" || action == "relays")
+    {
+      for (const FLEET_DEVICE &device : fleet_parse_devices(reply))
+      {
+        printf("%s: %d pin %d type %c", path, device.index, device.pin, device.type ? device.type : '-');
+        if (device.front >= 0)
+          printf(" front %d", device.front);
+        printf("\n");
+      }
+      if (!reply.ok())
+        printf("%s: %s\n", path, reply.result.c_str());
+    }
+    else
+    {
+      for (const std::string &line : reply.lines)
+        printf("%s: %s\n", path, line.c_str());
+      printf("%s: %s\n", path, reply.result.c_str());
+    }
+  });
+  while (!is_stopped && fleet.poll(-1))
+    ;
+
+  fprintf(stderr, "%zu ports: %zu done, %zu failed in %llu ms\n", paths.size(), ok, failed,
+          (unsigned long long)(fleet_now_ms() - start));
+  sim_ports_stop(sims);
+  return failed ? 1 : 0;
+}
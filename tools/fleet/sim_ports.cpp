@@ -0,0 +1,77 @@
+#include "sim_ports.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+static bool sim_port_start(SIM_PORT *sim, const std::string &firmware, const std::string &eeprom)
+{
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    return false;
+  sim->master = master;
+  sim->path = ptsname(master);
+
+  // raw from the start, otherwise line discipline echoes client commands back before client sets its mode
+  sim->slave = open(sim->path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  struct termios tio;
+  if (sim->slave < 0 || tcgetattr(sim->slave, &tio) != 0)
+    return false;
+  cfmakeraw(&tio);
+  tcsetattr(sim->slave, TCSANOW, &tio);
+
+  sim->pid = fork();
+  if (sim->pid < 0)
+    return false;
+  if (sim->pid == 0)
+  {
+    dup2(master, STDIN_FILENO);
+    dup2(master, STDOUT_FILENO);
+    close(master);
+    setenv("HOST_EEPROM", eeprom.c_str(), 1);
+    execl(firmware.c_str(), firmware.c_str(), (char *)0);
+    _exit(127);
+  }
+  close(master);
+  sim->master = -1;
+  return true;
+}
+
+std::vector<SIM_PORT> sim_ports_start(const std::string &firmware, size_t count, const std::string &dir)
+{
+  std::vector<SIM_PORT> sims;
+  mkdir(dir.c_str(), 0755);
+  for (size_t i = 0; i < count; i++)
+  {
+    SIM_PORT sim = {-1, -1, -1, ""};
+    std::string eeprom = dir + "/sim" + std::to_string(i) + ".bin";
+    if (!sim_port_start(&sim, firmware, eeprom))
+    {
+      perror("sim port");
+      if (sim.slave >= 0)
+        close(sim.slave);
+      if (sim.master >= 0)
+        close(sim.master);
+      break;
+    }
+    sims.push_back(sim);
+  }
+  return sims;
+}
+
+void sim_ports_stop(std::vector<SIM_PORT> &sims)
+{
+  for (SIM_PORT &sim : sims)
+    kill(sim.pid, SIGTERM);
+  for (SIM_PORT &sim : sims)
+  {
+    waitpid(sim.pid, 0, 0);
+    close(sim.slave);
+  }
+  sims.clear();
+}
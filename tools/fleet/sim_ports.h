@@ -0,0 +1,24 @@
+#ifndef SIM_PORTS_H
+#define SIM_PORTS_H
+
+/* Simulated controllers behind pseudo-terminals. Every controller is host build of firmware (env:native)
+   running in own process with own EEPROM file, its serial is connected to pty master. Slave path is used
+   like real serial port, so Fleet can be tested without hardware */
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+struct SIM_PORT
+{
+  pid_t pid;
+  int master;       // kept by firmware process only
+  int slave;        // kept open, so controller doesn't see hang up when client closes port
+  std::string path; // slave path for clients
+};
+
+// Starts count controllers. EEPROM files are kept in dir as sim<n>.bin. Returns started ones
+std::vector<SIM_PORT> sim_ports_start(const std::string &firmware, size_t count, const std::string &dir);
+void sim_ports_stop(std::vector<SIM_PORT> &sims);
+
+#endif
@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""Generates include/help_catalog.h, compressed help of serial commands for "help" command of firmware.
+
+Catalog is taken from src/main.cpp itself: commands are string defines of "List of commands" with description in
+trailing comment, dispatched by strcmp(action, NAME) in handle_input_commands(). Example is JSON example comment of
+command handler (or bare command when handler has none), errors are ERR_ defines printed by handler and by functions
+it calls. Header checks every command define against catalog at compile time, so renamed command fails the build
+until catalog is generated again.
+
+Text is compressed by pair substitution: byte < 0x80 is character, byte >= 0x80 is rule of two bytes, each of them
+character or earlier rule. Firmware expands rules with small stack straight into serial output.
+
+Runs before every build of PlatformIO envs (extra_scripts = pre:tools/help/gen_help.py) and by hand:
+  tools/help/gen_help.py [project dir]
+Header is written only when it changes.
+"""
+
+import os
+import re
+import sys
+
+MAX_RULES = 128
+MIN_PAIR_COUNT = 3  # rule costs 2 bytes, pair found less often doesn't save space
+
+DEFINE = re.compile(r'^#define (\w+) "((?:[^"\\]|\\.)*)"(?:\s*//\s*(.*))?$', re.M)
+ERROR = re.compile(r'\b(ERR_\w+)\b')
+CALL = re.compile(r'\b([a-z_][a-z0-9_]*)\s*\(')
+FUNCTION = re.compile(r'^\w[\w *]* \**([a-z_][a-z0-9_]*)\([^;\n]*\)\n\{', re.M)
+EXAMPLE = re.compile(r'/\* JSON example[^\n]*\n(.*?)\*/', re.S)
+
+
+def unescape(text):
+    return bytes(text, "ascii").decode("unicode_escape")
+
+
+def block(source, start):
+    """Text of {} block starting at source[start], braces of literals and comments are skipped"""
+    depth, i = 0, start
+    while i < len(source):
+        if source.startswith("//", i):
+            i = source.index("\n", i)
+        elif source.startswith("/*", i):
+            i = source.index("*/", i) + 1
+        elif source[i] in "\"'":
+            quote, i = source[i], i + 1
+            while source[i] != quote:
+                i += 2 if source[i] == "\\" else 1
+        elif source[i] == "{":
+            depth += 1
+        elif source[i] == "}":
+            depth -= 1
+            if depth == 0:
+                return source[start:i + 1]
+        i += 1
+    raise ValueError("unbalanced block")
+
+
+def compact_json(text):
+    lines = []
+    for line in text.splitlines():
+        line = re.sub(r'\s//.*$', "", line)
+        lines.append(line.strip())
+    out, in_string = [], False
+    for c in "".join(lines):
+        if c == '"':
+            in_string = not in_string
+        if in_string or not c.isspace():
+            out.append(c)
+    return "".join(out)
+
+
+def parse(source):
+    start = source.index("/* List of commands")
+    end = source.index("/* end list of Serial commands")
+    defines = {m.group(1): (unescape(m.group(2)), m.group(3)) for m in DEFINE.finditer(source)}
+    listed = [m.group(1) for m in DEFINE.finditer(source[start:end])]
+
+    functions = {}
+    for m in FUNCTION.finditer(source):
+        functions[m.group(1)] = block(source, m.end() - 1)
+
+    dispatch = functions["handle_input_commands"]
+    cases = list(re.finditer(r'strcmp\(action, (\w+)\) == 0\)', dispatch))
+    handlers = {}
+    for i, case in enumerate(cases):
+        handlers[case.group(1)] = block(dispatch, dispatch.index("{", case.end()))
+
+    commands = []
+    for macro in listed:
+        if macro not in handlers:
+            continue
+        name, description = defines[macro]
+        if not description:
+            raise ValueError("command %s has no description comment" % macro)
+        body = handlers[macro]
+        example = EXAMPLE.search(body)
+        example = compact_json(example.group(1)) if example else '{"class":"C","action":"%s"}' % name
+
+        errors = ERROR.findall(body)
+        for call in CALL.findall(body):
+            if call in functions and call != "handle_input_commands":
+                errors += ERROR.findall(functions[call])
+        errors = [e for i, e in enumerate(errors) if e in defines and e not in errors[:i]]
+        commands.append((macro, name, description, example, "\n".join(defines[e][0] for e in errors)))
+
+    missing = set(handlers) - set(c[0] for c in commands)
+    if missing:
+        raise ValueError("commands not in list of commands: %s" % ", ".join(sorted(missing)))
+    return commands
+
+
+def compress(strings):
+    """Pair substitution over strings, pairs never cross string end"""
+    seqs = [list(s.encode("ascii")) + [0] for s in strings]
+    for seq in seqs:
+        if any(c >= 0x80 for c in seq):
+            raise ValueError("help text should be ASCII")
+    rules = []
+    while len(rules) < MAX_RULES:
+        counts = {}
+        for seq in seqs:
+            for pair in zip(seq, seq[1:]):
+                if pair[1] != 0:
+                    counts[pair] = counts.get(pair, 0) + 1
+        if not counts:
+            break
+        pair, count = min(counts.items(), key=lambda item: (-item[1], item[0]))
+        if count < MIN_PAIR_COUNT:
+            break
+        token = 0x80 + len(rules)
+        rules.append(pair)
+        for n, seq in enumerate(seqs):
+            out, i = [], 0
+            while i < len(seq):
+                if i + 1 < len(seq) and (seq[i], seq[i + 1]) == pair:
+                    out.append(token)
+                    i += 2
+                else:
+                    out.append(seq[i])
+                    i += 1
+            seqs[n] = out
+    return rules, seqs
+
+
+def stack_depth(rules):
+    # expanding rule (a, b) keeps b on stack while a is expanded
+    depth = []
+    for a, b in rules:
+        da = depth[a - 0x80] if a >= 0x80 else 0
+        db = depth[b - 0x80] if b >= 0x80 else 0
+        depth.append(max(1 + da, db))
+    return max(depth + [1])
+
+
+def c_bytes(data, indent="  ", per_line=16):
+    lines = []
+    for i in range(0, len(data), per_line):
+        lines.append(indent + ", ".join("0x%02X" % b for b in data[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def c_string(text):
+    return '"%s"' % text.replace("\\", "\\\\").replace('"', '\\"').replace("\n", "\\n")
+
+
+def generate(commands):
+    strings = []
+    for _, _, description, example, errors in commands:
+        strings += [description, example, errors]
+    rules, seqs = compress(strings)
+
+    text, offsets = [], []
+    for i, seq in enumerate(seqs):
+        if i % 3 == 0:
+            offsets.append(len(text))
+        text += seq
+    plain = sum(len(s) + 1 for s in strings)
+
+    out = []
+    out.append("#ifndef HELP_CATALOG_H")
+    out.append("#define HELP_CATALOG_H")
+    out.append("")
+    out.append("/* Generated by tools/help/gen_help.py from src/main.cpp, don't edit.")
+    out.append("   Every command has 3 strings in help_text: description, JSON example and errors separated by \\n.")
+    out.append("   Byte < 0x80 is character, byte >= 0x80 is index of pair in help_rules + 0x80.")
+    out.append("   %d bytes of text in %d bytes of text and %d bytes of rules */" % (plain, len(text), 2 * len(rules)))
+    out.append("")
+    out.append("#define HELP_COMMANDS %d" % len(commands))
+    out.append("#define HELP_STACK_DEPTH %d // pending right halves of rules during expansion" % stack_depth(rules))
+    out.append("")
+    out.append("const char help_names[] PROGMEM =")
+    for _, name, _, _, _ in commands:
+        out.append("    %s \"\\0\"" % c_string(name))
+    out[-1] += ";"
+    out.append("")
+    out.append("const uint16_t help_offsets[HELP_COMMANDS] PROGMEM = {%s};" % ", ".join(str(o) for o in offsets))
+    out.append("")
+    out.append("const uint8_t help_rules[][2] PROGMEM = {")
+    for i in range(0, len(rules), 8):
+        out.append("  " + " ".join("{0x%02X, 0x%02X}," % r for r in rules[i:i + 8]))
+    out.append("};")
+    out.append("")
+    out.append("const uint8_t help_text[] PROGMEM = {")
+    out.append(c_bytes(text))
+    out.append("};")
+    out.append("")
+    out.append("constexpr bool help_is_same(const char *a, const char *b)")
+    out.append("{")
+    out.append("  return *a == *b && (*a == 0 || help_is_same(a + 1, b + 1));")
+    out.append("}")
+    out.append("")
+    for macro, name, _, _, _ in commands:
+        out.append("static_assert(help_is_same(%s, %s), \"help catalog is outdated, run tools/help/gen_help.py\");"
+                   % (macro, c_string(name)))
+    out.append("")
+    out.append("#endif")
+    return "\n".join(out) + "\n"
+
+
+def run(project_dir):
+    with open(os.path.join(project_dir, "src", "main.cpp")) as f:
+        header = generate(parse(f.read()))
+    path = os.path.join(project_dir, "include", "help_catalog.h")
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == header:
+                return
+    with open(path, "w") as f:
+        f.write(header)
+    print("Generated %s" % path)
+
+
+try:
+    Import("env")  # noqa: F821, PlatformIO extra script
+    run(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        here = os.path.dirname(os.path.abspath(__file__))
+        run(sys.argv[1] if len(sys.argv) > 1 else os.path.normpath(os.path.join(here, "..", "..")))
@@ -0,0 +1,207 @@
+/* Simulated I2C master for register map of firmware (REGMAP in src/main.cpp, env:regmap_master).
+   Host build of firmware runs on virtual clock, master transfers are made between loop() calls and go through
+   firmware TWI interrupt handler, so companion MCU code can be tried without hardware.
+
+   regmap_master [options] [script file]
+   Script (default stdin), one transfer or action per line, numbers are decimal or 0x hex, # starts comment:
+     w <reg> <byte> ...     write transfer: register pointer and bytes
+     r <reg> <count>        pointer write, then read of count bytes, printed as hex
+     expect <reg> <byte>    read one register, exit code 1 if it differs
+     run <ms>               run firmware
+     pin <pin> <level>      drive input pin (press button wired to GND with 0)
+     serial <line>          send line to firmware serial
+   Options:
+     -e <file>   EEPROM image to boot with (eeprom.bin of env:native or .bin of tools/eeprom)
+     -a <addr>   slave address (default 0x28, REGMAP_ADDRESS)
+     -v          print firmware serial output
+   Example, switch light on in mode 2 and read it back:
+     w 0x02 2
+     w 0x01 1
+     run 10
+     expect 0x01 1
+     r 0x00 8 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+
+#include "host.h"
+
+void setup();
+void loop();
+
+#define MASTER_ADDRESS 0x28
+#define MASTER_LOOP_US 1000 // virtual time of one loop() during run
+
+static bool is_verbose = false;
+
+static void master_tx(HOST_BOARD *board, uint8_t byte, uint8_t to_bus)
+{
+  (void)board;
+  (void)to_bus;
+  if (is_verbose)
+    fputc(byte, stdout);
+}
+
+static void run_ms(HOST_BOARD *board, uint32_t ms)
+{
+  uint64_t until = host_now_us(board) + ms * 1000ULL;
+  while (host_now_us(board) < until)
+  {
+    loop();
+    host_advance(board, MASTER_LOOP_US);
+  }
+}
+
+static std::vector<uint8_t> numbers(std::istringstream &words)
+{
+  std::vector<uint8_t> result;
+  std::string word;
+  while (words >> word)
+    result.push_back(strtoul(word.c_str(), 0, 0));
+  return result;
+}
+
+static bool read_registers(uint8_t address, uint8_t reg, uint8_t *data, uint8_t count)
+{
+  return host_twi_write(address, &reg, 1) && host_twi_read(address, data, count);
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: regmap_master [-e eeprom.bin] [-a address] [-v] [script]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  const char *eeprom_path = 0;
+  uint8_t address = MASTER_ADDRESS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "e:a:v")) != -1)
+  {
+    switch (opt)
+    {
+    case 'e':
+      eeprom_path = optarg;
+      break;
+    case 'a':
+      address = strtoul(optarg, 0, 0);
+      break;
+    case 'v':
+      is_verbose = true;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind < argc - 1)
+    usage();
+
+  std::ifstream file;
+  if (optind == argc - 1)
+  {
+    file.open(argv[optind]);
+    if (!file)
+    {
+      fprintf(stderr, "%s: can't open\n", argv[optind]);
+      return 2;
+    }
+  }
+  std::istream &script = optind == argc - 1 ? file : std::cin;
+
+  static HOST_BOARD board;
+  host_board_init(&board, 1);
+  board.tx = master_tx;
+  if (eeprom_path)
+  {
+    FILE *image = fopen(eeprom_path, "rb");
+    if (!image || fread(board.eeprom, 1, sizeof(board.eeprom), image) == 0)
+    {
+      fprintf(stderr, "%s: can't read EEPROM image\n", eeprom_path);
+      return 2;
+    }
+    fclose(image);
+  }
+  host_board = &board;
+  setup();
+  run_ms(&board, 10);
+
+  int failures = 0;
+  std::string line;
+  for (int line_no = 1; std::getline(script, line); line_no++)
+  {
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    std::string action;
+    if (!(words >> action))
+      continue;
+
+    if (action == "serial")
+    {
+      std::string rx = line.substr(line.find("serial") + 7) + "\n";
+      while (!rx.empty())
+      {
+        rx.erase(0, host_serial_feed(&board, (const uint8_t *)rx.data(), rx.size()));
+        run_ms(&board, 1);
+      }
+      continue;
+    }
+
+    std::vector<uint8_t> args = numbers(words);
+    bool is_acked = true;
+    if (action == "w" && !args.empty())
+    {
+      is_acked = host_twi_write(address, args.data(), args.size());
+    }
+    else if (action == "r" && args.size() == 2 && args[1] > 0)
+    {
+      std::vector<uint8_t> data(args[1]);
+      is_acked = read_registers(address, args[0], data.data(), args[1]);
+      if (is_acked)
+      {
+        printf("0x%02X:", args[0]);
+        for (uint8_t byte : data)
+          printf(" %02X", byte);
+        printf("\n");
+      }
+    }
+    else if (action == "expect" && args.size() == 2)
+    {
+      uint8_t value = 0;
+      is_acked = read_registers(address, args[0], &value, 1);
+      if (is_acked && value != args[1])
+      {
+        printf("line %d: register 0x%02X is 0x%02X, expected 0x%02X\n", line_no, args[0], value, args[1]);
+        failures++;
+      }
+    }
+    else if (action == "run" && args.size() == 1)
+    {
+      run_ms(&board, strtoul(line.c_str() + line.find("run") + 3, 0, 0));
+    }
+    else if (action == "pin" && args.size() == 2)
+    {
+      host_pin_input(&board, args[0], args[1]);
+    }
+    else
+    {
+      fprintf(stderr, "line %d: can't parse \"%s\"\n", line_no, line.c_str());
+      return 2;
+    }
+    if (!is_acked)
+    {
+      printf("line %d: address 0x%02X not acknowledged\n", line_no, address);
+      failures++;
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+/* Replay of input capture (CAPTURE in src/main.cpp) on host build of firmware (env:replay).
+   Board starts with EEPROM from boot image of capture, button pin levels and commands are applied at
+   recorded times on virtual clock (command is sent as line rebuilt from its action and options), and relay masks commanded by replayed firmware (read back by "capture"
+   command of replayed firmware) are compared with recorded ones.
+
+   replay [options] <capture file>
+   Capture file is output of {"class":"C","action":"capture"} saved from serial terminal, other lines are ignored.
+   Options:
+     -n <runs>   replay several times and check that every run gives same relays timeline (default 2)
+     -t <ms>     allowed difference of relay change time (default 50)
+     -k <us>     virtual time of every millis()/micros() call (default 20)
+     -v          print whole timeline, not only differences
+   Exit code: 0 - timelines match, 1 - they differ, 2 - bad arguments or capture.
+   Replayed firmware is host build with bigger parser memory, commands rejected on board for memory may differ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+
+#include "host.h"
+
+void setup();
+void loop();
+
+#define REPLAY_DUMP "{\"class\":\"C\",\"action\":\"capture\"}\n"
+#define REPLAY_DUMP_TIMEOUT_US 10000000ULL
+
+struct CAPTURE_ENTRY
+{
+  uint32_t time; // ms from reset
+  char type;     // 'R', 'P', 'C' or 'O'
+  uint16_t address;
+  uint8_t pin;
+  uint8_t value; // pin level or relay mask
+  std::vector<uint8_t> bytes; // EEPROM bytes or command line
+};
+
+struct CAPTURE_LOG
+{
+  std::vector<CAPTURE_ENTRY> entries;
+  uint8_t is_full;
+};
+
+struct REPLAY
+{
+  HOST_BOARD board;
+  std::string line;
+  std::vector<std::string> lines; // output of replayed firmware
+};
+
+static int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static bool parse_hex(const char *text, std::vector<uint8_t> *bytes)
+{
+  for (; text[0] && text[0] != '\r' && text[0] != '\n'; text += 2)
+  {
+    int high = hex_digit(text[0]);
+    int low = text[1] ? hex_digit(text[1]) : -1;
+    if (high < 0 || low < 0)
+      return false;
+    bytes->push_back(high << 4 | low);
+  }
+  return true;
+}
+
+// Command line from entry "<action> <options>", action "-" means options is whole command
+static bool parse_command(const char *text, std::vector<uint8_t> *bytes)
+{
+  char action[32];
+  int used = 0;
+  if (sscanf(text, "%31s%n", action, &used) != 1)
+    return false;
+  std::string options = text + used;
+  options.erase(0, options.find_first_not_of(' '));
+  options.erase(options.find_last_not_of("\r\n") + 1);
+  std::string line;
+  if (strcmp(action, "-") == 0)
+    line = options;
+  else if (options.empty())
+    line = std::string("{\"class\":\"C\",\"action\":\"") + action + "\"}";
+  else
+    line = std::string("{\"class\":\"C\",\"action\":\"") + action + "\",\"options\":" + options + "}";
+  line += "\n";
+  bytes->assign(line.begin(), line.end());
+  return true;
+}
+
+// Parses one dump line: "<ms> R <address> <hex>", "<ms> P <pin> <level>", "<ms> C <action> <options>", "<ms> O <mask>"
+static bool parse_entry(const std::string &line, CAPTURE_ENTRY *entry)
+{
+  char type;
+  unsigned long time;
+  int used = 0;
+  if (sscanf(line.c_str(), "%lu %c %n", &time, &type, &used) < 2 || used == 0)
+    return false;
+  const char *rest = line.c_str() + used;
+  unsigned a = 0, b = 0;
+  char hex[600];
+
+  entry->time = time;
+  entry->type = type;
+  entry->bytes.clear();
+  switch (type)
+  {
+  case 'R':
+    if (sscanf(rest, "%u %599s", &a, hex) != 2)
+      return false;
+    entry->address = a;
+    return parse_hex(hex, &entry->bytes);
+  case 'P':
+    if (sscanf(rest, "%u %u", &a, &b) != 2)
+      return false;
+    entry->pin = a;
+    entry->value = b;
+    return true;
+  case 'C':
+    return parse_command(rest, &entry->bytes);
+  case 'O':
+    if (sscanf(rest, "%u", &a) != 1)
+      return false;
+    entry->value = a;
+    return true;
+  }
+  return false;
+}
+
+// Takes entries of first dump found in lines
+static CAPTURE_LOG parse_capture(const std::vector<std::string> &lines)
+{
+  CAPTURE_LOG capture = {{}, 0};
+  bool is_dump = false;
+  for (const std::string &line : lines)
+  {
+    if (line.compare(0, 10, "# capture ") == 0)
+    {
+      if (is_dump)
+        break;
+      is_dump = true;
+      capture.is_full = line.find("full") != std::string::npos;
+      continue;
+    }
+    CAPTURE_ENTRY entry;
+    if (is_dump && parse_entry(line, &entry))
+      capture.entries.push_back(entry);
+    else if (is_dump && !line.empty() && line[0] == '@')
+      break; // acknowledgement ends dump
+  }
+  return capture;
+}
+
+static void replay_tx(HOST_BOARD *board, uint8_t byte, uint8_t to_bus)
+{
+  (void)to_bus;
+  REPLAY *replay = (REPLAY *)board->user;
+  if (byte == '\r')
+    return;
+  if (byte != '\n')
+  {
+    replay->line += (char)byte;
+    return;
+  }
+  replay->lines.push_back(replay->line);
+  replay->line.clear();
+}
+
+static uint64_t now_ms(HOST_BOARD *board)
+{
+  return host_now_us(board) / 1000;
+}
+
+// Runs capture on fresh board, returns relay entries of replayed firmware
+static std::vector<CAPTURE_ENTRY> replay_run(const CAPTURE_LOG &capture, const std::vector<uint8_t> &pristine,
+                                             uint16_t tick_us, uint32_t end_ms)
+{
+  static REPLAY replay;
+  HOST_BOARD *board = &replay.board;
+
+  host_board_init(board, 1);
+  board->tick_us = tick_us;
+  board->tx = replay_tx;
+  board->user = &replay;
+  replay.line.clear();
+  replay.lines.clear();
+  for (const CAPTURE_ENTRY &entry : capture.entries)
+  {
+    if (entry.type == 'R')
+      for (size_t i = 0; i < entry.bytes.size() && entry.address + i < HOST_EEPROM_SIZE; i++)
+        board->eeprom[entry.address + i] = entry.bytes[i];
+  }
+
+  host_board = board;
+  fw_state_load(pristine.data());
+  setup();
+
+  std::string rx; // bytes not accepted by full serial buffer yet
+  size_t next = 0;
+  while (now_ms(board) <= end_ms)
+  {
+    for (; next < capture.entries.size() && capture.entries[next].time <= now_ms(board); next++)
+    {
+      const CAPTURE_ENTRY &entry = capture.entries[next];
+      if (entry.type == 'P')
+        host_pin_input(board, entry.pin, entry.value);
+      else if (entry.type == 'C')
+        rx.append(entry.bytes.begin(), entry.bytes.end());
+    }
+    if (!rx.empty())
+      rx.erase(0, host_serial_feed(board, (const uint8_t *)rx.data(), rx.size()));
+    loop();
+  }
+
+  // replayed firmware has recorded own capture, its relay entries are the result
+  replay.lines.clear();
+  rx += REPLAY_DUMP;
+  uint64_t deadline = host_now_us(board) + REPLAY_DUMP_TIMEOUT_US;
+  while (host_now_us(board) < deadline && (replay.lines.empty() || replay.lines.back()[0] != '@' || !rx.empty()))
+  {
+    if (!rx.empty())
+      rx.erase(0, host_serial_feed(board, (const uint8_t *)rx.data(), rx.size()));
+    loop();
+  }
+
+  std::vector<CAPTURE_ENTRY> relays;
+  for (const CAPTURE_ENTRY &entry : parse_capture(replay.lines).entries)
+    if (entry.type == 'O' && entry.time <= end_ms)
+      relays.push_back(entry);
+  return relays;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: replay [-n runs] [-t tolerance_ms] [-k tick_us] [-v] <capture file>\n");
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  int runs = 2;
+  uint32_t tolerance_ms = 50;
+  uint16_t tick_us = 20;
+  bool is_verbose = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:t:k:v")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      runs = atoi(optarg);
+      break;
+    case 't':
+      tolerance_ms = strtoul(optarg, 0, 10);
+      break;
+    case 'k':
+      tick_us = strtoul(optarg, 0, 10);
+      break;
+    case 'v':
+      is_verbose = true;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind != argc - 1 || runs < 1 || tick_us == 0)
+    usage();
+
+  std::ifstream file(argv[optind]);
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(file, line))
+    lines.push_back(line);
+  CAPTURE_LOG capture = parse_capture(lines);
+  if (capture.entries.empty() || capture.entries[0].type != 'R')
+  {
+    fprintf(stderr, "%s: no capture starting with boot image\n", argv[optind]);
+    return 2;
+  }
+
+  std::vector<CAPTURE_ENTRY> recorded;
+  for (const CAPTURE_ENTRY &entry : capture.entries)
+    if (entry.type == 'O')
+      recorded.push_back(entry);
+  uint32_t end_ms = capture.entries.back().time;
+
+  // globals of this thread never ran setup(), every run starts from copy of them
+  std::vector<uint8_t> pristine(fw_state_size());
+  fw_state_save(pristine.data());
+
+  std::vector<CAPTURE_ENTRY> replayed;
+  bool is_deterministic = true;
+  auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < runs; run++)
+  {
+    std::vector<CAPTURE_ENTRY> result = replay_run(capture, pristine, tick_us, end_ms);
+    if (run == 0)
+      replayed = result;
+    else if (result.size() != replayed.size())
+      is_deterministic = false;
+    else
+      for (size_t i = 0; i < result.size(); i++)
+        if (result[i].time != replayed[i].time || result[i].value != replayed[i].value)
+          is_deterministic = false;
+  }
+  double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  size_t differences = 0;
+  printf("%10s %8s %10s %8s\n", "recorded", "mask", "replayed", "mask");
+  for (size_t i = 0; i < recorded.size() || i < replayed.size(); i++)
+  {
+    const CAPTURE_ENTRY *a = i < recorded.size() ? &recorded[i] : 0;
+    const CAPTURE_ENTRY *b = i < replayed.size() ? &replayed[i] : 0;
+    bool is_same = a && b && a->value == b->value &&
+                   (a->time > b->time ? a->time - b->time : b->time - a->time) <= tolerance_ms;
+    if (!is_same)
+      differences++;
+    if (!is_same || is_verbose)
+    {
+      if (a)
+        printf("%10u %8u", a->time, a->value);
+      else
+        printf("%10s %8s", "-", "-");
+      if (b)
+        printf(" %10u %8u", b->time, b->value);
+      else
+        printf(" %10s %8s", "-", "-");
+      printf("%s\n", is_same ? "" : "  <- differs");
+    }
+  }
+
+  printf("%zu relay changes recorded, %zu replayed, %zu differ%s\n", recorded.size(), replayed.size(), differences,
+         capture.is_full ? " (capture is full, compared until its last entry)" : "");
+  printf("%d runs %s, %.0f ms of board time in %.1f ms per run (%.0fx real time)\n", runs,
+         is_deterministic ? "identical" : "DIFFER", (double)end_ms, wall_ms / runs,
+         wall_ms > 0 ? end_ms * runs / wall_ms : 0.0);
+  return differences == 0 && is_deterministic ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+#include "pool.h"
+
+WorkPool::WorkPool(unsigned threads)
+    : task(0), generation(0), active(0), is_stopped(false)
+{
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+  for (unsigned i = 0; i < threads; i++)
+  {
+    WORKER *worker = new WORKER;
+    worker->steals = 0;
+    workers.push_back(worker);
+  }
+  for (unsigned i = 0; i < threads; i++)
+    workers[i]->thread = std::thread(&WorkPool::work, this, i);
+}
+
+WorkPool::~WorkPool()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    is_stopped = true;
+  }
+  wake.notify_all();
+  for (WORKER *worker : workers)
+  {
+    worker->thread.join();
+    delete worker;
+  }
+}
+
+void WorkPool::run(size_t count, const std::function<void(size_t index, unsigned worker)> &fn)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  size_t block = (count + workers.size() - 1) / workers.size();
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    std::lock_guard<std::mutex> worker_guard(workers[i]->lock);
+    for (size_t index = i * block; index < count && index < (i + 1) * block; index++)
+      workers[i]->tasks.push_back(index);
+  }
+  task = &fn;
+  active = (unsigned)workers.size();
+  generation++;
+  wake.notify_all();
+  done.wait(guard, [this] { return active == 0; });
+  task = 0;
+}
+
+uint64_t WorkPool::steals() const
+{
+  uint64_t n = 0;
+  for (const WORKER *worker : workers)
+    n += worker->steals;
+  return n;
+}
+
+bool WorkPool::take(unsigned id, size_t *index)
+{
+  WORKER *own = workers[id];
+  {
+    std::lock_guard<std::mutex> guard(own->lock);
+    if (!own->tasks.empty())
+    {
+      // own tasks from back: last dealt index is next to the one just stepped
+      *index = own->tasks.back();
+      own->tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < workers.size(); i++)
+  {
+    WORKER *victim = workers[(id + i) % workers.size()];
+    std::lock_guard<std::mutex> guard(victim->lock);
+    if (!victim->tasks.empty())
+    {
+      *index = victim->tasks.front();
+      victim->tasks.pop_front();
+      own->steals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkPool::work(unsigned id)
+{
+  uint64_t seen = 0;
+  for (;;)
+  {
+    const std::function<void(size_t, unsigned)> *fn;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [this, seen] { return is_stopped || generation != seen; });
+      if (is_stopped)
+        return;
+      seen = generation;
+      fn = task;
+    }
+
+    size_t index;
+    while (take(id, &index))
+      (*fn)(index, id);
+
+    // every task of this run is taken, the ones still running belong to other workers
+    std::lock_guard<std::mutex> guard(lock);
+    if (--active == 0)
+      done.notify_one();
+  }
+}
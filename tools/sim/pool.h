@@ -0,0 +1,53 @@
+#ifndef POOL_H
+#define POOL_H
+
+/* Work-stealing thread pool. Every worker has own deque of tasks: owner takes tasks from its back,
+   idle workers steal from front of other deques, so cores stay busy when tasks take uneven time
+   (boards with button activity are slower to step than idle ones) */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkPool
+{
+public:
+  explicit WorkPool(unsigned threads); // 0 - one worker per core
+  ~WorkPool();
+
+  unsigned size() const { return (unsigned)workers.size(); }
+
+  // Runs task(index, worker) for every index in [0, count) and returns when all are done.
+  // Indexes are dealt to workers in contiguous blocks, so neighbours in memory are stepped by one core
+  void run(size_t count, const std::function<void(size_t index, unsigned worker)> &task);
+
+  uint64_t steals() const; // tasks taken from other workers since pool start
+
+private:
+  struct WORKER
+  {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+    uint64_t steals;
+    std::thread thread;
+  };
+
+  std::vector<WORKER *> workers;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const std::function<void(size_t, unsigned)> *task;
+  uint64_t generation; // incremented by every run()
+  unsigned active;     // workers taking tasks of current run
+  bool is_stopped;
+
+  void work(unsigned id);
+  bool take(unsigned id, size_t *index);
+};
+
+#endif
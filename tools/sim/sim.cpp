@@ -0,0 +1,228 @@
+#include "sim.h"
+
+#include <math.h>
+#include <Arduino.h>
+
+void setup();
+void loop();
+
+static const SIM_WORKLOAD workloads[] = {
+    // name, arrivals/h, night, stay min, sigma, leave on, reaction s, timeout
+    {"bathroom", 3.0, 0.15, 8.0, 0.9, 0.3, 20.0, 0},
+    {"hallway", 12.0, 0.05, 1.0, 0.6, 0.6, 5.0, 0},
+    {"closet", 0.5, 0.0, 3.0, 0.7, 0.5, 5.0, 0},
+    {"office", 1.0, 0.0, 90.0, 0.6, 0.2, 10.0, 30},
+};
+
+const SIM_WORKLOAD *sim_workload(const std::string &name)
+{
+  for (const SIM_WORKLOAD &workload : workloads)
+    if (workload.name == name)
+      return &workload;
+  return 0;
+}
+
+std::vector<std::string> sim_workload_names()
+{
+  std::vector<std::string> names;
+  for (const SIM_WORKLOAD &workload : workloads)
+    names.push_back(workload.name);
+  return names;
+}
+
+void SIM_STATS::add(const SIM_STATS &other)
+{
+  arrivals += other.arrivals;
+  presses += other.presses;
+  timeouts += other.timeouts;
+  false_offs += other.false_offs;
+  on_us += other.on_us;
+  wasted_us += other.wasted_us;
+  eeprom_writes += other.eeprom_writes;
+  provision_failures += other.provision_failures;
+}
+
+static void sim_tx(HOST_BOARD *board, uint8_t byte, uint8_t to_bus)
+{
+  (void)to_bus;
+  SIM_INSTANCE *sim = (SIM_INSTANCE *)board->user;
+  if (byte == '\r')
+    return;
+  if (byte != '\n')
+  {
+    if (sim->rx_line.size() < 128)
+      sim->rx_line += (char)byte;
+    return;
+  }
+  // only acknowledgements matter: "@<seq> <result>". "@<seq> progress <percents>" of background job precedes it
+  size_t space = sim->rx_line.find(' ');
+  if (sim->rx_line[0] == '@' && space != std::string::npos && sim->rx_line.compare(space + 1, 9, "progress ") != 0)
+    sim->last_ack = sim->rx_line.substr(space + 1);
+  sim->rx_line.clear();
+}
+
+static double arrival_rate(const SIM_WORKLOAD *workload, uint64_t now_us)
+{
+  uint64_t hour = now_us / 3600000000ULL % 24;
+  return workload->arrivals_per_hour * (hour < 6 ? workload->night_factor : 1.0);
+}
+
+static uint64_t next_arrival(SIM_INSTANCE *sim, uint64_t now_us)
+{
+  double rate = arrival_rate(sim->workload, now_us);
+  if (rate <= 0)
+    return now_us + 3600000000ULL; // nobody comes this hour, look again in next one
+  std::exponential_distribution<double> gap(rate);
+  return now_us + (uint64_t)(gap(sim->rng) * 3600e6) + 1;
+}
+
+static void plan_press(SIM_INSTANCE *sim, uint64_t at_us)
+{
+  if (sim->press_at_us == 0 && sim->release_at_us == 0)
+    sim->press_at_us = at_us;
+}
+
+static void occupant(SIM_INSTANCE *sim, uint64_t now)
+{
+  const SIM_WORKLOAD *workload = sim->workload;
+
+  if (!sim->is_present && now >= sim->next_arrival_us)
+  {
+    std::lognormal_distribution<double> stay(log(workload->stay_minutes), workload->stay_sigma);
+    sim->is_present = 1;
+    sim->stats.arrivals++;
+    sim->departure_us = now + (uint64_t)(stay(sim->rng) * 60e6);
+    if (!sim->is_light_on)
+      plan_press(sim, now);
+  }
+  else if (sim->is_present && now >= sim->departure_us)
+  {
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    sim->is_present = 0;
+    sim->next_arrival_us = next_arrival(sim, now);
+    if (sim->is_light_on && chance(sim->rng) >= workload->leave_on)
+      plan_press(sim, now);
+  }
+
+  if (sim->press_at_us != 0 && now >= sim->press_at_us)
+  {
+    host_pin_input(&sim->board, SIM_BUTTON_PIN, LOW);
+    sim->press_at_us = 0;
+    sim->release_at_us = now + SIM_PRESS_US;
+    sim->last_press_us = now;
+    sim->stats.presses++;
+  }
+  else if (sim->release_at_us != 0 && now >= sim->release_at_us)
+  {
+    host_pin_input(&sim->board, SIM_BUTTON_PIN, HOST_FLOATING);
+    sim->release_at_us = 0;
+  }
+}
+
+static void sample_light(SIM_INSTANCE *sim, uint64_t now)
+{
+  HOST_BOARD *board = &sim->board;
+  uint8_t is_on = board->pin_mode[SIM_RELAY_PIN] == OUTPUT && host_pin_level(board, SIM_RELAY_PIN) == LOW;
+  uint64_t elapsed = now - sim->last_sample_us;
+
+  if (sim->is_light_on)
+  {
+    sim->stats.on_us += elapsed;
+    if (!sim->is_present)
+      sim->stats.wasted_us += elapsed;
+  }
+  if (sim->is_light_on && !is_on && now - sim->last_press_us > SIM_SETTLE_US)
+  {
+    sim->stats.timeouts++;
+    if (sim->is_present)
+    {
+      sim->stats.false_offs++;
+      plan_press(sim, now + (uint64_t)(sim->workload->reaction_s * 1e6));
+    }
+  }
+  sim->is_light_on = is_on;
+  sim->last_sample_us = now;
+}
+
+static uint64_t next_step(SIM_INSTANCE *sim, uint64_t now)
+{
+  if (sim->release_at_us != 0 || now - sim->last_press_us < SIM_SETTLE_US)
+    return SIM_ACTIVE_STEP_US;
+  uint64_t next = sim->is_present ? sim->departure_us : sim->next_arrival_us;
+  if (sim->press_at_us != 0 && sim->press_at_us < next)
+    next = sim->press_at_us;
+  if (next <= now + SIM_ACTIVE_STEP_US)
+    return SIM_ACTIVE_STEP_US;
+  return next - now < SIM_IDLE_STEP_US ? next - now : SIM_IDLE_STEP_US;
+}
+
+static void run_until_ack(SIM_INSTANCE *sim, const std::string &command)
+{
+  HOST_BOARD *board = &sim->board;
+  size_t fed = 0;
+  uint64_t deadline = host_now_us(board) + 30000000ULL;
+
+  sim->last_ack.clear();
+  while (sim->last_ack.empty() && host_now_us(board) < deadline)
+  {
+    if (fed < command.size())
+      fed += host_serial_feed(board, (const uint8_t *)command.data() + fed, command.size() - fed);
+    loop();
+    host_advance(board, SIM_ACTIVE_STEP_US);
+  }
+  if (sim->last_ack != "done")
+    sim->stats.provision_failures++;
+}
+
+void sim_instance_init(SIM_INSTANCE *sim, const SIM_WORKLOAD *workload, uint64_t seed,
+                       const std::vector<uint8_t> &pristine)
+{
+  HOST_BOARD *board = &sim->board;
+
+  host_board_init(board, 1);
+  board->tick_us = SIM_TICK_US;
+  board->tx = sim_tx;
+  board->user = sim;
+  sim->rng.seed(seed);
+  sim->workload = workload;
+  sim->is_present = 0;
+  sim->is_light_on = 0;
+  sim->press_at_us = 0;
+  sim->release_at_us = 0;
+  sim->last_press_us = 0;
+  sim->stats = SIM_STATS();
+
+  host_board = board;
+  fw_state_load(pristine.data());
+  setup();
+
+  std::string batch = "{\"class\":\"C\",\"action\":\"batch\",\"buttons\":[[3,\"M\",0]],\"relays\":[[\"A0\",\"L\"]]";
+  if (workload->timeout_minutes)
+    batch += ",\"timeout\":" + std::to_string(workload->timeout_minutes);
+  run_until_ack(sim, batch + "}\n");
+
+  uint64_t now = host_now_us(board);
+  sim->provision_writes = board->eeprom_writes;
+  sim->last_sample_us = now;
+  sim->next_arrival_us = next_arrival(sim, now);
+  sim->state.resize(fw_state_size());
+  fw_state_save(sim->state.data());
+}
+
+void sim_instance_run(SIM_INSTANCE *sim, uint64_t until_us)
+{
+  HOST_BOARD *board = &sim->board;
+
+  host_board = board;
+  fw_state_load(sim->state.data());
+  while (host_now_us(board) < until_us)
+  {
+    occupant(sim, host_now_us(board));
+    loop();
+    uint64_t now = host_now_us(board);
+    sample_light(sim, now);
+    host_advance(board, next_step(sim, now));
+  }
+  sim->stats.eeprom_writes = board->eeprom_writes - sim->provision_writes;
+  fw_state_save(sim->state.data());
+}
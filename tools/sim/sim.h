@@ -0,0 +1,83 @@
+#ifndef SIM_H
+#define SIM_H
+
+/* Virtual controllers for fleet simulation (env:fleet_sim). Every controller is real firmware (src/main.cpp)
+   on own emulated board (host/host.h) with own copy of firmware globals (fw_state_*), stepped on virtual time.
+   Synthetic occupant uses momentary button and watches light through relay, like person in bathroom would */
+
+#include <stdint.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "host.h"
+
+#define SIM_BUTTON_PIN 3      // momentary button, pressed connects to GND
+#define SIM_RELAY_PIN 14      // A0, low triggered relay: light is on when pin is low
+#define SIM_ACTIVE_STEP_US 10000ULL   // loop() period while button is held or light may change soon
+#define SIM_IDLE_STEP_US 1000000ULL   // loop() period while nothing happens, timeout is counted in minutes
+#define SIM_PRESS_US 150000ULL        // how long button is held
+#define SIM_SETTLE_US 2000000ULL      // light change after press within this time is caused by press
+#define SIM_TICK_US 500               // virtual time of every millis()/micros() call of simulated firmware
+
+// Synthetic occupancy of one room
+struct SIM_WORKLOAD
+{
+  std::string name;
+  double arrivals_per_hour; // daytime rate of Poisson arrivals
+  double night_factor;      // rate multiplier from 0:00 to 6:00
+  double stay_minutes;      // median of log-normal stay
+  double stay_sigma;        // log-normal shape, bigger - more long stays
+  double leave_on;          // probability occupant leaves without switching light off
+  double reaction_s;        // time to press button again after light went off while present
+  int timeout_minutes;      // initial timeout given to controller by set_timeout, 0 - firmware default
+};
+
+// Named workloads, selected by -w option of fleet_sim
+const SIM_WORKLOAD *sim_workload(const std::string &name);
+std::vector<std::string> sim_workload_names();
+
+struct SIM_STATS
+{
+  uint64_t arrivals;
+  uint64_t presses;
+  uint64_t timeouts;      // light switched off without press
+  uint64_t false_offs;    // timeouts while occupant is present
+  uint64_t on_us;         // time light was on
+  uint64_t wasted_us;     // time light was on while room is empty
+  uint64_t eeprom_writes; // EEPROM bytes written after provisioning
+  uint64_t provision_failures;
+
+  void add(const SIM_STATS &other);
+};
+
+struct SIM_INSTANCE
+{
+  HOST_BOARD board;
+  std::vector<uint8_t> state; // firmware globals while instance is not running (fw_state_save)
+  std::mt19937_64 rng;
+  const SIM_WORKLOAD *workload;
+
+  uint8_t is_present;
+  uint8_t is_light_on;
+  uint64_t next_arrival_us;
+  uint64_t departure_us;
+  uint64_t press_at_us;       // press planned by occupant, 0 - none
+  uint64_t release_at_us;     // button is held until this time, 0 - not held
+  uint64_t last_press_us;
+  uint64_t last_sample_us;
+  uint32_t provision_writes;  // EEPROM writes of provisioning, not counted in stats
+  std::string rx_line;        // output of firmware being received
+  std::string last_ack;       // result of last acknowledged command
+  SIM_STATS stats;
+};
+
+// Powers up instance on calling thread from pristine firmware state and provisions button, relay and timeout
+// by batch command over serial. Pristine state is fw_state_save() of thread which never ran setup()
+void sim_instance_init(SIM_INSTANCE *sim, const SIM_WORKLOAD *workload, uint64_t seed,
+                       const std::vector<uint8_t> &pristine);
+
+// Steps instance on calling thread until its virtual time reaches until_us
+void sim_instance_run(SIM_INSTANCE *sim, uint64_t until_us);
+
+#endif
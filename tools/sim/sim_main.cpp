@@ -0,0 +1,167 @@
+/* Fleet simulator (env:fleet_sim): thousands of virtual controllers running firmware from src/main.cpp
+   on virtual time, stepped by work-stealing thread pool, driven by synthetic occupancy.
+
+   fleet_sim [options]
+   Options:
+     -n <count>    controllers (default 1000)
+     -t <threads>  worker threads (default one per core)
+     -D <days>     simulated time (default 1)
+     -w <name>     workload: bathroom, hallway, closet, office (default bathroom)
+     -a <rate>     arrivals per hour          \
+     -m <minutes>  median stay                 |
+     -l <p>        probability to leave light on  > override values of workload
+     -r <seconds>  reaction to false off       |
+     -T <minutes>  initial timeout            /
+     -e <minutes>  epoch: controllers are synchronized after every epoch (default 60)
+     -s <seed>     random seed (default 1). Results don't depend on number of threads
+
+   Example: fleet_sim -n 5000 -D 7 -w hallway -T 10 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <deque>
+
+#include "pool.h"
+#include "sim.h"
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: fleet_sim [-n count] [-t threads] [-D days] [-w workload] [-a arrivals_per_hour] "
+                  "[-m stay_minutes] [-l leave_on] [-r reaction_s] [-T timeout_minutes] [-e epoch_minutes] [-s seed]\n"
+                  "workloads:");
+  for (const std::string &name : sim_workload_names())
+    fprintf(stderr, " %s", name.c_str());
+  fprintf(stderr, "\n");
+  exit(2);
+}
+
+static double per_day(double value, double controller_days)
+{
+  return controller_days > 0 ? value / controller_days : 0;
+}
+
+int main(int argc, char **argv)
+{
+  size_t count = 1000;
+  unsigned threads = 0;
+  double days = 1;
+  double epoch_minutes = 60;
+  uint64_t seed = 1;
+  const SIM_WORKLOAD *preset = sim_workload("bathroom");
+  SIM_WORKLOAD workload;
+  double arrivals = -1, stay = -1, leave_on = -1, reaction = -1;
+  int timeout = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:t:D:w:a:m:l:r:T:e:s:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      count = strtoul(optarg, 0, 10);
+      break;
+    case 't':
+      threads = strtoul(optarg, 0, 10);
+      break;
+    case 'D':
+      days = atof(optarg);
+      break;
+    case 'w':
+      preset = sim_workload(optarg);
+      if (!preset)
+        usage();
+      break;
+    case 'a':
+      arrivals = atof(optarg);
+      break;
+    case 'm':
+      stay = atof(optarg);
+      break;
+    case 'l':
+      leave_on = atof(optarg);
+      break;
+    case 'r':
+      reaction = atof(optarg);
+      break;
+    case 'T':
+      timeout = atoi(optarg);
+      break;
+    case 'e':
+      epoch_minutes = atof(optarg);
+      break;
+    case 's':
+      seed = strtoull(optarg, 0, 10);
+      break;
+    default:
+      usage();
+    }
+  }
+  if (count == 0 || days <= 0 || epoch_minutes <= 0)
+    usage();
+
+  workload = *preset;
+  if (arrivals >= 0)
+    workload.arrivals_per_hour = arrivals;
+  if (stay > 0)
+    workload.stay_minutes = stay;
+  if (leave_on >= 0)
+    workload.leave_on = leave_on;
+  if (reaction >= 0)
+    workload.reaction_s = reaction;
+  if (timeout >= 0)
+    workload.timeout_minutes = timeout;
+
+  // globals of main thread never ran setup(), every controller starts from copy of them
+  std::vector<uint8_t> pristine(fw_state_size());
+  fw_state_save(pristine.data());
+
+  WorkPool pool(threads);
+  std::deque<SIM_INSTANCE> sims(count); // deque: instances are big and never move
+  auto start = std::chrono::steady_clock::now();
+
+  pool.run(count, [&](size_t i, unsigned) {
+    sim_instance_init(&sims[i], &workload, seed * 0x9E3779B97F4A7C15ULL + i, pristine);
+  });
+
+  uint64_t end_us = (uint64_t)(days * 86400e6);
+  uint64_t epoch_us = (uint64_t)(epoch_minutes * 60e6);
+  for (uint64_t until = epoch_us; ; until += epoch_us)
+  {
+    if (until > end_us)
+      until = end_us;
+    pool.run(count, [&](size_t i, unsigned) { sim_instance_run(&sims[i], until); });
+    if (until >= end_us)
+      break;
+  }
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  SIM_STATS total = SIM_STATS();
+  uint64_t max_writes = 0;
+  for (SIM_INSTANCE &sim : sims)
+  {
+    total.add(sim.stats);
+    if (sim.stats.eeprom_writes > max_writes)
+      max_writes = sim.stats.eeprom_writes;
+  }
+  double controller_days = count * days;
+
+  printf("workload %s: %zu controllers, %.2f days, %u threads\n", workload.name.c_str(), count, days, pool.size());
+  printf("%-20s %12s %14s\n", "", "total", "per ctrl-day");
+  printf("%-20s %12llu %14.2f\n", "arrivals", (unsigned long long)total.arrivals, per_day(total.arrivals, controller_days));
+  printf("%-20s %12llu %14.2f\n", "presses", (unsigned long long)total.presses, per_day(total.presses, controller_days));
+  printf("%-20s %12llu %14.2f\n", "timeouts", (unsigned long long)total.timeouts, per_day(total.timeouts, controller_days));
+  printf("%-20s %12llu %14.2f\n", "false offs", (unsigned long long)total.false_offs,
+         per_day(total.false_offs, controller_days));
+  printf("%-20s %12.1f %14.2f\n", "light on, h", total.on_us / 3600e6, per_day(total.on_us / 3600e6, controller_days));
+  printf("%-20s %12.1f %14.2f\n", "empty room lit, h", total.wasted_us / 3600e6,
+         per_day(total.wasted_us / 3600e6, controller_days));
+  printf("%-20s %12llu %14.2f (max %.2f)\n", "EEPROM writes", (unsigned long long)total.eeprom_writes,
+         per_day(total.eeprom_writes, controller_days), per_day(max_writes, days));
+  printf("%-20s %12llu\n", "provision failures", (unsigned long long)total.provision_failures);
+  printf("wall %.2f s, %.1f ctrl-days/s, %llu steals\n", wall_s, controller_days / wall_s,
+         (unsigned long long)pool.steals());
+  return total.provision_failures ? 1 : 0;
+}
@@ -0,0 +1,414 @@
+/* Cycle accurate runs of AVR firmware in simavr (env:simavr). Real nanoatmega328 build runs on emulated ATmega328P
+   at 16 MHz: script drives button pins and firmware UART, relay pins are watched with cycle of every change, and
+   firmware built with CYCLE_MARKS (env:nanoatmega328_simavr, include/cycle_marks.h) gives cycles of its hot paths.
+   Host build (env:native) runs the same code, but its times aren't times of the board.
+
+   avr_bench [options] <firmware.elf> [script file]
+   Script (default stdin), one action per line, numbers are decimal or 0x hex, # starts comment:
+     run <ms>                 run firmware
+     pin <pin> <level>        drive input pin (press button wired to GND with 0). Emulator has no pull-ups, so
+                              released buttons are driven high before first run
+     serial <line>            send line to firmware UART, bytes take their time at 9600 baud
+     wait <pin> <level> <ms>  run until pin has level, print cycles from last pin or serial action
+     ack <ms>                 run until firmware prints acknowledgement "@...", print cycles from last action.
+                              Progress of background job isn't acknowledgement
+     expect <pin> <level>     exit code 1 if pin has other level
+     marks                    print cycles of marked paths since previous "marks" and reset them
+   Marks left after script are printed at exit. Cycles of path include interrupts served inside it.
+   simavr finishes EEPROM write at once, so rom_update has cycles of CPU, not ~3.3 ms write time of chip.
+   Options:
+     -e <file>   EEPROM image to boot with (eeprom.bin of env:native or .bin of tools/eeprom)
+     -v          print firmware serial output and pin changes
+   Example (tools/simavr/bench.txt), edge to relay latency of locked button on pin 3 and relay on pin 14 (A0),
+   then command to relay:
+     serial {"class":"C","action":"batch","buttons":[[3,"L",0]],"relays":[["A0","H"]]}
+     ack 3000
+     pin 3 1
+     run 200
+     pin 3 0
+     wait 14 1 100
+     serial {"class":"C","action":"light_state","options":[0]}
+     wait 14 0 200
+     marks */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/avr_eeprom.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+
+#define CYCLE_MARK_NAMES
+#include "cycle_marks.h"
+
+#define BENCH_MCU "atmega328p"
+#define BENCH_HZ 16000000UL
+#define BENCH_CYCLES_PER_MS (BENCH_HZ / 1000)
+#define BENCH_PINS 20       // D0..D13, A0..A5
+#define BENCH_EEPROM 1024
+#define BENCH_GPIOR0 0x3E   // data space address of GPIOR0 (I/O 0x1E)
+
+struct MARK_STATS
+{
+  uint64_t opened; // cycle of start mark
+  uint8_t is_open;
+  uint32_t count;
+  uint64_t total, min, max;
+};
+
+struct BENCH
+{
+  avr_t *avr;
+  avr_irq_t *pins[BENCH_PINS];
+  uint8_t levels[BENCH_PINS];
+  uint64_t changed[BENCH_PINS]; // cycle of last level change
+  avr_irq_t *uart_in;
+  std::string rx;     // bytes for firmware UART not taken yet
+  uint8_t is_xoff;    // UART input FIFO is full
+  std::string line;   // firmware output line being received
+  uint32_t acks;      // acknowledgement lines received
+  uint64_t acked;     // cycle of last acknowledgement
+  uint64_t action;    // cycle of last pin or serial action
+  MARK_STATS marks[MARK_COUNT];
+};
+
+static BENCH bench;
+static bool is_verbose = false;
+
+static bool pin_port(uint8_t pin, char *port, uint8_t *bit)
+{
+  if (pin < 8)
+    *port = 'D', *bit = pin;
+  else if (pin < 14)
+    *port = 'B', *bit = pin - 8;
+  else if (pin < BENCH_PINS)
+    *port = 'C', *bit = pin - 14;
+  else
+    return false;
+  return true;
+}
+
+static void pin_changed(avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void)irq;
+  uint8_t pin = (uintptr_t)param;
+  if (bench.levels[pin] == (value != 0))
+    return;
+  bench.levels[pin] = value != 0;
+  bench.changed[pin] = bench.avr->cycle;
+  if (is_verbose)
+    printf("[%llu] pin %u = %u\n", (unsigned long long)bench.avr->cycle, pin, bench.levels[pin]);
+}
+
+static void uart_feed(void)
+{
+  while (!bench.is_xoff && !bench.rx.empty())
+  {
+    uint8_t byte = bench.rx[0];
+    bench.rx.erase(0, 1);
+    avr_raise_irq(bench.uart_in, byte);
+  }
+}
+
+static void uart_xon(avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void)irq, (void)value, (void)param;
+  bench.is_xoff = 0;
+  uart_feed();
+}
+
+static void uart_xoff(avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void)irq, (void)value, (void)param;
+  bench.is_xoff = 1;
+}
+
+static void uart_output(avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void)irq, (void)param;
+  if (is_verbose)
+    fputc(value, stdout);
+  if (value == '\r')
+    return;
+  if (value != '\n')
+  {
+    bench.line += (char)value;
+    return;
+  }
+  // "@<seq> progress <percents>" of background job is followed by final acknowledgement
+  if (!bench.line.empty() && bench.line[0] == '@' && bench.line.find(" progress ") == std::string::npos)
+  {
+    bench.acks++;
+    bench.acked = bench.avr->cycle;
+  }
+  bench.line.clear();
+}
+
+// Firmware writes mark to GPIOR0 at start of path and mark | MARK_END at its end
+static void mark_write(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+  (void)param;
+  avr->data[addr] = v;
+  uint8_t id = v & ~MARK_END;
+  if (id == 0 || id >= MARK_COUNT)
+    return;
+  MARK_STATS *mark = &bench.marks[id];
+  if (!(v & MARK_END))
+  {
+    mark->opened = avr->cycle;
+    mark->is_open = 1;
+    return;
+  }
+  if (!mark->is_open)
+    return;
+  uint64_t cycles = avr->cycle - mark->opened;
+  mark->is_open = 0;
+  mark->min = mark->count == 0 || cycles < mark->min ? cycles : mark->min;
+  mark->max = cycles > mark->max ? cycles : mark->max;
+  mark->total += cycles;
+  mark->count++;
+}
+
+static bool marks_print(void)
+{
+  bool is_any = false;
+  for (uint8_t id = 1; id < MARK_COUNT; id++)
+    is_any = is_any || bench.marks[id].count;
+  if (!is_any)
+    return false;
+  printf("%-12s %8s %10s %10s %10s %10s\n", "path", "count", "min", "avg", "max", "max us");
+  for (uint8_t id = 1; id < MARK_COUNT; id++)
+  {
+    MARK_STATS *mark = &bench.marks[id];
+    if (mark->count)
+      printf("%-12s %8u %10llu %10llu %10llu %10.1f\n", cycle_mark_names[id], mark->count,
+             (unsigned long long)mark->min, (unsigned long long)(mark->total / mark->count),
+             (unsigned long long)mark->max, mark->max * 1e6 / BENCH_HZ);
+    mark->count = 0;
+    mark->total = mark->min = mark->max = 0;
+  }
+  return true;
+}
+
+// Runs until cycle limit or until done() is true, false when firmware has stopped
+template <typename DONE>
+static bool run_until(uint64_t until, DONE done)
+{
+  while (bench.avr->cycle < until && !done())
+  {
+    int state = avr_run(bench.avr);
+    if (state == cpu_Done || state == cpu_Crashed)
+    {
+      fprintf(stderr, "firmware stopped at cycle %llu, pc 0x%04X\n", (unsigned long long)bench.avr->cycle,
+              (unsigned)bench.avr->pc);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void print_latency(int line_no, const char *what, uint64_t cycle)
+{
+  uint64_t cycles = cycle - bench.action;
+  printf("line %d: %s after %llu cycles (%.1f us)\n", line_no, what, (unsigned long long)cycles,
+         cycles * 1e6 / BENCH_HZ);
+}
+
+static std::vector<uint32_t> numbers(std::istringstream &words)
+{
+  std::vector<uint32_t> result;
+  std::string word;
+  while (words >> word)
+    result.push_back(strtoul(word.c_str(), 0, 0));
+  return result;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: avr_bench [-e eeprom.bin] [-v] <firmware.elf> [script]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  const char *eeprom_path = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "e:v")) != -1)
+  {
+    switch (opt)
+    {
+    case 'e':
+      eeprom_path = optarg;
+      break;
+    case 'v':
+      is_verbose = true;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind != argc - 1 && optind != argc - 2)
+    usage();
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[optind], &firmware) != 0)
+  {
+    fprintf(stderr, "%s: can't read firmware\n", argv[optind]);
+    return 2;
+  }
+  if (!firmware.mmcu[0])
+    strcpy(firmware.mmcu, BENCH_MCU); // Arduino builds have no .mmcu section
+  firmware.frequency = BENCH_HZ;
+
+  std::ifstream file;
+  if (optind == argc - 2)
+  {
+    file.open(argv[optind + 1]);
+    if (!file)
+    {
+      fprintf(stderr, "%s: can't open\n", argv[optind + 1]);
+      return 2;
+    }
+  }
+  std::istream &script = optind == argc - 2 ? file : std::cin;
+
+  avr_t *avr = avr_make_mcu_by_name(firmware.mmcu);
+  if (!avr)
+  {
+    fprintf(stderr, "%s: unknown MCU\n", firmware.mmcu);
+    return 2;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  bench.avr = avr;
+
+  if (eeprom_path)
+  {
+    static uint8_t image[BENCH_EEPROM];
+    FILE *in = fopen(eeprom_path, "rb");
+    size_t size = in ? fread(image, 1, sizeof(image), in) : 0;
+    if (size == 0)
+    {
+      fprintf(stderr, "%s: can't read EEPROM image\n", eeprom_path);
+      return 2;
+    }
+    fclose(in);
+    avr_eeprom_desc_t desc = {image, 0, (uint32_t)size};
+    avr_ioctl(avr, AVR_IOCTL_EEPROM_SET, &desc);
+  }
+
+  for (uint8_t pin = 0; pin < BENCH_PINS; pin++)
+  {
+    char port;
+    uint8_t bit;
+    pin_port(pin, &port, &bit);
+    bench.pins[pin] = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), IOPORT_IRQ_PIN0 + bit);
+    avr_irq_register_notify(bench.pins[pin], pin_changed, (void *)(uintptr_t)pin);
+  }
+
+  uint32_t flags = 0;
+  avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO; // output goes through uart_output()
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+  bench.uart_in = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), uart_output, 0);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XON), uart_xon, 0);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XOFF), uart_xoff, 0);
+  avr_register_io_write(avr, BENCH_GPIOR0, mark_write, 0);
+
+  int failures = 0;
+  std::string line;
+  for (int line_no = 1; std::getline(script, line); line_no++)
+  {
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    std::string action;
+    if (!(words >> action))
+      continue;
+
+    if (action == "serial")
+    {
+      bench.rx += line.substr(line.find("serial") + 7) + "\n";
+      bench.action = avr->cycle;
+      uart_feed();
+      continue;
+    }
+
+    std::vector<uint32_t> args = numbers(words);
+    bool is_running = true;
+    if (action == "run" && args.size() == 1)
+    {
+      is_running = run_until(avr->cycle + (uint64_t)args[0] * BENCH_CYCLES_PER_MS, [] { return false; });
+    }
+    else if (action == "pin" && args.size() == 2 && args[0] < BENCH_PINS)
+    {
+      avr_raise_irq(bench.pins[args[0]], args[1] != 0);
+      bench.action = avr->cycle;
+    }
+    else if (action == "wait" && args.size() == 3 && args[0] < BENCH_PINS)
+    {
+      uint8_t pin = args[0], level = args[1] != 0;
+      is_running = run_until(avr->cycle + (uint64_t)args[2] * BENCH_CYCLES_PER_MS,
+                             [&] { return bench.levels[pin] == level; });
+      if (bench.levels[pin] == level)
+      {
+        std::string what = "pin " + std::to_string(pin) + " = " + std::to_string(level);
+        print_latency(line_no, what.c_str(), bench.changed[pin]);
+      }
+      else
+      {
+        printf("line %d: pin %u isn't %u after %u ms\n", line_no, pin, level, args[2]);
+        failures++;
+      }
+    }
+    else if (action == "ack" && args.size() == 1)
+    {
+      uint32_t acks = bench.acks;
+      is_running = run_until(avr->cycle + (uint64_t)args[0] * BENCH_CYCLES_PER_MS, [&] { return bench.acks != acks; });
+      if (bench.acks != acks)
+      {
+        print_latency(line_no, "acknowledged", bench.acked);
+      }
+      else
+      {
+        printf("line %d: no acknowledgement after %u ms\n", line_no, args[0]);
+        failures++;
+      }
+    }
+    else if (action == "expect" && args.size() == 2 && args[0] < BENCH_PINS)
+    {
+      if (bench.levels[args[0]] != (args[1] != 0))
+      {
+        printf("line %d: pin %u is %u, expected %u\n", line_no, args[0], bench.levels[args[0]], args[1] != 0);
+        failures++;
+      }
+    }
+    else if (action == "marks" && args.empty())
+    {
+      if (!marks_print())
+        printf("line %d: no marks, firmware isn't built with CYCLE_MARKS\n", line_no);
+    }
+    else
+    {
+      fprintf(stderr, "line %d: can't parse \"%s\"\n", line_no, line.c_str());
+      return 2;
+    }
+    if (!is_running)
+      return 2;
+  }
+  marks_print();
+  printf("%.1f ms of board time, %llu cycles\n", avr->cycle * 1e3 / BENCH_HZ, (unsigned long long)avr->cycle);
+  return failures ? 1 : 0;
+}